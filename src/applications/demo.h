@@ -33,8 +33,7 @@ public:
   void counter() {
     DistributedDataFrame* v = DistributedDataFrame::deserialize(kv.waitAndGet(main)->serialized(), &kv);
     Logger::log("Counter got frame.");
-    double sum = 0;
-    for (size_t i = 0; i < 100*1000; ++i) sum += v->get_double(0,i);
+    double sum = v->aggregate<double>(0).sum();
     p("The sum is  ").pln(sum);
     delete DistributedDataFrame::fromScalar(verify, &kv, sum);
     Logger::log("Counter done.");
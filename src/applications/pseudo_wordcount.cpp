@@ -0,0 +1,23 @@
+#include "wordcount.h"
+
+int main(int argc, char** argv) {
+    assert(argc == 2); // the file to count the words of
+    args = new Args();
+    args->num_nodes = 3;
+
+    PseudoNetwork* net = new PseudoNetwork(3);
+
+    WordCount* nodes[3];
+    NodeThread* threads[3];
+    for (size_t i = 0; i < 3; i++)
+    {
+        nodes[i] = new WordCount(i, net, argv[1], 3);
+        threads[i] = new NodeThread(nodes[i]);
+    }
+
+    Logger::log("Starting word count threads.");
+    for (size_t i = 0; i < 3; i++) threads[i]->start();
+
+    Logger::log("Joining threads");
+    for (size_t i = 0; i < 3; i++) threads[i]->join();
+}
@@ -2,9 +2,10 @@
 
 #include <assert.h>
 
-#include "../dataframe/dataframe.h"
+#include "../dataframe/distributed_dataframe.h"
 #include "../client/application.h"
-#include "../client/visitor.h"
+#include "../dataframe/visitor.h"
+#include "../utils/map.h"
 
 class FileReader : public Writer {
 public:
@@ -25,8 +26,10 @@ public:
             ++i_;
         }
         buf_[i_] = 0;
-        String word(buf_ + wStart, i_ - wStart);
-        r.set(0, &word);
+        // the row borrows the word, so it has to outlive this visit
+        delete word_;
+        word_ = new String(buf_ + wStart, i_ - wStart);
+        r.set(0, word_);
         ++i_;
         skipWhitespace_();
     }
@@ -37,13 +40,19 @@ public:
     bool done() override { return (i_ >= end_) && feof(file_);  }
  
     /** Creates the reader and opens the file for reading.  */
-    FileReader() {
-        file_ = fopen(arg.file, "r");
-        if (file_ == nullptr) FATAL_ERROR("Cannot open file " << arg.file);
+    FileReader(const char* path) {
+        file_ = fopen(path, "r");
+        assert(file_ != nullptr);
         buf_ = new char[BUFSIZE + 1]; //  null terminator
         fillBuffer_();
         skipWhitespace_();
     }
+
+    ~FileReader() {
+        fclose(file_);
+        delete[](buf_);
+        delete word_;
+    }
  
     static const size_t BUFSIZE = 1024;
  
@@ -77,6 +86,7 @@ public:
     }
  
     char * buf_;
+    String * word_ = nullptr; // owned, the last word read
     size_t end_ = 0;
     size_t i_ = 0;
     FILE * file_;
@@ -87,14 +97,15 @@ public:
   int v;
 
   Num() { v = 0; }
+
+  Num(int n) { v = n; }
+
+  Object* clone() override { return new Num(v); }
 };
 
+/** A map from words to their counts, the map keeps its own copies of both */
 class SIMap : public Map {
 public:
-  SIMap(SIMap& map) {
-    SIMap* clone = map.clone();
-  }
-
   Num* get(String& word) {
     return dynamic_cast<Num*>(Map::get(&word));
   }
@@ -106,72 +117,69 @@ public:
   bool contains(String& word) {
     return get(word) != nullptr;
   }
+
+  /** adds n to the word's count */
+  void add(String& word, int n) {
+    Num* num = get(word);
+    if(num != nullptr) {
+      num->v += n;
+      return;
+    }
+    Num first(n);
+    set(word, &first);
+  }
+
+  /** adds every count in other to this map's */
+  void add_all(SIMap& other) {
+    for (size_t i = 0; i < other.capacity_; i++)
+    {
+      for (Node* n = other.nodes_[i]; n != nullptr; n = n->next_)
+      {
+        add(*dynamic_cast<String*>(n->k_), dynamic_cast<Num*>(n->v_)->v);
+      }
+    }
+  }
 };
  
  
 /****************************************************************************/
-class Adder : public Reader {
+/** Adds up counts it sees, as rows of a word and how many times it was seen. */
+class Merger : public Rower {
 public:
-  SIMap& map_;  // String to Num map;  Num holds an int
- 
-  Adder(SIMap& map) : map_(map)  {}
- 
-  bool visit(Row& r) override {
-    String* word = r.get_string(0);
-    assert(word != nullptr);
-    Num* num = map_.contains(*word) ? map_.get(*word) : new Num();
-    assert(num != nullptr);
-    num->v++;
-    map_.set(*word, num);
+  SIMap& map_;
+
+  Merger(SIMap& map) : map_(map) {}
+
+  bool accept(Row& r) override {
+    map_.add(*r.get_string(0), r.get_int(1));
     return false;
   }
 };
  
 /***************************************************************************/
+/** Writes out a map as rows of a word and its count. */
 class Summer : public Writer {
 public:
   SIMap& map_;
-  size_t i = 0;
-  size_t j = 0;
-  size_t seen = 0;
- 
-  Summer(SIMap& map) : map_(map) {}
- 
-  void next() {
-      if (i == map_.capacity_ ) return;
-      if ( j < map_.items_[i].keys_.size() ) {
-          j++;
-          ++seen;
-      } else {
-          ++i;
-          j = 0;
-          while( i < map_.capacity_ && map_.items_[i].keys_.size() == 0 )  i++;
-          if (k()) ++seen;
-      }
-  }
+  size_t i = 0; // the bucket being walked
+  Node* node_ = nullptr; // the next entry to write, external
  
-  String* k() {
-      if (i==map_.capacity_ || j == map_.items_[i].keys_.size()) return nullptr;
-      return (String*) (map_.items_[i].keys_.get_(j));
-  }
- 
-  size_t v() {
-      if (i == map_.capacity_ || j == map_.items_[i].keys_.size()) {
-          assert(false); return 0;
-      }
-      return ((Num*)(map_.items_[i].vals_.get_(j)))->v;
+  Summer(SIMap& map) : map_(map) { next_(); }
+
+  // moves to the next entry, starting at node_'s successor
+  void next_() {
+      if (node_ != nullptr) node_ = node_->next_;
+      while (node_ == nullptr && i < map_.capacity_) node_ = map_.nodes_[i++];
   }
  
-  void visit(Row& r) {
-      if (!k()) next();
-      String & key = *k();
-      size_t value = v();
-      r.set(0, key);
-      r.set(1, (int) value);
-      next();
+  void visit(Row& r) override {
+      assert(node_ != nullptr);
+      r.set(0, dynamic_cast<String*>(node_->k_));
+      r.set(1, dynamic_cast<Num*>(node_->v_)->v);
+      next_();
   }
  
-  bool done() {return seen == map_.size(); }
+  bool done() override { return node_ == nullptr; }
 };
  
 /****************************************************************************
@@ -182,19 +190,19 @@ public:
  **********************************************************author: pmaj ****/
 class WordCount: public Application {
 public:
-  static const size_t BUFSIZE = 1024;
   Key in;
-  KeyBuff kbuf;
-  SIMap all;
+  const char* file_; // external
+  size_t num_nodes_;
+  size_t words_ = 0; // different words found, once node 0 has reduced
  
-  WordCount(size_t idx, NetworkIfc & net):
-    Application(idx, net), in("data"), kbuf(new Key("wc-map-",0)) { }
+  WordCount(size_t idx, NetworkIfc* net, const char* file, size_t num_nodes):
+    Application(idx, net), in("data", 0), file_(file), num_nodes_(num_nodes) { }
  
   /** The master nodes reads the input, then all of the nodes count. */
   void run_() override {
     if (this_node() == 0) {
-      FileReader fr;
-      delete DataFrame::fromVisitor(&in, &kv, "S", fr);
+      FileReader fr(file_);
+      delete DistributedDataFrame::fromVisitor(&in, &kv, "S", fr);
     }
     local_count();
     reduce();
@@ -203,21 +211,38 @@ public:
   /** Returns a key for given node.  These keys are homed on master node
    *  which then joins them one by one. */
   Key* mk_key(size_t idx) {
-      Key * k = kbuf.c(idx).get();
-      LOG("Created key " << k->c_str());
+      StrBuff buf;
+      buf.c("wc-map-");
+      char* idx_str = to_str<size_t>(idx);
+      buf.c(idx_str);
+      delete[](idx_str);
+      String* name = buf.get();
+      Key* k = new Key(name->c_str(), 0);
+      delete(name);
       return k;
   }
+
+  /** Waits for the dataframe under the given key */
+  DistributedDataFrame* wait_for(Key* k) {
+    Value* v = kv.waitAndGet(k);
+    DistributedDataFrame* df = DistributedDataFrame::deserialize(v->serialized(), &kv);
+    delete(v);
+    return df;
+  }
  
   /** Compute word counts on the local node and build a data frame. */
   void local_count() {
-    DataFrame* words = (kv.waitAndGet(in));
+    DistributedDataFrame* words = wait_for(&in);
     p("Node ").p(this_node()).pln(": starting local count...");
+    // each chunk's words are counted by dictionary code, so the map sees every distinct word once a chunk
     SIMap map;
-    Adder add(map);
-    words->local_map(add);
+    Merger add(map);
+    words->local_group_count(0, add);
     delete words;
     Summer cnt(map);
-    delete DataFrame::fromVisitor(mk_key(index), &kv, "SI", cnt);
+    Key* k = mk_key(this_node());
+    delete DistributedDataFrame::fromVisitor(k, &kv, "SI", cnt);
+    delete k;
   }
  
   /** Merge the data frames of all nodes */
@@ -225,20 +250,18 @@ public:
     if (this_node() != 0) return;
     pln("Node 0: reducing counts...");
     SIMap map;
-    Key* own = mk_key(0);
-    merge(kv.get(*own), map);
-    for (size_t i = 1; i < arg.num_nodes; ++i) { // merge other nodes
-      Key* ok = mk_key(i);
-      merge(kv.waitAndGet(*ok), map);
-      delete ok;
+    for (size_t i = 0; i < num_nodes_; ++i) {
+      Key* k = mk_key(i);
+      merge(wait_for(k), map);
+      delete k;
     }
-    p("Different words: ").pln(map.size());
-    delete own;
+    words_ = map.count();
+    p("Different words: ").pln(words_);
   }
  
-  void merge(DataFrame* df, SIMap& m) {
-    Adder add(m);
+  void merge(DistributedDataFrame* df, SIMap& m) {
+    Merger add(m);
     df->map(add);
     delete df;
   }
-}; // WordcountDemo
\ No newline at end of file
+}; // WordcountDemo
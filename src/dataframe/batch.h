@@ -0,0 +1,199 @@
+#pragma once
+
+#include <assert.h>
+
+#include "../utils/object.h"
+#include "../utils/string.h"
+#include "../utils/bitmap.h"
+#include "../utils/primitivearray.h"
+
+#include "schema.h"
+
+#define BATCH_ROWS 1024 // the most rows handed to a Batcher at once, a multiple of 64
+
+/*************************************************************************
+ * ColumnBatch::
+ *
+ * A run of consecutive rows of a dataframe, seen a column at a time. Each
+ * column is a plain array of its values borrowed straight from the column's
+ * chunk, so loops over it can be vectorized. Nothing is copied, strings
+ * included, and the arrays are only good until the next batch. Bools come
+ * as a bitmap, as does the selection, so predicates on them can be combined
+ * a word at a time. Strings come with their chunk's dictionary codes too.
+ */
+class ColumnBatch : public Object {
+public:
+    char* types_; // owned
+    size_t width_;
+    const void** cols_; // owned, elements external
+    const uint32_t** codes_; // owned, elements external - the dictionary codes of string columns
+    StringArrayChunk** dicts_; // owned, elements external - the chunks string columns come from
+    size_t start_; // the dataframe row of the first row in the batch
+    size_t count_;
+    uint64_t* selected_; // owned - a bitmap of the rows a filter keeps, all of them unless a Batcher says otherwise
+
+    /** Build a batch following a schema. */
+    ColumnBatch(Schema& scm) {
+        types_ = duplicate(scm.col_types);
+        width_ = scm.width();
+        cols_ = new const void*[width_];
+        codes_ = new const uint32_t*[width_];
+        dicts_ = new StringArrayChunk*[width_];
+        selected_ = new uint64_t[bitmap_words(BATCH_ROWS)];
+        start_ = 0;
+        count_ = 0;
+    }
+
+    ~ColumnBatch() {
+        delete[](types_);
+        delete[](cols_);
+        delete[](codes_);
+        delete[](dicts_);
+        delete[](selected_);
+    }
+
+    /** Points the batch at a new run of rows. Called by the dataframe before each batch. */
+    void reset(size_t start, size_t count) {
+        assert(count <= BATCH_ROWS);
+        start_ = start;
+        count_ = count;
+        memset(selected_, 0xff, bitmap_words(count_) * sizeof(uint64_t));
+        if(count_ > 0) selected_[bitmap_words(count_) - 1] &= bitmap_tail_mask(count_);
+    }
+
+    void set_column(size_t col, const void* values) {
+        assert(col < width_);
+        cols_[col] = values;
+    }
+
+    /** Points a string column at the chunk's strings from idx on. */
+    void set_strings(size_t col, StringArrayChunk* chunk, size_t idx) {
+        set_column(col, chunk->views(idx));
+        codes_[col] = chunk->codes(idx);
+        dicts_[col] = chunk;
+    }
+
+    /** The number of rows in the batch. */
+    size_t count() { return count_; }
+
+    /** The dataframe row of the batch's first row. */
+    size_t start() { return start_; }
+
+    size_t width() { return width_; }
+
+    char col_type(size_t col) { return types_[col]; }
+
+    /** The values of the given column, count() of them. Asking for the wrong type is an error. */
+    const int* ints(size_t col) {
+        assert(types_[col] == 'I');
+        return static_cast<const int*>(cols_[col]);
+    }
+
+    const double* doubles(size_t col) {
+        assert(types_[col] == 'F');
+        return static_cast<const double*>(cols_[col]);
+    }
+
+    /** Bools are a bitmap, see bitmap_get. Bits past count() may be set. */
+    const uint64_t* bools(size_t col) {
+        assert(types_[col] == 'B');
+        return static_cast<const uint64_t*>(cols_[col]);
+    }
+
+    /** The strings are views into the column's chunk, not copies: strings(col)[i] is row i's. */
+    String* strings(size_t col) {
+        assert(types_[col] == 'S');
+        return static_cast<String*>(const_cast<void*>(cols_[col]));
+    }
+
+    /** The dictionary codes of a string column. Rows hold equal strings exactly when their codes are equal. */
+    const uint32_t* codes(size_t col) {
+        assert(types_[col] == 'S');
+        return codes_[col];
+    }
+
+    /** Looks up the code the given string has in a string column, false if no row in the batch's chunk holds it. */
+    bool find_code(size_t col, String* s, uint32_t* code) {
+        assert(types_[col] == 'S');
+        return dicts_[col]->find(s, code);
+    }
+
+    /** Keeps only the selected rows whose string in the given column equals s, comparing codes. */
+    void select_equal(size_t col, String* s) {
+        uint32_t code;
+        size_t words = bitmap_words(count_);
+        if(!find_code(col, s, &code)) {
+            memset(selected_, 0, words * sizeof(uint64_t));
+            return;
+        }
+        const uint32_t* c = codes(col);
+        for (size_t w = 0; w < words; w++)
+        {
+            uint64_t bits = 0;
+            size_t end = (w + 1) * BITMAP_WORD_BITS < count_ ? (w + 1) * BITMAP_WORD_BITS : count_;
+            for (size_t i = w * BITMAP_WORD_BITS; i < end; i++) bits |= (uint64_t)(c[i] == code) << (i % BITMAP_WORD_BITS);
+            selected_[w] &= bits;
+        }
+    }
+
+    /** Marks whether a filter should keep the given row of the batch. */
+    void select(size_t row, bool keep) {
+        assert(row < count_);
+        bitmap_set(selected_, row, keep);
+    }
+
+    bool selected(size_t row) { return bitmap_get(selected_, row); }
+
+    /** Keeps only the selected rows whose bit is set in the given bitmap, e.g. a bool column. */
+    void select_and(const uint64_t* bits) { bitmap_and(selected_, bits, count_); }
+
+    /** Also keeps the rows whose bit is set in the given bitmap. */
+    void select_or(const uint64_t* bits) {
+        bitmap_or(selected_, bits, count_);
+        selected_[bitmap_words(count_) - 1] &= bitmap_tail_mask(count_);
+    }
+
+    /** Flips which rows are kept. */
+    void select_not() { bitmap_not(selected_, count_); }
+
+    /** The selection as a bitmap, count() bits long. */
+    const uint64_t* selection() { return selected_; }
+
+    /** How many rows are selected. */
+    size_t selected_count() { return bitmap_count(selected_, count_); }
+};
+
+/*******************************************************************************
+ *  Batcher::
+ *  Like a Rower, but is handed a batch of rows at a time in columnar form
+ *  rather than one Row per call. Batchers can be cloned for parallel execution.
+ */
+class Batcher : public Object {
+ public:
+  /** Called once per batch, in row order. The batch is on loan and is reused
+      for the next one. Filters deselect the rows they don't want to keep. */
+  virtual void accept(ColumnBatch& b) { }
+
+  /** Once traversal is complete the batchers that were split off will be
+      joined, in row order. The join method is reponsible for cleaning up memory. */
+  virtual void join_delete(Batcher* other) { delete(other); }
+
+  // clones this type of batcher.
+  virtual Object * clone() { return new Batcher(); }
+};
+
+/** Keeps the rows whose string in the given column equals the given string, comparing codes rather than characters. */
+class StringEquals : public Batcher {
+ public:
+  size_t col_;
+  String* s_; // external
+
+  StringEquals(size_t col, String* s) {
+    col_ = col;
+    s_ = s;
+  }
+
+  void accept(ColumnBatch& b) { b.select_equal(col_, s_); }
+
+  Object* clone() { return new StringEquals(col_, s_); }
+};
@@ -1,12 +1,14 @@
 #pragma once
 
+#include <stdarg.h>
+
 #include "../utils/object.h"
 #include "../utils/string.h"
 #include "../utils/primitivearray.h"
 
 // page size divided by type size
 #define INT_CHUNK_SIZE 4096 / sizeof(int) 
-#define BOOL_CHUNK_SIZE 4096 / sizeof(bool) 
+#define BOOL_CHUNK_SIZE 4096 * 8 // bools are packed into bits
 #define DOUBLE_CHUNK_SIZE 4096 / sizeof(double) 
 #define STRING_CHUNK_SIZE 4096 / sizeof(String *) 
 
@@ -37,6 +39,10 @@ class Column : public SerializableObject {
   virtual void push_back(double val) { return; }
   virtual void push_back(String* val) { return; }
  
+  /** Moves the values of other, a column of the same type, onto the end of this one, see
+    * PrimitiveArray::take_chunks. This column's chunks must be full. */
+  virtual void take_chunks(Column* other) { assert(false); }
+ 
  /** Returns the number of elements in the column. */
   virtual size_t size() { return 0; }
  
@@ -87,9 +93,12 @@ class IntColumn : public Column {
   }
 
   void push_back(int val) { this->as_int()->_data->push_back(val); }
+  void take_chunks(Column* other) { _data->take_chunks(other->as_int()->_data); }
 
   int get(size_t idx) { return _data->get(idx); }
   IntColumn* as_int() { return dynamic_cast<IntColumn *>(this); }
+  /** The count, sum, min, max, mean and variance of the column's values. */
+  Aggregate aggregate() { return _data->aggregate(); }
   void set(size_t idx, int val) { _data->set(idx, val); }
   size_t size() { return _data->count(); }
 
@@ -108,24 +117,26 @@ class IntColumn : public Column {
   }
 
   SerialString* serialize() {
-    SerialString* data_serial = _data->serialize();
-    
-    size_t size = data_serial->size_ + 1;
-    char* serialStr = new char[size];
-    serialStr[0] = 'I';
-
-    memcpy(serialStr+1, data_serial->data_, data_serial->size_);
-    delete(data_serial);
+    Serializer s;
+    serialize_into(s);
+    return s.to_serial();
+  }
 
-    SerialString* serial = new SerialString(serialStr, size);
-    delete[](serialStr);
-    return serial;
+  void serialize_into(Serializer& s) {
+    char tag = 'I';
+    s.write(&tag, 1);
+    _data->serialize_into(s);
   }
 
   static IntColumn* deserialize(SerialString* serialized) {
+    Deserializer d(serialized);
+    return deserialize(d);
+  }
+
+  static IntColumn* deserialize(Deserializer& d) {
     IntColumn* col = new IntColumn();
     delete(col->_data);
-    col->_data = PrimitiveArray<int>::deserialize(serialized);
+    col->_data = PrimitiveArray<int>::deserialize(d);
     return col;
   }
 };
@@ -164,9 +175,12 @@ class DoubleColumn : public Column {
   }
 
   void push_back(double val) { this->as_double()->_data->push_back(val); }
+  void take_chunks(Column* other) { _data->take_chunks(other->as_double()->_data); }
 
   double get(size_t idx) { return _data->get(idx); }
   DoubleColumn* as_double() { return dynamic_cast<DoubleColumn *>(this); }
+  /** The count, sum, min, max, mean and variance of the column's values. */
+  Aggregate aggregate() { return _data->aggregate(); }
   void set(size_t idx, float val) { _data->set(idx, val); }
   size_t size() { return _data->count(); }
 
@@ -186,24 +200,26 @@ class DoubleColumn : public Column {
   }
 
   SerialString* serialize() {
-    SerialString* data_serial = _data->serialize();
-    
-    size_t size = data_serial->size_ + 1;
-    char* serialStr = new char[size];
-    serialStr[0] = 'F';
-
-    memcpy(serialStr+1, data_serial->data_, data_serial->size_);
-    delete(data_serial);
+    Serializer s;
+    serialize_into(s);
+    return s.to_serial();
+  }
 
-    SerialString* serial = new SerialString(serialStr, size);
-    delete[](serialStr);
-    return serial;
+  void serialize_into(Serializer& s) {
+    char tag = 'F';
+    s.write(&tag, 1);
+    _data->serialize_into(s);
   }
 
   static DoubleColumn* deserialize(SerialString* serialized) {
+    Deserializer d(serialized);
+    return deserialize(d);
+  }
+
+  static DoubleColumn* deserialize(Deserializer& d) {
     DoubleColumn* col = new DoubleColumn();
     delete(col->_data);
-    col->_data = PrimitiveArray<double>::deserialize(serialized);
+    col->_data = PrimitiveArray<double>::deserialize(d);
     return col;
   }
 };
@@ -244,9 +260,18 @@ class BoolColumn : public Column {
   }
 
   void push_back(bool val) { this->as_bool()->_data->push_back(val); }  
+  void take_chunks(Column* other) { _data->take_chunks(other->as_bool()->_data); }
 
   bool get(size_t idx) { return _data->get(idx); }
   BoolColumn* as_bool() { return dynamic_cast<BoolColumn *>(this); }
+  /** How many of the values are true, counted a word at a time. */
+  size_t trues() {
+    size_t n = 0;
+    for (size_t i = 0; i < _data->chunks_; i++) n += _data->data_[i]->trues();
+    return n;
+  }
+  /** The count, sum, min, max, mean and variance of the column's values. */
+  Aggregate aggregate() { return _data->aggregate(); }
   void set(size_t idx, bool val) { _data->set(idx, val); }
   size_t size() { return _data->count(); }
 
@@ -265,24 +290,26 @@ class BoolColumn : public Column {
   }
 
   SerialString* serialize() {
-    SerialString* data_serial = _data->serialize();
-    
-    size_t size = data_serial->size_ + 1;
-    char* serialStr = new char[size];
-    serialStr[0] = 'B';
-
-    memcpy(serialStr+1, data_serial->data_, data_serial->size_);
-    delete(data_serial);
+    Serializer s;
+    serialize_into(s);
+    return s.to_serial();
+  }
 
-    SerialString* serial = new SerialString(serialStr, size);
-    delete[](serialStr);
-    return serial;
+  void serialize_into(Serializer& s) {
+    char tag = 'B';
+    s.write(&tag, 1);
+    _data->serialize_into(s);
   }
 
   static BoolColumn* deserialize(SerialString* serialized) {
+    Deserializer d(serialized);
+    return deserialize(d);
+  }
+
+  static BoolColumn* deserialize(Deserializer& d) {
     BoolColumn* col = new BoolColumn();
     delete(col->_data);
-    col->_data = PrimitiveArray<bool>::deserialize(serialized);
+    col->_data = PrimitiveArray<bool>::deserialize(d);
     return col;
   }
 };
@@ -327,6 +354,7 @@ class StringColumn : public Column {
   /** Acquire ownership for the string. */
   void set(size_t idx, String* val) { _data->set(idx, new String(*val)); }
   void push_back(String* val) { _data ->push_back(val); }
+  void take_chunks(Column* other) { _data->take_chunks(other->as_string()->_data); }
   size_t size() { return _data->count(); }
 
   bool data_equals(Object  * other) {
@@ -344,24 +372,26 @@ class StringColumn : public Column {
   }
 
   SerialString* serialize() {
-    SerialString* data_serial = _data->serialize();
-    
-    size_t size = data_serial->size_ + 1;
-    char* serialStr = new char[size];
-    serialStr[0] = 'S';
-
-    memcpy(serialStr+1, data_serial->data_, data_serial->size_);
-    delete(data_serial);
+    Serializer s;
+    serialize_into(s);
+    return s.to_serial();
+  }
 
-    SerialString* serial = new SerialString(serialStr, size);
-    delete[](serialStr);
-    return serial;
+  void serialize_into(Serializer& s) {
+    char tag = 'S';
+    s.write(&tag, 1);
+    _data->serialize_into(s);
   }
 
   static StringColumn* deserialize(SerialString* serialized) {
+    Deserializer d(serialized);
+    return deserialize(d);
+  }
+
+  static StringColumn* deserialize(Deserializer& d) {
     StringColumn* col = new StringColumn();
     delete(col->_data);
-    col->_data = StringArray::deserialize(serialized);
+    col->_data = StringArray::deserialize(d);
     return col;
   }
 };
\ No newline at end of file
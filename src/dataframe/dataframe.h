@@ -7,6 +7,7 @@
 #include "../utils/array.h"
 #include "../utils/string.h"
 #include "../utils/thread.h"
+#include "../utils/pool.h"
 
 #include "../store/kvstore.h"
 #include "../store/key.h"
@@ -15,6 +16,7 @@
 #include "column.h"
 #include "row.h"
 #include "visitor.h"
+#include "batch.h"
 
 /****************************************************************************
  * DataFrame::
@@ -190,6 +192,17 @@ class DataFrame : public SerializableObject {
     }
   }
  
+  /** Moves the rows of other, a dataframe with the same columns, onto the end of this one by
+    * handing over its columns' chunks rather than copying values, leaving other with no rows.
+    * This dataframe must hold a multiple of chunk_rows() rows so that its chunks are all full. */
+  void take_chunks(DataFrame* other) {
+    assert(strcmp(_schema->col_types, other->_schema->col_types) == 0);
+    assert(nrows() % chunk_rows() == 0);
+    for (size_t i = 0; i < ncols(); ++i) get_column_obj(i)->take_chunks(other->get_column_obj(i));
+    _schema->nrow += other->nrows();
+    other->_schema->nrow = 0;
+  }
+ 
   /** The number of rows in the dataframe. */
   size_t nrows() { return _schema->nrow; }
  
@@ -209,6 +222,157 @@ class DataFrame : public SerializableObject {
   /** This method clones the Rower and executes the map in parallel. Join is
   * used at the end to merge the results. */
   void pmap(Rower& r);
+
+  /** pmap on the given pool rather than the shared one */
+  void pmap(Rower& r, ThreadPool& pool);
+
+  /** Visit rows in order a batch at a time, handing the batcher column arrays
+    * rather than filling a Row for every row. */
+  void map_batch(Batcher& b) { map_batch(b, 0, nrows()); }
+
+  /** map_batch over the rows from start (inclusive) to end (exclusive). start
+    * must be a multiple of batch_rows(). */
+  void map_batch(Batcher& b, size_t start, size_t end) {
+    ColumnBatch batch(get_schema());
+    size_t step = batch_rows();
+    for (size_t i = start; i < end; i += step)
+    {
+      fill_batch(i, end - i < step ? end - i : step, batch);
+      b.accept(batch);
+    }
+  }
+
+  /** map_batch on clones of the batcher in parallel, joined at the end like pmap. */
+  void pmap_batch(Batcher& b);
+
+  /** pmap_batch on the given pool rather than the shared one */
+  void pmap_batch(Batcher& b, ThreadPool& pool);
+
+  /** Points the batch at count rows starting at the given row, which must not cross
+    * a chunk of any column. */
+  void fill_batch(size_t start, size_t count, ColumnBatch& batch) {
+    batch.reset(start, count);
+    for (size_t i = 0; i < ncols(); ++i)
+    {
+      switch(_schema->col_type(i)) {
+        case 'I':
+          batch.set_column(i, chunk_values_(get_column_obj(i)->as_int()->_data, start));
+          break;
+        case 'F':
+          batch.set_column(i, chunk_values_(get_column_obj(i)->as_double()->_data, start));
+          break;
+        case 'B': {
+          // a batch never starts part way through a word, since batch_rows() is a multiple of 64
+          PrimitiveArray<bool>* arr = get_column_obj(i)->as_bool()->_data;
+          assert(start % BITMAP_WORD_BITS == 0);
+          batch.set_column(i, arr->data_[start / arr->chunk_size_]->words_ + start % arr->chunk_size_ / BITMAP_WORD_BITS);
+          break;
+        }
+        case 'S': {
+          // the views are side by side within a block, which a batch never crosses
+          StringArray* arr = get_column_obj(i)->as_string()->_data;
+          assert(start % STRING_VIEW_BLOCK + count <= STRING_VIEW_BLOCK);
+          batch.set_strings(i, arr->data_[start / arr->chunk_size_], start % arr->chunk_size_);
+          break;
+        }
+        default:
+          break;
+      }
+    }
+  }
+
+  // where the given row's value sits in its chunk of arr
+  template<class T> const T* chunk_values_(PrimitiveArray<T>* arr, size_t row) {
+    return arr->data_[row / arr->chunk_size_]->data_ + row % arr->chunk_size_;
+  }
+
+  /** The number of rows in a batch: the smallest chunk of any column, so no batch
+    * crosses a chunk, and at most BATCH_ROWS. */
+  size_t batch_rows() {
+    size_t rows = BATCH_ROWS;
+    for (size_t i = 0; i < ncols(); ++i)
+    {
+      size_t col_rows = rows;
+      switch(_schema->col_type(i)) {
+        case 'I': col_rows = get_column_obj(i)->as_int()->_data->chunk_size_; break;
+        case 'F': col_rows = get_column_obj(i)->as_double()->_data->chunk_size_; break;
+        case 'B': col_rows = get_column_obj(i)->as_bool()->_data->chunk_size_; break;
+        case 'S': col_rows = get_column_obj(i)->as_string()->_data->chunk_size_; break;
+      }
+      if(col_rows < rows) rows = col_rows;
+    }
+    return rows;
+  }
+
+  /** Splits the rows into chunk aligned tasks of type T, each with its own clone of r,
+    * and joins the clones back into r in row order. */
+  template<class R, class T> void pmap_(R& r, ThreadPool& pool);
+
+  /** The number of rows in a chunk of every column. Chunk sizes are all powers of 2,
+   *  so the largest is a multiple of the rest. */
+  size_t chunk_rows() {
+    size_t rows = 1;
+    for (size_t i = 0; i < ncols(); ++i)
+    {
+      size_t col_rows = 1;
+      switch(_schema->col_type(i)) {
+        case 'I': col_rows = INT_CHUNK_SIZE; break;
+        case 'F': col_rows = DOUBLE_CHUNK_SIZE; break;
+        case 'B': col_rows = BOOL_CHUNK_SIZE; break;
+        case 'S': col_rows = STRING_CHUNK_SIZE; break;
+      }
+      if(col_rows > rows) rows = col_rows;
+    }
+    return rows;
+  }
+ 
+  /** Create a new dataframe from the rows the given Batcher leaves selected. */
+  DataFrame* filter_batch(Batcher& b) {
+    DataFrame* df = new DataFrame(*this);
+    ColumnBatch batch(get_schema());
+    size_t step = batch_rows();
+    for (size_t i = 0; i < nrows(); i += step)
+    {
+      fill_batch(i, nrows() - i < step ? nrows() - i : step, batch);
+      b.accept(batch);
+      df->append_selected_(batch);
+    }
+    return df;
+  }
+
+  /** Create a new dataframe from the rows whose string in the given column equals s.
+    * Strings are matched on their dictionary codes, a lookup per batch rather than a compare per row. */
+  DataFrame* filter_equal(size_t col, String* s) {
+    assert(_schema->col_type(col) == 'S');
+    StringEquals eq(col, s);
+    return filter_batch(eq);
+  }
+
+  // adds the batch's selected rows to the end of this dataframe
+  void append_selected_(ColumnBatch& batch) {
+    bitmap_for_each(batch.selection(), batch.count(), [&](size_t row) {
+      _schema->add_row();
+      for (size_t i = 0; i < ncols(); ++i)
+      {
+        switch(_schema->col_type(i)) {
+          case 'I':
+            get_column_obj(i)->push_back(batch.ints(i)[row]);
+            break;
+          case 'F':
+            get_column_obj(i)->push_back(batch.doubles(i)[row]);
+            break;
+          case 'B':
+            get_column_obj(i)->push_back(bitmap_get(batch.bools(i), row));
+            break;
+          case 'S':
+            get_column_obj(i)->push_back(&batch.strings(i)[row]);
+            break;
+          default:
+            break;
+        }
+      }
+    });
+  }
  
   /** Create a new dataframe, constructed from rows for which the given Rower
     * returned true from its accept method. */
@@ -281,61 +445,46 @@ class DataFrame : public SerializableObject {
   }
 
   SerialString* serialize() {
-    size_t size = 0;
-
-    SerialString* sch_serial = _schema->serialize();
-    size += sch_serial->size_;
-
-    SerialString** col_serial = new SerialString*[ncols()];
-    for (size_t i = 0; i < ncols(); i++) {
-      col_serial[i] = get_column_obj(i)->serialize();
-      size += col_serial[i]->size_;
-    }
-    
-    char* serialStr = new char[size];
-    size_t pos = 0;
-
-    memcpy(serialStr, sch_serial->data_, sch_serial->size_);
-    pos += sch_serial->size_;
-    delete(sch_serial);
+    Serializer s;
+    serialize_into(s);
+    return s.to_serial();
+  }
 
+  void serialize_into(Serializer& s) {
+    _schema->serialize_into(s);
     for (size_t i = 0; i < ncols(); i++) {
-      memcpy(&serialStr[pos], col_serial[i]->data_, col_serial[i]->size_);
-      pos += col_serial[i]->size_;
-      delete(col_serial[i]);
+      get_column_obj(i)->serialize_into(s);
     }
-    delete[](col_serial);
-
-    SerialString* serial = new SerialString(serialStr, size);
-    delete[](serialStr);
-
-    return serial;
   }
 
   static DataFrame* deserialize(SerialString* serialized) {
+    Deserializer d(serialized);
+    return deserialize(d);
+  }
+
+  static DataFrame* deserialize(Deserializer& d) {
     Schema empty("");
     DataFrame* df = new DataFrame(empty);
 
-    size_t pos = 0;
-    Schema* s = Schema::deserialize(serialized);
-    pos += sizeof(size_t) + sizeof(size_t) + s->width();
-
+    Schema* s = Schema::deserialize(d);
     for (size_t i = 0; i < s->width(); i++)
     {
       Column* c;
-      SerialString* serial = new SerialString(&serialized->data_[pos + 1], serialized->size_ - (pos + 1));
-      switch(s->col_type(i)) {
+      // each column leads with its type
+      char type = d.read<char>();
+      assert(type == s->col_type(i));
+      switch(type) {
         case 'I':
-          c = IntColumn::deserialize(serial);
+          c = IntColumn::deserialize(d);
           break;
         case 'B':
-          c = BoolColumn::deserialize(serial);
+          c = BoolColumn::deserialize(d);
           break;
         case 'F':
-          c = DoubleColumn::deserialize(serial);
+          c = DoubleColumn::deserialize(d);
           break;
         case 'S':
-          c = StringColumn::deserialize(serial);
+          c = StringColumn::deserialize(d);
           break;
         default:
           c = nullptr;
@@ -343,12 +492,8 @@ class DataFrame : public SerializableObject {
           break;
       }
       
-      SerialString* temp = c->serialize();
-      pos += temp->size_;
       df->add_column(c);
       delete(c);
-      delete(temp);
-      delete(serial);
     }
     delete(s);
     return df;
@@ -449,17 +594,15 @@ class ThreadableRower : public Rower {
 };
 
 /****************************************************************************
- * RowerThread::
+ * RowerTask::
  * 
- * A RowerThread is a thread runner that runs a rower on a given set of rows.
- * If the set contains more than one row, the RowerThread clones the rower and sets up 2 child RowerThreads.
- * It then splits up the set evenly between the two threads.
+ * A RowerTask runs a rower on a given set of rows as one task of a pmap.
  * The set of rows is determined by given start and end row indices (where start is inclusive, and end is not).
  */
-class RowerThread : public Thread {
+class RowerTask : public Task {
 public:
-  DataFrame* _df;
-  Rower* _p;
+  DataFrame* _df; // external
+  Rower* _p; // external
   size_t _start;
   size_t _end; // exclusive
 
@@ -471,17 +614,17 @@ public:
    * @param[in]  start  The starting row (inclusive)
    * @param[in]  end    The ending row (exclusive)
    */
-  RowerThread(DataFrame* df, Rower* p, size_t start, size_t end) {
+  RowerTask(DataFrame* df, Rower* p, size_t start, size_t end) {
     _df = df;
-    _p = dynamic_cast<Rower *>(p->clone());
+    _p = p;
     _start = start;
     _end = end;
   }
 
-  virtual void run() { 
+  void run() override { 
     // execute on our assigned row
     Row r(_df->get_schema());
-    for (int i = _start; i < _end; ++i)
+    for (size_t i = _start; i < _end; ++i)
     {
       _df->fill_row(i, r);
       _p->accept(r);
@@ -489,36 +632,98 @@ public:
   }
 };
 
-const size_t THREAD_ROW_RATIO = 100000; // number of rows to 1 thread
+/** Runs a batcher on a given set of rows as one task of a pmap_batch. */
+class BatchTask : public Task {
+public:
+  DataFrame* _df; // external
+  Batcher* _b; // external
+  size_t _start;
+  size_t _end; // exclusive
+
+  BatchTask(DataFrame* df, Batcher* b, size_t start, size_t end) {
+    _df = df;
+    _b = b;
+    _start = start;
+    _end = end;
+  }
+
+  void run() override { _df->map_batch(*_b, _start, _end); }
+};
+
+/** Joins one rower (or batcher) into another as a step of a pmap's reduction. */
+template<class R>
+class JoinTask : public Task {
+public:
+  R* _into; // external
+  R* _other; // consumed
+
+  JoinTask(R* into, R* other) {
+    _into = into;
+    _other = other;
+  }
+
+  void run() override { _into->join_delete(_other); }
+};
+
+const size_t PMAP_TASKS_PER_WORKER = 4; // spare tasks for workers that finish early to steal
 
 /** This method clones the Rower and executes the map in parallel. Join is
 * used at the end to merge the results. */
 void DataFrame::pmap(Rower& r) {
-  size_t numThreadsToSpawn = ((nrows() - (nrows() % THREAD_ROW_RATIO)) / THREAD_ROW_RATIO) + 1;
-  
-  if(numThreadsToSpawn <= 1) {
+  pmap(r, *ThreadPool::shared());
+}
+
+void DataFrame::pmap(Rower& r, ThreadPool& pool) {
+  pmap_<Rower, RowerTask>(r, pool);
+}
+
+void DataFrame::pmap_batch(Batcher& b) {
+  pmap_batch(b, *ThreadPool::shared());
+}
+
+void DataFrame::pmap_batch(Batcher& b, ThreadPool& pool) {
+  pmap_<Batcher, BatchTask>(b, pool);
+}
+
+/** Splits the rows into tasks along chunk boundaries, one rower clone per task. Once they've
+* all run, the clones are joined pairwise in parallel, halving them each round, and the last
+* one is joined into r. */
+template<class R, class T> void DataFrame::pmap_(R& r, ThreadPool& pool) {
+  size_t step = chunk_rows();
+  size_t chunks = (nrows() + step - 1) / step;
+  size_t tasks = pool.size() * PMAP_TASKS_PER_WORKER;
+  if(tasks > chunks) tasks = chunks;
+
+  if(tasks <= 1) {
     // we don't have enough rows to need multithreading
-    map(r);
+    T(this, &r, 0, nrows()).run();
     return;
   }
 
-  // distribute rows evenly between threads
-  size_t rowsPerThread = nrows() / numThreadsToSpawn;
-  RowerThread** threads = new RowerThread*[numThreadsToSpawn];
-
-  // spawn the threads
-  for (int i = 0; i < numThreadsToSpawn; ++i)
+  // distribute chunks evenly between tasks
+  R** rowers = new R*[tasks];
+  TaskGroup mapped;
+  size_t start = 0;
+  for (size_t i = 0; i < tasks; ++i)
   {
-    size_t end = i == numThreadsToSpawn - 1 ? nrows() : (i + 1) * rowsPerThread;
-    threads[i] = new RowerThread(this, &r, i * rowsPerThread, end);
-    threads[i]->start();
+    size_t task_chunks = chunks / tasks + (i < chunks % tasks ? 1 : 0);
+    size_t end = start + task_chunks * step < nrows() ? start + task_chunks * step : nrows();
+    rowers[i] = dynamic_cast<R *>(r.clone());
+    pool.submit(new T(this, rowers[i], start, end), &mapped);
+    start = end;
   }
-  // await the threads' completion and join them to the main rower
-  for (int i = 0; i < numThreadsToSpawn; ++i)
+  pool.wait(mapped);
+
+  // join neighbours, each rower only ever takes in the ones after it so rows stay in order
+  for (size_t stride = 1; stride < tasks; stride *= 2)
   {
-    threads[i]->join();
-    r.join_delete(threads[i]->_p);
+    TaskGroup joined;
+    for (size_t i = 0; i + stride < tasks; i += 2 * stride)
+    {
+      pool.submit(new JoinTask<R>(rowers[i], rowers[i + stride]), &joined);
+    }
+    pool.wait(joined);
   }
+  r.join_delete(rowers[0]);
+  delete[](rowers);
 }
-
-
@@ -1,5 +1,7 @@
 #pragma once
 
+#include <atomic>
+
 #include "../utils/object.h"
 #include "../utils/string.h"
 #include "../utils/primitivearray.h"
@@ -11,25 +13,6 @@
 // 4kb * 125 = 0.5 mb
 #define CHUNK_MEMORY 4096 * 125
 
-/**
- * @brief Metadata for a chunk, used for representing locally cached chunk
- * 
- */
-class ChunkMeta : public Object {
-public:
-    Key* key; // key in local store - owned
-    size_t chunk; // chunk index
-
-    ChunkMeta(Key* k, size_t c) {
-        key = k;
-        chunk = c;
-    }
-
-    ~ChunkMeta() {
-        delete(key);
-    }
-};
-
 template<class T>
 class Column : public SerializableObject {
 public:
@@ -37,21 +20,20 @@ public:
     KVStore* store_; // not owned
     Array* keys_; // owned
     size_t chunk_size_; // how many elements are stored in a chunk
-    ChunkMeta* cached_chunk_; // owned - the chunk most recently accessed, only exists if we have a store
     size_t next_node_; // where the next chunk will be shipped when completed
+    PutBatch* batch_; // external - if set, completed chunks are shipped through it instead of put one by one
 
     Column(size_t idx) {
         idx_ = idx;
         store_ = nullptr;
         keys_ = new Array();
-        chunk_size_ = CHUNK_MEMORY / sizeof(T);
-        cached_chunk_ = nullptr;
+        chunk_size_ = CHUNK_MEMORY * 8 / PrimitiveArrayChunk<T>::VALUE_BITS;
         next_node_ = 0;
+        batch_ = nullptr;
     }
 
     ~Column() {
         delete(keys_);
-        if(cached_chunk_ != nullptr) delete(cached_chunk_);
     }
 
     String* build_key(size_t chunk_idx, String* name) {
@@ -77,59 +59,59 @@ public:
         store_ = store;
     }
 
+    void set_batch(PutBatch* batch) {
+        batch_ = batch;
+    }
+
+    /** puts a completed chunk, through the batch if there is one */
+    void put_chunk(Key* k, Value* v) {
+        if(batch_ != nullptr) batch_->put(k, v);
+        else store_->put(k, v);
+    }
+
+    /** requests the values of the given keys all at once */
+    ValueFuture** get_chunks(Array* keys) {
+        Key** ks = new Key*[keys->count()];
+        for (size_t i = 0; i < keys->count(); i++) ks[i] = dynamic_cast<Key *>(keys->get(i));
+        ValueFuture** futures = store_->get_many(ks, keys->count());
+        delete[](ks);
+        return futures;
+    }
+
     virtual void push_back(T val, String* name) { assert(false); }
     virtual T get(size_t idx) { assert(false); return 0; }
     virtual size_t size() { assert(false); return 0; }
     virtual PrimitiveArray<T>* get_local_chunks_primitive(size_t node) { assert(false); return nullptr; }
     virtual StringArray* get_local_chunks_string(size_t node) { assert(false); return nullptr; }
-    virtual SerialString* serialize_last_chunk() { assert(false); return nullptr; }
+    virtual void serialize_last_chunk_into(Serializer& s) { assert(false); }
 
     /** Return a serialized version of this column's contents */
     SerialString* serialize() {
-        size_t keys_size = 0;
-        SerialString** keys_serials = new SerialString*[keys_->count()];
+        Serializer s;
+        serialize_into(s);
+        return s.to_serial();
+    }
+
+    void serialize_into(Serializer& s) {
+        s.write_size(idx_);
+        s.write_size(keys_->count());
         for (size_t i = 0; i < keys_->count(); i++)
         {
-            keys_serials[i] = dynamic_cast<Key *>(keys_->get(i))->serialize();
-            keys_size += keys_serials[i]->size_;
+            dynamic_cast<Key *>(keys_->get(i))->serialize_into(s);
         }
+        serialize_last_chunk_into(s);
+        s.write_size(next_node_);
+    }
 
-        SerialString* last_chunk_serial = serialize_last_chunk();
-
-        size_t sz = sizeof(size_t) + sizeof(size_t) + keys_size + last_chunk_serial->size_ + sizeof(size_t);
-        char* arr = new char[sz];
-        size_t pos = 0;
-
-        // idx_
-        memcpy(arr + pos, &idx_, sizeof(size_t));
-        pos += sizeof(size_t);
-
-        // num keys_
-        size_t num_keys = keys_->count();
-        memcpy(arr + pos, &num_keys, sizeof(size_t));
-        pos += sizeof(size_t);
-
-        // keys_
+    /** Reads the keys written by serialize_into, leaving d at the last chunk */
+    void deserialize_keys_(Deserializer& d) {
+        size_t num_keys = d.read_size();
         for (size_t i = 0; i < num_keys; i++)
         {
-            memcpy(arr + pos, keys_serials[i]->data_, keys_serials[i]->size_);
-            pos += keys_serials[i]->size_;
-            delete(keys_serials[i]);
+            Key* k = Key::deserialize(d);
+            keys_->append(k);
+            delete(k);
         }
-        delete[](keys_serials);
-
-        // last_chunk_
-        memcpy(arr + pos, last_chunk_serial->data_, last_chunk_serial->size_);
-        pos += last_chunk_serial->size_;
-        delete(last_chunk_serial);
-
-        // next_node_
-        memcpy(arr + pos, &next_node_, sizeof(size_t));
-        pos += sizeof(size_t);
-
-        SerialString* serial = new SerialString(arr, pos);
-        delete[](arr);
-        return serial;
     }
 };
 
@@ -165,7 +147,7 @@ public:
 
             // maybe want to check if our key is already in use?
             Value v(last_chunk_);
-            this->store_->put(k, &v);
+            this->put_chunk(k, &v);
 
             delete(kstr);
             this->next_node_ = (this->next_node_ + 1) % args->num_nodes;
@@ -182,25 +164,11 @@ public:
         if(chunk_idx == this->keys_->count()) return last_chunk_->get(idx_in_chunk);
 
         assert(this->store_ != nullptr); // at this point we need a store
-        Key* k;
-        if(this->cached_chunk_ != nullptr && this->cached_chunk_->chunk == chunk_idx) {
-            // grab key to cached chunk
-            k = this->cached_chunk_->key;
-        } else {
-            // grab key to external chunk
-            k = dynamic_cast<Key *>(this->keys_->get(chunk_idx));
-        }
-
-        //  grab the value from the store
+        Key* k = dynamic_cast<Key *>(this->keys_->get(chunk_idx));
         assert(k != nullptr);
-        Value* chunkV = this->store_->get(k);
 
-        // cache the chunk if we haven't already
-        if(k->idx_ != this->store_->idx_) {
-            if(this->cached_chunk_ != nullptr) { this->store_->remove(this->cached_chunk_->key); delete(this->cached_chunk_); }
-            this->cached_chunk_ = new ChunkMeta(new Key(k->name_, this->store_->idx_), chunk_idx);
-            this->store_->put(this->cached_chunk_->key, chunkV);
-        }
+        // chunks never change once stored, so remote ones can come out of the node's cache
+        Value* chunkV = this->store_->get_cached(k);
         
         T v = PrimitiveArrayChunk<T>::quick_deserialize(chunkV->serialized(), idx_in_chunk);
         delete(chunkV);
@@ -211,6 +179,42 @@ public:
         return (this->keys_->count() * this->chunk_size_) + last_chunk_->count();
     }
 
+    /**
+     * @brief the count, sum, min, max, mean and variance of the column's values. Each node
+     * aggregates the chunks it holds and sends back only the result, all at the same time.
+     */
+    Aggregate aggregate() {
+        size_t nodes = args->num_nodes;
+        ValueFuture** futures = new ValueFuture*[nodes];
+        Key** keys = new Key*[this->keys_->count() + 1];
+        // this node's own chunks are reduced in place, so go last and let the other nodes start first
+        for (size_t step = 1; step <= nodes; step++)
+        {
+            size_t node = (this->store_->idx_ + step) % nodes;
+            size_t n = 0;
+            for (size_t i = 0; i < this->keys_->count(); i++)
+            {
+                Key* k = dynamic_cast<Key *>(this->keys_->get(i));
+                if(k->idx_ == node) keys[n++] = k;
+            }
+            futures[node] = n > 0 ? this->store_->reduce_async(keys, n, elem_type<T>()) : nullptr;
+        }
+        delete[](keys);
+
+        Aggregate a = last_chunk_->aggregate();
+        for (size_t node = 0; node < nodes; node++)
+        {
+            if(futures[node] == nullptr) continue;
+            Value* v = futures[node]->get();
+            Aggregate part = Aggregate::deserialize(SerialView(v->serialized()));
+            a.merge(part);
+            delete(v);
+            delete(futures[node]);
+        }
+        delete[](futures);
+        return a;
+    }
+
     /** Gets all chunks local to the given node **/
     PrimitiveArray<T>* get_local_chunks_primitive(size_t node) override {
         Array local_keys;
@@ -220,22 +224,26 @@ public:
             Key* k = dynamic_cast<Key *>(this->keys_->get(i));
             if(k->idx_ == node) local_keys.append(k);
         }
+        // request every chunk up front so remote fetches are in flight together
+        ValueFuture** futures = this->get_chunks(&local_keys);
         // build a super array to hold all the chunks
         PrimitiveArray<T>* arr = new PrimitiveArray<T>(this->chunk_size_, local_keys.count() + 1);
         for (; arr->chunks_ < local_keys.count(); arr->chunks_++)
         {
-            Value* v = this->store_->get(dynamic_cast<Key *>(local_keys.get(arr->chunks_)));
+            Value* v = futures[arr->chunks_]->get();
             arr->data_[arr->chunks_] = PrimitiveArrayChunk<T>::deserialize(v->serialized());
             delete(v);
+            delete(futures[arr->chunks_]);
         }
+        delete[](futures);
         // grab last_chunk_ if we're the 0 node.
         if(node == 0) arr->data_[arr->chunks_++] = last_chunk_->clone();
 
         return arr;
     }
     
-    SerialString* serialize_last_chunk() override {
-        return last_chunk_->serialize();
+    void serialize_last_chunk_into(Serializer& s) override {
+        last_chunk_->serialize_into(s);
     }
 
     /** Return a copy of the object; nullptr is considered an error */
@@ -265,43 +273,18 @@ public:
 
     /** Deserialize the provided String into a DistributedColumn object */
     static DistributedColumn<T>* deserialize(SerialString* serialized) {
-        size_t pos = 0;
-
-        // idx_
-        size_t idx;
-        
-        memcpy(&idx, serialized->data_ + pos, sizeof(size_t));
-        pos += sizeof(size_t);
-
-        DistributedColumn<T>* col = new DistributedColumn<T>(idx);
+        Deserializer d(serialized);
+        return deserialize(d);
+    }
 
-        // keys_
-        size_t num_keys;
-        memcpy(&num_keys, serialized->data_ + pos, sizeof(size_t));
-        pos += sizeof(size_t);
+    static DistributedColumn<T>* deserialize(Deserializer& d) {
+        DistributedColumn<T>* col = new DistributedColumn<T>(d.read_size());
+        col->deserialize_keys_(d);
 
-        for (size_t i = 0; i < num_keys; i++)
-        {
-            // just look at the remains of serialized
-            SerialString* k_serial = new SerialString(serialized->data_ + pos, serialized->size_ - pos);
-            Key* k = Key::deserialize(k_serial);
-            delete(k_serial);
-            k_serial = k->serialize();
-            pos += k_serial->size_;
-            delete(k_serial);
-            col->keys_->append(k);
-        }
-
-        // last_chunk_
         delete(col->last_chunk_);
-        SerialString* last_chunk_serial = new SerialString(serialized->data_ + pos, serialized->size_ - pos);
-        col->last_chunk_ = PrimitiveArrayChunk<T>::deserialize(last_chunk_serial);
-        delete(last_chunk_serial);
-
-        // next_node_
-        pos = serialized->size_ - sizeof(size_t);
-        memcpy(&col->next_node_, serialized->data_ + pos, sizeof(size_t));
+        col->last_chunk_ = PrimitiveArrayChunk<T>::deserialize(d);
 
+        col->next_node_ = d.read_size();
         return col;
     }
 
@@ -313,6 +296,103 @@ public:
     }
 };
 
+/**
+ * A ChunkScan walks a DistributedColumn one chunk at a time in key order, giving direct access to each
+ * chunk's values. The next chunk is requested while the current one is being read.
+ */
+template<class T>
+class ChunkScan : public Object {
+public:
+    DistributedColumn<T>* col_; // external
+    size_t chunk_; // the chunk being read, the column's last chunk comes after every key
+    bool started_;
+    Value* value_; // owned - the current chunk's bytes, nullptr for the last chunk
+    ValueFuture* next_; // owned - the chunk after the current one, nullptr if it hasn't been asked for
+    T* copy_; // owned - the current chunk's values if they couldn't be read in place
+    const T* data_; // external
+    size_t count_;
+
+    ChunkScan(DistributedColumn<T>* col) {
+        col_ = col;
+        chunk_ = 0;
+        started_ = false;
+        value_ = nullptr;
+        next_ = nullptr;
+        copy_ = nullptr;
+        data_ = nullptr;
+        count_ = 0;
+    }
+
+    ~ChunkScan() {
+        release_();
+        if(next_ != nullptr) delete(next_->get());
+        delete(next_);
+    }
+
+    /**
+     * @brief moves on to the next chunk
+     * 
+     * @return true - if there is one, its values are in data() and count()
+     * @return false - if the column has been read through
+     */
+    bool next() {
+        if(started_) chunk_++;
+        started_ = true;
+        release_();
+        size_t keys = col_->keys_->count();
+        if(chunk_ > keys) return false;
+        if(chunk_ == keys) {
+            data_ = col_->last_chunk_->values();
+            count_ = col_->last_chunk_->count();
+            if(data_ == nullptr) {
+                // not kept as a plain array (bools), so copy the values out
+                copy_ = new T[count_];
+                col_->last_chunk_->copy_to(copy_);
+                data_ = copy_;
+            }
+            return true;
+        }
+
+        if(next_ == nullptr) next_ = request_(chunk_);
+        value_ = next_->get();
+        delete(next_);
+        next_ = chunk_ + 1 < keys ? request_(chunk_ + 1) : nullptr;
+
+        SerialView bytes(value_->serialized());
+        data_ = PrimitiveArrayChunk<T>::quick_view(bytes, &count_);
+        if(data_ == nullptr) {
+            // misaligned or not a plain array, so copy the values out
+            copy_ = new T[count_];
+            PrimitiveArrayChunk<T>::quick_copy(bytes, copy_);
+            data_ = copy_;
+        }
+        return true;
+    }
+
+    /** the current chunk's values, valid until next() */
+    const T* data() { return data_; }
+
+    /** how many values the current chunk holds */
+    size_t count() { return count_; }
+
+    /** the row of the current chunk's first value */
+    size_t first_row() { return chunk_ * col_->chunk_size_; }
+
+    ValueFuture* request_(size_t chunk) {
+        assert(col_->store_ != nullptr);
+        return col_->store_->get_cached_async(dynamic_cast<Key *>(col_->keys_->get(chunk)));
+    }
+
+    void release_() {
+        if(value_ != nullptr) delete(value_);
+        if(copy_ != nullptr) delete[](copy_);
+        value_ = nullptr;
+        copy_ = nullptr;
+        data_ = nullptr;
+        count_ = 0;
+    }
+};
+
 /** 
  * A DistributedStringColumn is a collection of Keys which point to string data belonging to this column.
  * When data is added to the column, it will be added to the currently cached chunk.
@@ -321,14 +401,25 @@ public:
 class DistributedStringColumn : public Column<String *> {
 public:
     StringArrayChunk* last_chunk_; // owned - the chunk currently being filled by push_back
+    std::atomic<StringArrayChunk*>* stored_; // owned, elements owned - stored chunks decoded by get, nullptr until then
+    size_t stored_slots_;
+    Lock stored_lock_; // held while installing a decoded chunk, not while fetching it
 
     /** Create an empty DistributedColumn representing the provided index */
     DistributedStringColumn(size_t idx) : Column(idx) {
         last_chunk_ = new StringArrayChunk(chunk_size_);
+        stored_ = nullptr;
+        stored_slots_ = 0;
     }
 
     ~DistributedStringColumn() {
         delete(last_chunk_);
+        for (size_t i = 0; i < stored_slots_; i++)
+        {
+            StringArrayChunk* chunk = stored_[i].load();
+            if(chunk != nullptr) delete(chunk);
+        }
+        if(stored_ != nullptr) delete[](stored_);
     }
 
     /** Append a new value to this distributed column */
@@ -340,10 +431,11 @@ public:
             
             Key* k = new Key(kstr->c_str(), next_node_);
             keys_->append(k);
+            grow_stored_();
 
             // maybe want to check if our key is already in use?
             Value v(last_chunk_);
-            store_->put(k, &v);
+            put_chunk(k, &v);
 
             delete(kstr);
             next_node_ = (next_node_ + 1) % args->num_nodes;
@@ -352,38 +444,53 @@ public:
         }
     }
 
+    /** a view of the string at idx, owned by the column */
     String* get(size_t idx) override {
         size_t chunk_idx = idx / chunk_size_;
         size_t idx_in_chunk = idx - (chunk_idx * chunk_size_);
 
         // check if pulling from last chunk
         if(chunk_idx == keys_->count()) return last_chunk_->get(idx_in_chunk);
+        return stored_chunk_(chunk_idx)->get(idx_in_chunk);
+    }
 
-        assert(store_ != nullptr); // at this point we need a store
-        Key* k;
-        if(cached_chunk_ != nullptr && cached_chunk_->chunk == chunk_idx) {
-            // grab key to cached chunk
-            k = cached_chunk_->key;
-        } else {
-            // grab key to external chunk
-            k = dynamic_cast<Key *>(keys_->get(chunk_idx));
-        }
+    /**
+     * @brief the stored chunk at the given index, decoded the first time it's asked for and kept
+     * until the column goes, so the views it hands out stay good
+     */
+    StringArrayChunk* stored_chunk_(size_t chunk_idx) {
+        assert(chunk_idx < stored_slots_);
+        StringArrayChunk* chunk = stored_[chunk_idx].load(std::memory_order_acquire);
+        if(chunk != nullptr) return chunk;
 
-        //  grab the value from the store
+        assert(store_ != nullptr); // at this point we need a store
+        Key* k = dynamic_cast<Key *>(keys_->get(chunk_idx));
         assert(k != nullptr);
-        Value* chunkV = store_->get(k);
+        // chunks never change once stored, so remote ones can come out of the node's cache
+        Value* chunkV = store_->get_cached(k);
+        StringArrayChunk* decoded = StringArrayChunk::deserialize(chunkV->serialized());
+        delete(chunkV);
 
-        // cache the chunk if we haven't already
-        if(k->idx_ != store_->idx_) {
-            if(cached_chunk_ != nullptr) delete(cached_chunk_);
-            cached_chunk_ = new ChunkMeta(new Key(k->name_, store_->idx_), chunk_idx);
-            store_->put(cached_chunk_->key, chunkV);
+        stored_lock_.lock();
+        chunk = stored_[chunk_idx].load(std::memory_order_relaxed);
+        if(chunk == nullptr) {
+            chunk = decoded;
+            stored_[chunk_idx].store(chunk, std::memory_order_release);
         }
-        
-        // use quick deserialize because we are grabbing a single value
-        String* v = StringArrayChunk::quick_deserialize(chunkV->serialized(), idx_in_chunk);
-        delete(chunkV);
-        return v;
+        else delete(decoded); // another thread got there first
+        stored_lock_.unlock();
+        return chunk;
+    }
+
+    // makes room for every key's decoded chunk, only while the column is being built or copied
+    void grow_stored_() {
+        if(keys_->count() <= stored_slots_) return;
+        size_t slots = stored_slots_ * 2 > keys_->count() ? stored_slots_ * 2 : keys_->count();
+        std::atomic<StringArrayChunk*>* stored = new std::atomic<StringArrayChunk*>[slots];
+        for (size_t i = 0; i < slots; i++) stored[i] = i < stored_slots_ ? stored_[i].load() : nullptr;
+        if(stored_ != nullptr) delete[](stored_);
+        stored_ = stored;
+        stored_slots_ = slots;
     }
 
     size_t size() override {
@@ -399,22 +506,26 @@ public:
             Key* k = dynamic_cast<Key *>(keys_->get(i));
             if(k->idx_ == node) local_keys.append(k);
         }
+        // request every chunk up front so remote fetches are in flight together
+        ValueFuture** futures = get_chunks(&local_keys);
         // build a super array to hold all the chunks
         StringArray* arr = new StringArray(chunk_size_, local_keys.count() + 1);
         for (; arr->chunks_ < local_keys.count(); arr->chunks_++)
         {
-            Value* v = store_->get(dynamic_cast<Key *>(local_keys.get(arr->chunks_)));
+            Value* v = futures[arr->chunks_]->get();
             arr->data_[arr->chunks_] = StringArrayChunk::deserialize(v->serialized());
             delete(v);
+            delete(futures[arr->chunks_]);
         }
+        delete[](futures);
         // grab last_chunk_ if we're the 0 node.
         if(node == 0) arr->data_[arr->chunks_++] = last_chunk_->clone();
 
         return arr;
     }
     
-    SerialString* serialize_last_chunk() override {
-        return last_chunk_->serialize();
+    void serialize_last_chunk_into(Serializer& s) override {
+        last_chunk_->serialize_into(s);
     }
 
     /** Return a copy of the object; nullptr is considered an error */
@@ -423,6 +534,7 @@ public:
         clone->store_ = store_;
         delete(clone->keys_);
         clone->keys_ = new Array(keys_);
+        clone->grow_stored_();
         for (size_t i = 0; i < last_chunk_->count(); i++)
         {
             clone->last_chunk_->push_back(last_chunk_->get(i));
@@ -444,43 +556,19 @@ public:
 
     /** Deserialize the provided String into a DistributedColumn object */
     static DistributedStringColumn* deserialize(SerialString* serialized) {
-        size_t pos = 0;
-
-        // idx_
-        size_t idx;
-        
-        memcpy(&idx, serialized->data_ + pos, sizeof(size_t));
-        pos += sizeof(size_t);
-
-        DistributedStringColumn* col = new DistributedStringColumn(idx);
-
-        // keys_
-        size_t num_keys;
-        memcpy(&num_keys, serialized->data_ + pos, sizeof(size_t));
-        pos += sizeof(size_t);
+        Deserializer d(serialized);
+        return deserialize(d);
+    }
 
-        for (size_t i = 0; i < num_keys; i++)
-        {
-            // just look at the remains of serialized
-            SerialString* k_serial = new SerialString(serialized->data_ + pos, serialized->size_ - pos);
-            Key* k = Key::deserialize(k_serial);
-            delete(k_serial);
-            k_serial = k->serialize();
-            pos += k_serial->size_;
-            delete(k_serial);
-            col->keys_->append(k);
-        }
+    static DistributedStringColumn* deserialize(Deserializer& d) {
+        DistributedStringColumn* col = new DistributedStringColumn(d.read_size());
+        col->deserialize_keys_(d);
+        col->grow_stored_();
 
-        // last_chunk_
         delete(col->last_chunk_);
-        SerialString* last_chunk_serial = new SerialString(serialized->data_ + pos, serialized->size_ - pos);
-        col->last_chunk_ = StringArrayChunk::deserialize(last_chunk_serial);
-        delete(last_chunk_serial);
-
-        // next_node_
-        pos = serialized->size_ - sizeof(size_t);
-        memcpy(&col->next_node_, serialized->data_ + pos, sizeof(size_t));
+        col->last_chunk_ = StringArrayChunk::deserialize(d);
 
+        col->next_node_ = d.read_size();
         return col;
     }
 
@@ -2,6 +2,7 @@
 
 #include <assert.h>
 #include <stdarg.h>
+#include <atomic>
 
 #include "../utils/helper.h"
 #include "../utils/array.h"
@@ -16,21 +17,45 @@
 #include "visitor.h"
 #include "distributed_column.h"
 
-class ColumnMeta : public Object {
+/**
+ * @brief One chunk of a column, decoded so the rows it holds can be read without going through the store.
+ * Only the chunk for the column's type is set.
+ */
+class DecodedChunk : public Object {
 public:
-  size_t idx;
-  Key* key; // owned
-  ChunkMeta* cached_chunk; // owned
+  char type_;
+  bool owned_; // the column's unfinished last chunk is borrowed from it
+  PrimitiveArrayChunk<int>* ints_;
+  PrimitiveArrayChunk<double>* doubles_;
+  PrimitiveArrayChunk<bool>* bools_;
+  StringArrayChunk* strings_;
+
+  DecodedChunk(char type, bool owned) {
+    type_ = type;
+    owned_ = owned;
+    ints_ = nullptr;
+    doubles_ = nullptr;
+    bools_ = nullptr;
+    strings_ = nullptr;
+  }
 
-  ColumnMeta(size_t i, Key* k) {
-    idx = i;
-    key = k;
-    cached_chunk = nullptr;
+  ~DecodedChunk() {
+    if(!owned_) return;
+    if(ints_ != nullptr) delete(ints_);
+    if(doubles_ != nullptr) delete(doubles_);
+    if(bools_ != nullptr) delete(bools_);
+    if(strings_ != nullptr) delete(strings_);
   }
 
-  ~ColumnMeta() {
-    delete(key);
-    delete(cached_chunk);
+  /** sets the given field of the row to the value at idx in this chunk, strings are borrowed */
+  void fill(Row& row, size_t col, size_t idx) {
+    switch(type_) {
+      case 'I': row.set(col, ints_->get(idx)); break;
+      case 'F': row.set(col, doubles_->get(idx)); break;
+      case 'B': row.set(col, bools_->get(idx)); break;
+      case 'S': row.set(col, strings_->get(idx)); break;
+      default: assert(false);
+    }
   }
 };
 
@@ -44,12 +69,15 @@ public:
   Schema* schema_; // owned
   KVStore* store_; // not owned
   Array* keys_; // owned
-  ColumnMeta* cached_column_;
+  std::atomic<Object*>* columns_; // owned, elements owned - decoded columns, nullptr until first read
+  size_t column_slots_; // length of columns_
+  Lock columns_lock_; // held while installing a decoded column, not while fetching it
 
   DistributedDataFrame(Schema& schema) {
     schema_ = new Schema(schema);
     keys_ = new Array();
-    cached_column_ = nullptr;
+    columns_ = nullptr;
+    reset_columns_();
   }
 
   ~DistributedDataFrame() {
@@ -59,7 +87,7 @@ public:
       delete(keys_->get(i));
     }
     delete(keys_);
-    if(cached_column_ != nullptr) delete(cached_column_);
+    clear_columns_();
   }
 
   /** Returns the dataframe's schema. Modifying the schema after a dataframe
@@ -71,6 +99,7 @@ public:
   void add_column(Key* k, char type) {
     schema_->add_column(type);
     keys_->append(k);
+    reset_columns_();
   }
 
   /**
@@ -80,28 +109,41 @@ public:
    * @return Value* - the value representing the column
    */
   Value* get_column_value(size_t idx) {
-    Key* k;
-
-    // if we're looking at the cached column let's grab from there
-    if(cached_column_ != nullptr && cached_column_->idx == idx) k = cached_column_->key;
-    else k = dynamic_cast<Key*>(keys_->get(idx));
-    
+    Key* k = dynamic_cast<Key*>(keys_->get(idx));
     assert(store_ != nullptr);
-    Value* v = store_->get(k);
+    // columns never change once stored, so remote ones can come out of the node's cache
+    return store_->get_cached(k);
+  }
 
-    // should we store the column in our cache?
-    if(k->idx_ != store_->idx_) {
-      if(cached_column_ != nullptr && !cached_column_->key->equals(k)) {
-        store_->remove(cached_column_->key);
-        delete(cached_column_);
+  /**
+   * @brief Get the decoded column at the given index, fetching and decoding it on first use.
+   * The column stays with this dataframe, so callers don't delete it.
+   * 
+   * @tparam C - the column's class
+   * @param idx - the index of the column
+   * @return C* - the column
+   */
+  template<class C>
+  C* get_column(size_t idx) {
+    assert(idx < column_slots_);
+    Object* col = columns_[idx].load(std::memory_order_acquire);
+    if(col == nullptr) {
+      // fetched and decoded without the lock, so a slow first read doesn't hold up the other columns
+      Value* v = get_column_value(idx);
+      Object* decoded = C::deserialize(v->serialized(), store_);
+      delete(v);
+      columns_lock_.lock();
+      col = columns_[idx].load(std::memory_order_relaxed);
+      if(col == nullptr) {
+        col = decoded;
+        columns_[idx].store(col, std::memory_order_release);
       }
-
-      Key* local_k = new Key(k->name_, store_->idx_);
-      store_->put(local_k, v);
-      cached_column_ = new ColumnMeta(idx, local_k);
+      else delete(decoded); // another thread got there first
+      columns_lock_.unlock();
     }
-    
-    return v;
+    C* c = dynamic_cast<C *>(col);
+    assert(c != nullptr);
+    return c;
   }
 
   /**
@@ -114,25 +156,7 @@ public:
    */
   template<class T>
   T get_primitive(size_t col, size_t row) {
-    Value* v = get_column_value(col);
-    DistributedColumn<T>* dc = DistributedColumn<T>::deserialize(v->serialized(), store_);
-    // supply cached column
-    if(cached_column_->cached_chunk != nullptr) dc->cached_chunk_ = new ChunkMeta(dynamic_cast<Key *>(cached_column_->cached_chunk->key->clone()), cached_column_->cached_chunk->chunk);
-
-    T val = dc->get(row);
-
-    // update cached column
-    if(cached_column_ != nullptr && dc->cached_chunk_ != nullptr) {
-      if(cached_column_->cached_chunk != nullptr && dc->cached_chunk_->chunk != cached_column_->cached_chunk->chunk) {
-        delete(cached_column_->cached_chunk);
-        cached_column_->cached_chunk = nullptr;
-      }
-      if(cached_column_->cached_chunk == nullptr) cached_column_->cached_chunk = new ChunkMeta(dynamic_cast<Key *>(dc->cached_chunk_->key->clone()), dc->cached_chunk_->chunk);
-    }
-
-    delete(v);
-    delete(dc);
-    return val;
+    return get_column<DistributedColumn<T>>(col)->get(row);
   }
 
   /** get methods for our four primary types, primitives use get_primitive **/
@@ -140,18 +164,334 @@ public:
   double get_double(size_t col, size_t row) { assert(schema_->col_type(col) == 'F'); return get_primitive<double>(col, row); }
   bool get_bool(size_t col, size_t row) { assert(schema_->col_type(col) == 'B'); return get_primitive<bool>(col, row); }
   
+  /** a copy of the string at the given position, owned by the caller */
   String* get_string(size_t col, size_t row) { 
     assert(schema_->col_type(col) == 'S'); 
-    Value* v = get_column_value(col);
-    DistributedStringColumn* dsc = DistributedStringColumn::deserialize(v->serialized(), store_);
-    String* val = new String(*dsc->get(row));
-    delete(v);
-    delete(dsc);
-    return val;
+    return new String(*get_column<DistributedStringColumn>(col)->get(row));
   }
 
   /**
-   * @brief Builds a dataframe from a visitor
+   * @brief Starts a scan over the given column's values a chunk at a time, in row order
+   * 
+   * @tparam T - the type of value
+   * @param col - the column index
+   * @return ChunkScan<T>* - the scan, owned by the caller and only valid while this dataframe is
+   */
+  template<class T>
+  ChunkScan<T>* scan(size_t col) {
+    return new ChunkScan<T>(get_column<DistributedColumn<T>>(col));
+  }
+
+  /**
+   * @brief The count, sum, min, max, mean and variance of the given column, aggregated
+   * on the nodes that hold it
+   * 
+   * @tparam T - the type of value: int, double or bool
+   * @param col - the column index
+   * @return Aggregate - the result
+   */
+  template<class T>
+  Aggregate aggregate(size_t col) {
+    assert(schema_->col_type(col) == elem_type<T>());
+    return get_column<DistributedColumn<T>>(col)->aggregate();
+  }
+
+  // drops every decoded column, they're decoded again the next time they're read
+  void clear_columns_() {
+    if(columns_ == nullptr) return;
+    for (size_t i = 0; i < column_slots_; i++)
+    {
+      Object* col = columns_[i].load();
+      if(col != nullptr) delete(col);
+    }
+    delete[](columns_);
+    columns_ = nullptr;
+  }
+
+  // makes room for every column in the schema, with none decoded yet
+  void reset_columns_() {
+    clear_columns_();
+    column_slots_ = schema_->ncol;
+    columns_ = new std::atomic<Object*>[column_slots_];
+    for (size_t i = 0; i < column_slots_; i++) columns_[i] = nullptr;
+  }
+
+  /**
+   * @brief Get the number of rows, as told by the first column
+   */
+  size_t nrows() {
+    if(schema_->width() == 0) return 0;
+    Array* keys;
+    size_t chunk_size;
+    return layout_(0, &keys, &chunk_size);
+  }
+
+  /**
+   * @brief Visits every row in order with the given rower, wherever the rows are stored
+   * 
+   * @param r - the rower
+   */
+  void map(Rower& r) {
+    map_chunks_(r, false);
+  }
+
+  /**
+   * @brief Visits the rows stored on this node with a clone of the given rower, then joins the clone back into it.
+   * A row is stored here if the first column's chunk holding it is, with the first column's unfinished last chunk
+   * counting as node 0's. Every node can run this over its own rows at once and combine the results through the store,
+   * so the data never moves.
+   * 
+   * @param r - the rower
+   */
+  void local_map(Rower& r) {
+    assert(store_ != nullptr);
+    Rower* clone = dynamic_cast<Rower *>(r.clone());
+    map_chunks_(*clone, true);
+    r.join_delete(clone);
+  }
+
+  /**
+   * @brief Counts the strings of the given column among its chunks stored on this node, visiting the given
+   * rower with a row per distinct string in each chunk: the string, then how many of the chunk's rows hold it.
+   * Rows are counted by their dictionary codes, so no strings are compared. A string that is in several chunks
+   * is visited once for each of them. The column's unfinished last chunk counts as node 0's.
+   * 
+   * @param col - the string column
+   * @param r - the rower, handed rows of schema "SI". It is not cloned
+   */
+  void local_group_count(size_t col, Rower& r) {
+    assert(store_ != nullptr && schema_->col_type(col) == 'S');
+    Array* keys;
+    size_t chunk_size;
+    layout_(col, &keys, &chunk_size);
+    Schema counted("SI");
+    Row row(counted);
+    for (size_t i = 0; i <= keys->count(); i++)
+    {
+      bool here = i < keys->count() ? dynamic_cast<Key *>(keys->get(i))->idx_ == store_->idx_ : store_->idx_ == 0;
+      if(!here) continue;
+      DecodedChunk* dc = decode_chunk_(col, i);
+      StringArrayChunk* chunk = dc->strings_;
+      size_t* counts = new size_t[chunk->entries()];
+      size_t* first = new size_t[chunk->entries()]; // a row holding each entry, for its view
+      memset(counts, 0, sizeof(size_t) * chunk->entries());
+      for (size_t j = 0; j < chunk->count(); j++)
+      {
+        uint32_t c = chunk->code(j);
+        if(counts[c]++ == 0) first[c] = j;
+      }
+      for (size_t c = 0; c < chunk->entries(); c++)
+      {
+        if(counts[c] == 0) continue;
+        row.set(0, chunk->get(first[c]));
+        row.set(1, (int)counts[c]);
+        r.accept(row);
+      }
+      delete[](counts);
+      delete[](first);
+      delete(dc);
+    }
+  }
+
+  // visits rows a chunk of the first column at a time, only the ones stored on this node if local.
+  // Columns whose chunks hold the same rows as the first column's are decoded a chunk at a time
+  // alongside it, any others are read a value at a time.
+  void map_chunks_(Rower& r, bool local) {
+    size_t width = schema_->width();
+    if(width == 0) return;
+    Array* keys;
+    size_t chunk_size;
+    size_t n = layout_(0, &keys, &chunk_size);
+    bool* aligned = new bool[width];
+    for (size_t c = 0; c < width; c++) aligned[c] = aligned_(c, keys, chunk_size);
+
+    Row row(*schema_);
+    DecodedChunk** chunks = new DecodedChunk*[width];
+    for (size_t i = 0; i <= keys->count(); i++)
+    {
+      if(local) {
+        bool here = i < keys->count() ? dynamic_cast<Key *>(keys->get(i))->idx_ == store_->idx_ : store_->idx_ == 0;
+        if(!here) continue;
+      }
+      for (size_t c = 0; c < width; c++) chunks[c] = aligned[c] ? decode_chunk_(c, i) : nullptr;
+
+      size_t start = i * chunk_size;
+      size_t end = start + chunk_size < n ? start + chunk_size : n;
+      for (size_t j = start; j < end; j++)
+      {
+        row.set_idx(j);
+        for (size_t c = 0; c < width; c++)
+        {
+          if(chunks[c] != nullptr) chunks[c]->fill(row, c, j - start);
+          else fill_field_(row, c, j);
+        }
+        r.accept(row);
+        // strings from fill_field_ are new
+        for (size_t c = 0; c < width; c++)
+        {
+          if(chunks[c] == nullptr && schema_->col_type(c) == 'S') delete(row.get_string(c));
+        }
+      }
+
+      for (size_t c = 0; c < width; c++)
+      {
+        if(chunks[c] != nullptr) delete(chunks[c]);
+      }
+    }
+    delete[](chunks);
+    delete[](aligned);
+  }
+
+  // sets the given field of the row to the value at the given row of the column, strings are new
+  void fill_field_(Row& row, size_t col, size_t idx) {
+    switch(schema_->col_type(col)) {
+      case 'I': row.set(col, get_int(col, idx)); break;
+      case 'F': row.set(col, get_double(col, idx)); break;
+      case 'B': row.set(col, get_bool(col, idx)); break;
+      case 'S': row.set(col, get_string(col, idx)); break;
+      default: assert(false);
+    }
+  }
+
+  // the given column's keys, chunk size and number of rows
+  size_t layout_(size_t col, Array** keys, size_t* chunk_size) {
+    Column<int>* ci;
+    Column<double>* cf;
+    Column<bool>* cb;
+    Column<String *>* cs;
+    switch(schema_->col_type(col)) {
+      case 'I': ci = get_column<DistributedColumn<int>>(col); *keys = ci->keys_; *chunk_size = ci->chunk_size_; return ci->size();
+      case 'F': cf = get_column<DistributedColumn<double>>(col); *keys = cf->keys_; *chunk_size = cf->chunk_size_; return cf->size();
+      case 'B': cb = get_column<DistributedColumn<bool>>(col); *keys = cb->keys_; *chunk_size = cb->chunk_size_; return cb->size();
+      case 'S': cs = get_column<DistributedStringColumn>(col); *keys = cs->keys_; *chunk_size = cs->chunk_size_; return cs->size();
+      default: assert(false); return 0;
+    }
+  }
+
+  // true if the given column's chunks hold the same rows, on the same nodes, as the first column's
+  bool aligned_(size_t col, Array* first_keys, size_t first_chunk_size) {
+    Array* keys;
+    size_t chunk_size;
+    layout_(col, &keys, &chunk_size);
+    if(chunk_size != first_chunk_size || keys->count() != first_keys->count()) return false;
+    for (size_t i = 0; i < keys->count(); i++)
+    {
+      if(dynamic_cast<Key *>(keys->get(i))->idx_ != dynamic_cast<Key *>(first_keys->get(i))->idx_) return false;
+    }
+    return true;
+  }
+
+  // decodes the given chunk of the column, the chunk after its last key is the column's unfinished last chunk
+  DecodedChunk* decode_chunk_(size_t col, size_t chunk) {
+    Array* keys;
+    size_t chunk_size;
+    layout_(col, &keys, &chunk_size);
+    bool last = chunk == keys->count();
+    DecodedChunk* dc = new DecodedChunk(schema_->col_type(col), !last);
+    Value* v = last ? nullptr : store_->get_cached(dynamic_cast<Key *>(keys->get(chunk)));
+    switch(dc->type_) {
+      case 'I':
+        dc->ints_ = last ? get_column<DistributedColumn<int>>(col)->last_chunk_ : PrimitiveArrayChunk<int>::deserialize(v->serialized());
+        break;
+      case 'F':
+        dc->doubles_ = last ? get_column<DistributedColumn<double>>(col)->last_chunk_ : PrimitiveArrayChunk<double>::deserialize(v->serialized());
+        break;
+      case 'B':
+        dc->bools_ = last ? get_column<DistributedColumn<bool>>(col)->last_chunk_ : PrimitiveArrayChunk<bool>::deserialize(v->serialized());
+        break;
+      case 'S':
+        dc->strings_ = last ? get_column<DistributedStringColumn>(col)->last_chunk_ : StringArrayChunk::deserialize(v->serialized());
+        break;
+    }
+    if(v != nullptr) delete(v);
+    return dc;
+  }
+
+  /**
+   * @brief Builds a dataframe from the rows a writer produces, shipping each column's chunks as they fill
+   * so only the chunk being filled in each column is ever held here, however many rows there are.
+   * 
+   * @param k - the key this df is to be stored under
+   * @param store - the store/network this df is to be stored in
+   * @param sch_str - the schema string for this df
+   * @param w - the writer that fills in each row
+   * @return DistributedDataFrame* - the new df
+   */
+  static DistributedDataFrame* fromWriter(Key* k, KVStore* store, const char* sch_str, Writer& w) {
+    // set up df
+    Schema sch("", k);
+    DistributedDataFrame* ddf = new DistributedDataFrame(sch);
+    ddf->store_ = store;
+    String* name = ddf->get_schema().get_name();
+
+    // one column per type character, only the array for its type is set
+    Schema row_sch(sch_str);
+    size_t width = row_sch.width();
+    DistributedColumn<int>** ints = new DistributedColumn<int>*[width];
+    DistributedColumn<double>** doubles = new DistributedColumn<double>*[width];
+    DistributedColumn<bool>** bools = new DistributedColumn<bool>*[width];
+    DistributedStringColumn** strings = new DistributedStringColumn*[width];
+    for (size_t c = 0; c < width; c++)
+    {
+      char type = row_sch.col_type(c);
+      ints[c] = type == 'I' ? new DistributedColumn<int>(c) : nullptr;
+      doubles[c] = type == 'F' ? new DistributedColumn<double>(c) : nullptr;
+      bools[c] = type == 'B' ? new DistributedColumn<bool>(c) : nullptr;
+      strings[c] = type == 'S' ? new DistributedStringColumn(c) : nullptr;
+      assert(ints[c] != nullptr || doubles[c] != nullptr || bools[c] != nullptr || strings[c] != nullptr);
+      if(ints[c] != nullptr) ints[c]->set_store(store);
+      if(doubles[c] != nullptr) doubles[c]->set_store(store);
+      if(bools[c] != nullptr) bools[c]->set_store(store);
+      if(strings[c] != nullptr) strings[c]->set_store(store);
+    }
+
+    // pull rows until the writer runs out, a column puts each chunk as soon as it's full
+    Row row(row_sch);
+    for (size_t i = 0; !w.done(); i++)
+    {
+      row.set_idx(i);
+      w.visit(row);
+      for (size_t c = 0; c < width; c++)
+      {
+        if(ints[c] != nullptr) ints[c]->push_back(row.get_int(c), name);
+        else if(doubles[c] != nullptr) doubles[c]->push_back(row.get_double(c), name);
+        else if(bools[c] != nullptr) bools[c]->push_back(row.get_bool(c), name);
+        else strings[c]->push_back(row.get_string(c), name);
+      }
+    }
+
+    // store the columns and provide them to the df
+    for (size_t c = 0; c < width; c++)
+    {
+      char* col_name = ddf->get_schema().build_col_key(c);
+      Key column_key(col_name, k->idx_);
+      delete[](col_name);
+      Serializable* col;
+      if(ints[c] != nullptr) col = ints[c];
+      else if(doubles[c] != nullptr) col = doubles[c];
+      else if(bools[c] != nullptr) col = bools[c];
+      else col = strings[c];
+      Value column_value(col);
+      store->put(&column_key, &column_value);
+      ddf->add_column(&column_key, row_sch.col_type(c));
+      if(ints[c] != nullptr) delete(ints[c]);
+      if(doubles[c] != nullptr) delete(doubles[c]);
+      if(bools[c] != nullptr) delete(bools[c]);
+      if(strings[c] != nullptr) delete(strings[c]);
+    }
+    delete[](ints);
+    delete[](doubles);
+    delete[](bools);
+    delete[](strings);
+
+    // store df
+    Value df_value(ddf);
+    store->put(k, &df_value);
+    return ddf;
+  }
+
+  /**
+   * @brief Builds a dataframe from a visitor, see fromWriter
    * 
    * @param key - the key this df is to be stored under
    * @param store - the store/network this df is to be stored in
@@ -159,11 +499,8 @@ public:
    * @param v - the visitor used to build this df
    * @return DistributedDataFrame* - the new df
    */
-  static DistributedDataFrame* fromVisitor(Key* key, KVStore* store, char* sch_str, Visitor* v) {
-    Sys s;
-    s.OK("fromVisitor not implemented.");
-    assert(false);
-    return nullptr;
+  static DistributedDataFrame* fromVisitor(Key* key, KVStore* store, const char* sch_str, Writer& v) {
+    return fromWriter(key, store, sch_str, v);
   }
 
   /**
@@ -181,13 +518,16 @@ public:
     DistributedDataFrame* ddf = new DistributedDataFrame(sch);
     ddf->store_ = store;
 
-    // build column
+    // build column, shipping chunks bound for the same node together
+    PutBatch batch(store, args->num_nodes);
     DistributedColumn<double> dc(0);
     dc.set_store(store);
+    dc.set_batch(&batch);
     for (size_t i = 0; i < sz; i++)
     {
       dc.push_back(arr[i], ddf->get_schema().get_name());
     }
+    batch.flush();
 
     // store column
     Key column_key(ddf->get_schema().build_col_key(0), k->idx_);
@@ -222,61 +562,35 @@ public:
   }
 
   SerialString* serialize() {
-    SerialString* sch_ss = schema_->serialize();
-
-    // build serial strings for each key
-    SerialString** keys_strings = new SerialString*[keys_->count()];
-    size_t sz = sch_ss->size_;
-    for (size_t i = 0; i < keys_->count(); i++)
-    {
-      keys_strings[i] = dynamic_cast<Key *>(keys_->get(i))->serialize();
-      sz += keys_strings[i]->size_;
-    }
-
-    char* arr = new char[sz];
-    size_t pos = 0;
-
-    // copy schema
-    memcpy(arr + pos, sch_ss->data_, sch_ss->size_);
-    pos += sch_ss->size_;
-    delete(sch_ss);
+    Serializer s;
+    serialize_into(s);
+    return s.to_serial();
+  }
 
-    // copy each key
+  void serialize_into(Serializer& s) {
+    schema_->serialize_into(s);
     for (size_t i = 0; i < keys_->count(); i++)
     {
-      memcpy(arr + pos, keys_strings[i]->data_, keys_strings[i]->size_);
-      pos += keys_strings[i]->size_;
-      delete(keys_strings[i]);
+      dynamic_cast<Key *>(keys_->get(i))->serialize_into(s);
     }
-    delete[](keys_strings);
-    
-    SerialString* ss = new SerialString(arr, sz);
-    delete[](arr);
-    
-    return ss;
   }
 
   static DistributedDataFrame* deserialize(SerialString* ss) {
-    // grab schema and set up position
-    Schema* sch = Schema::deserialize(ss);
-    SerialString* temp = sch->serialize();
-    size_t pos = temp->size_;
-    delete(temp);
+    Deserializer d(ss);
+    return deserialize(d);
+  }
 
-    // create df
+  static DistributedDataFrame* deserialize(Deserializer& d) {
+    Schema* sch = Schema::deserialize(d);
     DistributedDataFrame* ddf = new DistributedDataFrame(*sch);
     delete(sch);
 
+    // one key per column
     for (size_t i = 0; i < ddf->get_schema().ncol; i++)
     {
-      SerialString* substr = new SerialString(ss->data_ + pos, ss->size_ - pos);
-      Key* k = Key::deserialize(substr);
+      Key* k = Key::deserialize(d);
       ddf->keys_->append(k);
-
-      temp = k->serialize();
-      pos += temp->size_;
-      delete(temp);
-      delete(substr);
+      delete(k);
     }
     
     return ddf;
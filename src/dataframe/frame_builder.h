@@ -333,7 +333,7 @@ public:
 		}
 		String* cleaned = clean_field(field.get(), r.col_type(col));
 		add_field_to_row(cleaned, r, col);
-		delete(cleaned);
+		if(r.col_type(col) != 'S') delete(cleaned); // the row holds string fields until it's added
 		return col;
 	}
 
@@ -345,10 +345,13 @@ public:
 		int col = 0;
 		while(read_field(*r, col) != -1) { col++; }
 		while(col < _df->ncols()) {
-			add_field_to_row(clean_field(new String(""), r->col_type(col)), *r, col); // set the rest to default values
+			String* cleaned = clean_field(new String(""), r->col_type(col));
+			add_field_to_row(cleaned, *r, col); // set the rest to default values
+			if(r->col_type(col) != 'S') delete(cleaned);
 			col++;
 		}
 		_df->add_row(*r);
+		for (size_t i = 0; i < _df->ncols(); i++) if(r->col_type(i) == 'S') delete(r->get_string(i));
 		delete(r);
 		return READ_ROW_SUCCESS;
 	}
@@ -3,6 +3,7 @@
 #include "../utils/object.h"
 #include "../utils/string.h"
 #include "../utils/array.h"
+#include "../store/key.h"
 
 /*************************************************************************
  * Schema::
@@ -129,50 +130,30 @@ public:
     Object* clone() { return new Schema(*this); }
 
     SerialString* serialize() {
-        SerialString* name_ss = name->serialize();
-
-        char* serial = new char[name_ss->size_ + sizeof(size_t) + sizeof(size_t) + ncol];
-        size_t pos = 0;
-
-        // name
-        memcpy(&serial[pos], name_ss->data_, name_ss->size_);
-        pos += name_ss->size_;
-        delete(name_ss);
-
-        // ncol
-        memcpy(&serial[pos], &ncol, sizeof(size_t));
-        pos += sizeof(size_t);
-
-        // nrow
-        memcpy(&serial[pos], &nrow, sizeof(size_t));
-        pos += sizeof(size_t);
-
-        // col_types
-        memcpy(&serial[pos], col_types, ncol);
-        pos += ncol;
-        
-        SerialString* s = new SerialString(serial, pos);
-        delete[](serial);
-        return s;
+        Serializer s;
+        serialize_into(s);
+        return s.to_serial();
     }
 
-    static Schema* deserialize(SerialString* serialized) {
-        String* name;
-        size_t col;
-        size_t row;
-        size_t pos = 0;
+    void serialize_into(Serializer& s) {
+        name->serialize_into(s);
+        s.write_size(ncol);
+        s.write_size(nrow);
+        s.write(col_types, ncol);
+    }
 
-        name = String::deserialize(serialized);
-        pos += sizeof(size_t) + name->size();
-        
-        memcpy(&col, &serialized->data_[pos], sizeof(size_t));
-        pos += sizeof(size_t);
+    static Schema* deserialize(SerialString* serialized) {
+        Deserializer d(serialized);
+        return deserialize(d);
+    }
 
-        memcpy(&row, &serialized->data_[pos], sizeof(size_t));
-        pos += sizeof(size_t);
+    static Schema* deserialize(Deserializer& d) {
+        String* name = String::deserialize(d);
+        size_t col = d.read_size();
+        size_t row = d.read_size();
 
         char* types = new char[col + 1];
-        memcpy(types, &serialized->data_[pos], col);
+        memcpy(types, d.read_bytes(col).data_, col);
         types[col] = '\0';
 
         Schema* s = new Schema(types);
@@ -0,0 +1,422 @@
+#pragma once
+
+#include <assert.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "../utils/mapped_file.h"
+#include "../utils/string.h"
+
+#include "dataframe.h"
+#include "sor_scanner.h"
+#include "visitor.h"
+
+#define SOR_SCHEMA_LINES 500 // how many lines the schema is inferred from
+#define SOR_PARALLEL_BYTES (1 << 20) // files smaller than this aren't worth splitting between threads
+
+/*************************************************************************
+ * Helpers for reading SoR text in place. A field is handed around as the
+ * pointers to its first byte and one past its last, into a buffer that is
+ * not null terminated, so nothing is copied until a string cell needs it.
+ */
+
+inline bool sor_digit(char c) { return c >= '0' && c <= '9'; }
+
+/** Drops the spaces padding either side of a field. */
+inline void sor_trim(const char** start, const char** stop) {
+    while(*start < *stop && sor_space(**start)) (*start)++;
+    while(*stop > *start && sor_space(*(*stop - 1))) (*stop)--;
+}
+
+/** Narrows a trimmed string field to what is inside its quotes, if it has any. */
+inline void sor_unquote(const char** start, const char** stop) {
+    if(*start == *stop || **start != '"') return;
+    (*start)++;
+    const char* q = *start;
+    while(q < *stop && *q != '"') q++;
+    *stop = q;
+}
+
+/** Parses a trimmed field as an int: an optional sign then digits, all of it. False if it isn't one or doesn't fit. */
+inline bool sor_parse_int(const char* s, const char* e, int* out) {
+    bool neg = false;
+    if(s < e && (*s == '+' || *s == '-')) neg = *s++ == '-';
+    if(s == e) return false;
+    int64_t v = 0;
+    for (; s < e; s++)
+    {
+        if(!sor_digit(*s)) return false;
+        v = v * 10 + (*s - '0');
+        if(v > (int64_t)INT32_MAX + 1) return false;
+    }
+    if(neg) v = -v;
+    if(v > INT32_MAX) return false;
+    *out = (int)v;
+    return true;
+}
+
+/**
+ * @brief Parses a trimmed field as a double: an optional sign, digits with at most one '.', and an optional
+ * exponent. Up to 15 digits and a power of ten up to 22 convert exactly with one multiply or divide, longer
+ * ones are left to strtod to round. False if the field isn't a number.
+ */
+inline bool sor_parse_double(const char* s, const char* e, double* out) {
+    static const double pow10[] = { 1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+        1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22 };
+    const char* p = s;
+    bool neg = false;
+    if(p < e && (*p == '+' || *p == '-')) neg = *p++ == '-';
+    uint64_t mantissa = 0;
+    int digits = 0;
+    int scale = 0;
+    for (; p < e && sor_digit(*p); p++, digits++) mantissa = mantissa * 10 + (*p - '0');
+    if(p < e && *p == '.') {
+        for (p++; p < e && sor_digit(*p); p++, digits++, scale--) mantissa = mantissa * 10 + (*p - '0');
+    }
+    if(digits == 0) return false;
+    if(p < e && (*p == 'e' || *p == 'E')) {
+        p++;
+        bool neg_exp = false;
+        if(p < e && (*p == '+' || *p == '-')) neg_exp = *p++ == '-';
+        if(p == e) return false;
+        int exp = 0;
+        for (; p < e && sor_digit(*p); p++) if(exp < 100000) exp = exp * 10 + (*p - '0');
+        scale += neg_exp ? -exp : exp;
+    }
+    if(p != e) return false;
+    if(digits <= 15 && scale >= -22 && scale <= 22) {
+        double v = scale < 0 ? mantissa / pow10[-scale] : mantissa * pow10[scale];
+        *out = neg ? -v : v;
+        return true;
+    }
+    // the field is a number followed by '>' or a space, so strtod stops at its end
+    char* stop;
+    *out = strtod(s, &stop);
+    return stop == e;
+}
+
+/**
+ * @brief The narrowest type that holds a trimmed field: 'B' for 0 and 1, then 'I', 'F', and 'S' for anything
+ * else including quoted fields. An empty field is missing and says nothing about its column, 0 is returned.
+ */
+inline char sor_classify(const char* s, const char* e) {
+    if(s == e) return 0;
+    if(*s == '"') return 'S';
+    if(e - s == 1 && (*s == '0' || *s == '1')) return 'B';
+    int i;
+    if(sor_parse_int(s, e, &i)) return 'I';
+    double d;
+    if(sor_parse_double(s, e, &d)) return 'F';
+    return 'S';
+}
+
+/** The wider of two column types, in the order B, I, F, S. 0 stands for not known yet. */
+inline char sor_wider(char a, char b) {
+    static const char order[] = "BIFS";
+    if(a == 0) return b;
+    if(b == 0) return a;
+    return strchr(order, a) > strchr(order, b) ? a : b;
+}
+
+/** Counts the rows in a range of SoR text as one task of SorReader::build(pool). */
+class SorCountTask : public Task {
+public:
+    const char* begin_; // external
+    const char* end_; // external
+    size_t* rows_; // external - where the count goes
+
+    SorCountTask(const char* begin, const char* end, size_t* rows) {
+        begin_ = begin;
+        end_ = end;
+        rows_ = rows;
+    }
+
+    void run() override {
+        SorScanner scanner(end_);
+        *rows_ = scanner.count_rows(begin_);
+    }
+};
+
+class SorReader;
+
+/**
+ * @brief Parses a run of rows into a dataframe of its own as one task of SorReader::build(pool). The run's
+ * first row is found from the counted ranges: in the range holding it, by skipping the rows before it.
+ */
+class SorParseTask : public Task {
+public:
+    SorReader* reader_; // external
+    const char** starts_; // external - where each range begins, and where the last ends
+    size_t* rows_before_; // external - how many rows come before each range
+    size_t ranges_;
+    size_t first_;
+    size_t rows_;
+    DataFrame** out_; // external - where the dataframe goes
+
+    SorParseTask(SorReader* reader, const char** starts, size_t* rows_before, size_t ranges, size_t first, size_t rows, DataFrame** out) {
+        reader_ = reader;
+        starts_ = starts;
+        rows_before_ = rows_before;
+        ranges_ = ranges;
+        first_ = first;
+        rows_ = rows;
+        out_ = out;
+    }
+
+    void run() override;
+};
+
+/*************************************************************************
+ * SorReader::
+ *
+ * Reads a SoR file, a row per line of <field>s, straight out of a memory
+ * mapping of it. A SorScanner finds the fields, which are parsed in place,
+ * the only allocations being the strings of string cells. As a Writer it
+ * fills in one row per visit, so it can feed DistributedDataFrame::fromWriter,
+ * or build() reads every row into a local DataFrame.
+ *
+ * build(pool) reads the rows on a thread pool instead, each task parsing
+ * its own run of rows into its own dataframe, see SorParseTask.
+ *
+ * Fields are trimmed of padding spaces and string fields of their quotes.
+ * Missing fields, and ones that don't parse as their column's type, get
+ * the type's default: 0, 0.0, false or "". Fields past the schema's width
+ * are ignored.
+ */
+class SorReader : public Writer {
+public:
+    MappedFile* file_; // owned, nullptr when reading text mapped by someone else
+    const char* pos_; // external, into file_ - the start of the next row
+    const char* end_; // external
+    Schema* schema_; // owned
+    size_t width_;
+    SorScanner* scanner_; // owned
+    const char** starts_; // owned, elements external - where the fields of the last row read start
+    const char** stops_; // owned, elements external - and where they stop
+    String** cells_; // owned, elements owned - the strings set in the last row read, nullptr where none was
+    size_t rows_; // how many rows have been read
+
+    /** Maps the file and infers its schema from its first SOR_SCHEMA_LINES lines. */
+    SorReader(const char* path) {
+        file_ = new MappedFile(path);
+        schema_ = infer_schema(file_->begin(), file_->end(), SOR_SCHEMA_LINES);
+        init_(file_->begin(), file_->end());
+    }
+
+    /** Maps the file, which follows the given schema. */
+    SorReader(const char* path, Schema& s) {
+        file_ = new MappedFile(path);
+        schema_ = new Schema(s.col_types);
+        init_(file_->begin(), file_->end());
+    }
+
+    /** Reads the text in [begin, end), which follows the given schema and outlives the reader. */
+    SorReader(const char* begin, const char* end, Schema& s) {
+        file_ = nullptr;
+        schema_ = new Schema(s.col_types);
+        init_(begin, end);
+    }
+
+    ~SorReader() {
+        for (size_t i = 0; i < width_; i++) delete(cells_[i]);
+        delete[](cells_);
+        delete(scanner_);
+        delete[](starts_);
+        delete[](stops_);
+        delete(schema_);
+        delete(file_);
+    }
+
+    /**
+     * @brief Infers a schema from the first lines of SoR text: as many columns as the widest of the lines
+     * has fields, each the widest type any line has in it, see sor_classify. A column that is always
+     * missing is a bool column. Asserts that there is at least one field.
+     *
+     * @return Schema* - the new schema, the caller owns it
+     */
+    static Schema* infer_schema(const char* begin, const char* end, size_t lines) {
+        size_t width = 0;
+        char* found = new char[1];
+        found[0] = '\0';
+        const char* pos = begin;
+        for (size_t line = 0; line < lines && pos < end; line++)
+        {
+            const char* s;
+            const char* e;
+            size_t col = 0;
+            for (; sor_next_field(&pos, end, &s, &e); col++)
+            {
+                if(col == width) { // a wider line, the new columns start out not known
+                    char* wider = new char[width + 2];
+                    memcpy(wider, found, width);
+                    wider[width] = 0;
+                    wider[++width] = '\0';
+                    delete[](found);
+                    found = wider;
+                }
+                sor_trim(&s, &e);
+                found[col] = sor_wider(found[col], sor_classify(s, e));
+            }
+        }
+        assert(width > 0);
+        for (size_t i = 0; i < width; i++) if(found[i] == 0) found[i] = 'B';
+        Schema* sch = new Schema(found);
+        delete[](found);
+        return sch;
+    }
+
+    Schema& get_schema() { return *schema_; }
+
+    size_t rows() { return rows_; }
+
+    /** Fills in the given row, which follows this reader's schema, from the next line. */
+    void visit(Row& r) override {
+        skip_blank_();
+        size_t fields = scanner_->next_row(&pos_, starts_, stops_, width_);
+        size_t col = 0;
+        for (; col < fields && col < width_; col++) set_cell_(r, col, starts_[col], stops_[col]);
+        const char* none = "";
+        for (; col < width_; col++) set_cell_(r, col, none, none);
+        rows_++;
+    }
+
+    /** True once only blank lines are left. */
+    bool done() override {
+        skip_blank_();
+        return pos_ == end_;
+    }
+
+    /** Reads the rest of the rows into a new dataframe, which the caller owns. */
+    DataFrame* build() {
+        DataFrame* df = new DataFrame(*schema_);
+        Row row(*schema_);
+        while(!done()) {
+            visit(row);
+            df->add_row(row);
+        }
+        return df;
+    }
+
+    /**
+     * @brief Reads the rest of the rows into a new dataframe like build(), on the given pool. The text left
+     * is split at newlines into a range per worker and their rows counted in parallel. Then the rows are
+     * dealt out to tasks in runs that start on a chunk boundary, so once each task has parsed its run into
+     * a dataframe of its own, their chunks are put together in order without copying any values.
+     *
+     * @return DataFrame* - the new dataframe, the caller owns it
+     */
+    DataFrame* build(ThreadPool& pool) {
+        size_t ranges = pool.size();
+        if(ranges == 1 || (size_t)(end_ - pos_) < SOR_PARALLEL_BYTES) return build();
+
+        // split at the first newline after each even share of the bytes, and count rows
+        const char** starts = new const char*[ranges + 1];
+        size_t* rows_before = new size_t[ranges + 1];
+        starts[0] = pos_;
+        for (size_t i = 1; i < ranges; i++)
+        {
+            const char* p = pos_ + (end_ - pos_) * i / ranges;
+            if(p < starts[i - 1]) p = starts[i - 1];
+            const char* nl = static_cast<const char*>(memchr(p, '\n', end_ - p));
+            starts[i] = nl == nullptr ? end_ : nl + 1;
+        }
+        starts[ranges] = end_;
+        TaskGroup counted;
+        for (size_t i = 0; i < ranges; i++) pool.submit(new SorCountTask(starts[i], starts[i + 1], &rows_before[i + 1]), &counted);
+        pool.wait(counted);
+        rows_before[0] = 0;
+        for (size_t i = 1; i <= ranges; i++) rows_before[i] += rows_before[i - 1];
+
+        // deal out whole chunks of rows like pmap does
+        DataFrame* df = new DataFrame(*schema_);
+        size_t total = rows_before[ranges];
+        size_t step = df->chunk_rows();
+        size_t chunks = (total + step - 1) / step;
+        size_t tasks = pool.size() * PMAP_TASKS_PER_WORKER;
+        if(tasks > chunks) tasks = chunks;
+        DataFrame** parts = new DataFrame*[tasks];
+        TaskGroup parsed;
+        size_t first = 0;
+        for (size_t i = 0; i < tasks; i++)
+        {
+            size_t task_chunks = chunks / tasks + (i < chunks % tasks ? 1 : 0);
+            size_t rows = first + task_chunks * step < total ? task_chunks * step : total - first;
+            pool.submit(new SorParseTask(this, starts, rows_before, ranges, first, rows, &parts[i]), &parsed);
+            first += rows;
+        }
+        pool.wait(parsed);
+
+        for (size_t i = 0; i < tasks; i++)
+        {
+            df->take_chunks(parts[i]);
+            delete(parts[i]);
+        }
+        delete[](parts);
+        delete[](starts);
+        delete[](rows_before);
+        pos_ = end_;
+        rows_ += total;
+        return df;
+    }
+
+    void init_(const char* begin, const char* end) {
+        pos_ = begin;
+        end_ = end;
+        scanner_ = new SorScanner(end_);
+        width_ = schema_->width();
+        cells_ = new String*[width_];
+        starts_ = new const char*[width_];
+        stops_ = new const char*[width_];
+        for (size_t i = 0; i < width_; i++) cells_[i] = nullptr;
+        rows_ = 0;
+    }
+
+    void skip_blank_() {
+        while(pos_ < end_ && (sor_space(*pos_) || *pos_ == '\n')) pos_++;
+    }
+
+    /** Parses the field [s, e) as the column's type and sets it in the row. */
+    void set_cell_(Row& r, size_t col, const char* s, const char* e) {
+        sor_trim(&s, &e);
+        switch(schema_->col_type(col)) {
+            case 'I': {
+                int i;
+                r.set(col, sor_parse_int(s, e, &i) ? i : 0);
+                return;
+            }
+            case 'F': {
+                double d;
+                r.set(col, sor_parse_double(s, e, &d) ? d : 0.0);
+                return;
+            }
+            case 'B':
+                r.set(col, e - s == 1 && *s == '1');
+                return;
+            case 'S':
+                sor_unquote(&s, &e);
+                delete(cells_[col]);
+                cells_[col] = new String(s, e - s);
+                r.set(col, cells_[col]);
+                return;
+            default:
+                assert(false);
+        }
+    }
+};
+
+inline void SorParseTask::run() {
+    size_t range = 0;
+    while(rows_before_[range + 1] <= first_) range++;
+    SorScanner scanner(starts_[range + 1]);
+    const char* start = scanner.skip_rows(starts_[range], first_ - rows_before_[range]);
+    Schema& sch = reader_->get_schema();
+    SorReader part(start, reader_->end_, sch);
+    DataFrame* df = new DataFrame(sch);
+    Row row(sch);
+    for (size_t i = 0; i < rows_; i++)
+    {
+        part.visit(row);
+        df->add_row(row);
+    }
+    *out_ = df;
+}
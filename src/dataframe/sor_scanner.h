@@ -0,0 +1,425 @@
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+
+#include "../utils/object.h"
+#include "../utils/simd.h"
+
+#define SOR_BLOCK 64 // the bytes SorScanner classifies at once, one bit each in a word
+
+/*************************************************************************
+ * Helpers for finding the structure of SoR text a byte at a time: the
+ * fields of a line and the lines holding rows. They are what SorScanner
+ * falls back on without vector instructions, and what it has to agree with.
+ */
+
+/** A padding space inside a line. */
+inline bool sor_space(char c) { return c == ' ' || c == '\t' || c == '\r'; }
+
+/**
+ * @brief finds the next field on the current line, between a '<' and the '>' closing it, where a '>'
+ * inside quotes doesn't count. On success the field's bytes are [*start, *stop) and *pos is past the '>'.
+ *
+ * @return false when the line ends first, *pos is then past its '\n'. A field cut off by the end of
+ * the line or of the buffer is dropped, like the rest of the line.
+ */
+inline bool sor_next_field(const char** pos, const char* end, const char** start, const char** stop) {
+    const char* p = *pos;
+    while(p < end && *p != '<') {
+        if(*p == '\n') { *pos = p + 1; return false; }
+        p++;
+    }
+    if(p == end) { *pos = end; return false; }
+    const char* s = ++p;
+    int quotes = 0;
+    while(p < end && (*p != '>' || quotes == 1)) {
+        if(*p == '\n') { *pos = p + 1; return false; }
+        if(*p == '"') quotes++;
+        p++;
+    }
+    if(p == end) { *pos = end; return false; }
+    *start = s;
+    *stop = p;
+    *pos = p + 1;
+    return true;
+}
+
+/** How many rows the lines in [begin, end) hold: every line with something other than spaces is one. */
+inline size_t sor_count_rows(const char* begin, const char* end) {
+    size_t rows = 0;
+    bool content = false;
+    for (const char* p = begin; p < end; p++)
+    {
+        if(*p == '\n') {
+            rows += content;
+            content = false;
+        }
+        else if(!sor_space(*p)) content = true;
+    }
+    return rows + content;
+}
+
+/** Where the line after the first n rows from begin starts, counting rows like sor_count_rows. */
+inline const char* sor_skip_rows(const char* begin, const char* end, size_t n) {
+    const char* p = begin;
+    bool content = false;
+    for (; n > 0 && p < end; p++)
+    {
+        if(*p == '\n') {
+            if(content) n--;
+            content = false;
+        }
+        else if(!sor_space(*p)) content = true;
+    }
+    return p;
+}
+
+
+/** Where the bytes of a block that matter to the scanner are, bit i standing for byte i. Rows only need newlines and spaces, fields the rest. */
+struct SorBlock {
+    uint64_t open; // '<'
+    uint64_t close; // '>'
+    uint64_t quote; // '"'
+    uint64_t newline; // '\n'
+    uint64_t space; // ' ', '\t' or '\r'
+};
+
+#ifdef SIMD_X86
+
+__attribute__((target("sse4.1")))
+inline uint64_t sor_match_sse41_(const __m128i* x, char c) {
+    __m128i m = _mm_set1_epi8(c);
+    uint64_t bits = 0;
+    for (int i = 0; i < 4; i++) bits |= (uint64_t)(uint16_t)_mm_movemask_epi8(_mm_cmpeq_epi8(x[i], m)) << (16 * i);
+    return bits;
+}
+
+/** classifies 64 bytes, 16 at a time, finding either what fields or what rows need */
+__attribute__((target("sse4.1")))
+inline void sor_classify_sse41_(const char* b, SorBlock* out, bool fields) {
+    __m128i x[4];
+    for (int i = 0; i < 4; i++) x[i] = _mm_loadu_si128(reinterpret_cast<const __m128i*>(b + 16 * i));
+    out->newline = sor_match_sse41_(x, '\n');
+    if(fields) {
+        out->open = sor_match_sse41_(x, '<');
+        out->close = sor_match_sse41_(x, '>');
+        out->quote = sor_match_sse41_(x, '"');
+    }
+    else out->space = sor_match_sse41_(x, ' ') | sor_match_sse41_(x, '\t') | sor_match_sse41_(x, '\r');
+}
+
+__attribute__((target("avx2")))
+inline uint64_t sor_match_avx2_(__m256i lo, __m256i hi, char c) {
+    __m256i m = _mm256_set1_epi8(c);
+    uint32_t l = _mm256_movemask_epi8(_mm256_cmpeq_epi8(lo, m));
+    uint32_t h = _mm256_movemask_epi8(_mm256_cmpeq_epi8(hi, m));
+    return (uint64_t)h << 32 | l;
+}
+
+/** classifies 64 bytes, 32 at a time, finding either what fields or what rows need */
+__attribute__((target("avx2")))
+inline void sor_classify_avx2_(const char* b, SorBlock* out, bool fields) {
+    __m256i lo = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(b));
+    __m256i hi = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(b + 32));
+    out->newline = sor_match_avx2_(lo, hi, '\n');
+    if(fields) {
+        out->open = sor_match_avx2_(lo, hi, '<');
+        out->close = sor_match_avx2_(lo, hi, '>');
+        out->quote = sor_match_avx2_(lo, hi, '"');
+    }
+    else out->space = sor_match_avx2_(lo, hi, ' ') | sor_match_avx2_(lo, hi, '\t') | sor_match_avx2_(lo, hi, '\r');
+}
+
+#endif
+
+/** The parity of the set bits up to and including each bit: set from one set bit until the next. */
+inline uint64_t sor_prefix_xor(uint64_t x) {
+    x ^= x << 1;
+    x ^= x << 2;
+    x ^= x << 4;
+    x ^= x << 8;
+    x ^= x << 16;
+    x ^= x << 32;
+    return x;
+}
+
+/** Clears the lowest set bit. */
+inline uint64_t sor_drop_lowest(uint64_t x) { return x & (x - 1); }
+
+/** Stores base plus the index of each set bit, lowest first, in out. Returns how many there were. */
+inline size_t sor_flatten(uint64_t bits, const char* base, const char** out) {
+    size_t n = 0;
+    for (; bits != 0; bits = sor_drop_lowest(bits)) out[n++] = base + __builtin_ctzll(bits);
+    return n;
+}
+
+#ifdef SIMD_X86
+
+/** sor_flatten with bmi's blsr clearing the bit, which is most of what the loop waits on */
+__attribute__((target("bmi")))
+inline size_t sor_flatten_bmi_(uint64_t bits, const char* base, const char** out) {
+    size_t n = 0;
+    for (; bits != 0; bits = sor_drop_lowest(bits)) out[n++] = base + __builtin_ctzll(bits);
+    return n;
+}
+
+#endif
+
+/*************************************************************************
+ * SorScanner::
+ *
+ * Finds fields and rows in SoR text like sor_next_field, sor_count_rows
+ * and sor_skip_rows do, with the same results, but classifies the text
+ * SOR_BLOCK bytes at a time with vector compares into a bitmap per kind of
+ * byte that matters. The bytes in between those, most of them, are never
+ * looked at one by one. Without vector instructions, see simd_level, it
+ * uses the byte at a time helpers.
+ *
+ * For fields, each block's bitmaps are turned into marks: where the '<'
+ * and '>' of every field are, and the newlines, in order. The quotes'
+ * bitmap made into a mask of what is inside them hides the '<' and '>'
+ * there, and what's left has to take turns. That is what the byte at a
+ * time rules do as long as no field runs over a newline, no quote is
+ * outside a field and no field has more than two, which the bitmaps can
+ * tell too. A block where they can't be sure is marked following the
+ * rules instead, one '<', '>', '"' or newline at a time. next_row then
+ * walks the marks.
+ *
+ * Blocks start wherever they were needed, not on any particular boundary.
+ * The last one is copied out and padded with spaces, so nothing is read
+ * past the end of the text.
+ */
+class SorScanner : public Object {
+public:
+    const char* end_; // external
+    const char* base_; // external - the first byte of the current block
+    SorBlock block_;
+    int level_; // the instruction set in use, fixed when the scanner is made
+    bool bmi_; // whether the cpu has bmi too
+    const char* marks_[SOR_BLOCK + 1]; // elements external - the '<', '>' and newlines that matter, in order
+    size_t marked_; // how many marks there are
+    size_t mark_; // the next mark for next_row
+    const char* next_; // external - the first byte not marked yet
+    const char* resume_; // external - where the last row next_row found ended, nullptr before that
+    bool inside_; // whether a field is open where marking stopped
+    int quotes_; // the quotes in that field so far, counting up to 2
+
+    SorScanner(const char* end) {
+        end_ = end;
+        base_ = nullptr;
+        level_ = simd_level();
+        bmi_ = false;
+#ifdef SIMD_X86
+        bmi_ = level_ != SIMD_SCALAR && __builtin_cpu_supports("bmi");
+#endif
+        marked_ = 0;
+        mark_ = 0;
+        next_ = nullptr;
+        resume_ = nullptr;
+        inside_ = false;
+        quotes_ = 0;
+    }
+
+    /**
+     * @brief Finds the fields of the row at *pos, as repeated calls to sor_next_field would, and moves *pos
+     * past its newline, or to the end of the text. The first max fields go in starts and stops. Going on
+     * from where the last row ended, past blank lines if need be, uses up the marks already made.
+     *
+     * @return size_t - how many fields the row has, which can be more than max
+     */
+    size_t next_row(const char** pos, const char** starts, const char** stops, size_t max) {
+        size_t n = 0;
+        if(level_ == SIMD_SCALAR) {
+            const char* s;
+            const char* e;
+            for (; sor_next_field(pos, end_, &s, &e); n++)
+            {
+                if(n < max) {
+                    starts[n] = s;
+                    stops[n] = e;
+                }
+            }
+            return n;
+        }
+        if(*pos >= end_) return 0;
+        if(*pos != resume_) restart_(*pos);
+        while(true) {
+            if(marked_ - mark_ < 2) {
+                ready_(2);
+                if(mark_ == marked_) break;
+                if(marked_ - mark_ < 2 && *marks_[mark_] != '\n') break; // a field the text ends in the middle of
+            }
+            // a '<' is followed by the '>' closing it, one cut off by a newline isn't marked
+            const char* m = marks_[mark_];
+            if(*m == '\n') {
+                mark_++;
+                *pos = resume_ = m + 1;
+                return n;
+            }
+            if(n < max) {
+                starts[n] = m + 1;
+                stops[n] = marks_[mark_ + 1];
+            }
+            n++;
+            mark_ += 2;
+        }
+        *pos = resume_ = end_;
+        return n;
+    }
+
+    /** See sor_count_rows, over [begin, end of the text). */
+    size_t count_rows(const char* begin) {
+        if(level_ == SIMD_SCALAR) return sor_count_rows(begin, end_);
+        size_t rows = 0;
+        bool content = false;
+        for (const char* b = begin; b < end_; b += SOR_BLOCK)
+        {
+            load_(b, false);
+            uint64_t text = ~(block_.newline | block_.space);
+            for (uint64_t nl = block_.newline; nl != 0; nl &= nl - 1)
+            {
+                int i = __builtin_ctzll(nl);
+                uint64_t line = ((uint64_t)1 << i) - 1; // the bytes before the newline, cleared once counted
+                rows += content || (text & line) != 0;
+                content = false;
+                text &= ~line;
+            }
+            content = content || text != 0; // what's left comes after the block's last newline
+        }
+        return rows + content;
+    }
+
+    /** See sor_skip_rows, over [begin, end of the text). */
+    const char* skip_rows(const char* begin, size_t n) {
+        if(level_ == SIMD_SCALAR) return sor_skip_rows(begin, end_, n);
+        if(n == 0) return begin;
+        bool content = false;
+        for (const char* b = begin; b < end_; b += SOR_BLOCK)
+        {
+            load_(b, false);
+            uint64_t text = ~(block_.newline | block_.space);
+            for (uint64_t nl = block_.newline; nl != 0; nl &= nl - 1)
+            {
+                int i = __builtin_ctzll(nl);
+                uint64_t line = ((uint64_t)1 << i) - 1;
+                if((content || (text & line) != 0) && --n == 0) return b + i + 1;
+                content = false;
+                text &= ~line;
+            }
+            content = content || text != 0;
+        }
+        return end_;
+    }
+
+    /** classifies the block starting at b, for marking fields or else for counting rows */
+    void load_(const char* b, bool fields) {
+        base_ = b;
+        char padded[SOR_BLOCK];
+        if(end_ - b < SOR_BLOCK) {
+            memset(padded, ' ', SOR_BLOCK);
+            memcpy(padded, b, end_ - b);
+            b = padded;
+        }
+#ifdef SIMD_X86
+        if(level_ == SIMD_AVX2) sor_classify_avx2_(b, &block_, fields);
+        else sor_classify_sse41_(b, &block_, fields);
+#endif
+    }
+
+    /** starts marking at pos, unless that is past blank lines after the last row and it can go on */
+    void restart_(const char* pos) {
+        while(mark_ < marked_ && marks_[mark_] < pos && *marks_[mark_] == '\n') mark_++;
+        if(resume_ == nullptr || pos < resume_ || pos > next_ || (mark_ < marked_ && marks_[mark_] < pos)) {
+            marked_ = 0;
+            mark_ = 0;
+            next_ = pos;
+            inside_ = false;
+        }
+        resume_ = pos;
+    }
+
+    /** whether there are n marks left, marking more blocks if need be */
+    bool ready_(size_t n) {
+        while(marked_ - mark_ < n) {
+            if(next_ >= end_) return false;
+            // at most one mark is left over, which goes to the front
+            for (size_t i = mark_; i < marked_; i++) marks_[i - mark_] = marks_[i];
+            marked_ -= mark_;
+            mark_ = 0;
+            load_(next_, true);
+            next_ = end_ - next_ > SOR_BLOCK ? next_ + SOR_BLOCK : end_;
+            if(!mark_block_()) follow_block_();
+        }
+        return true;
+    }
+
+    /**
+     * @brief Marks the block from its bitmaps. It gives up, having marked nothing, when that could differ
+     * from following the rules: when a field open from the last block already has two quotes, when a '<'
+     * or '>' outside quotes comes where the other was due, when a field runs over a newline, when a quote
+     * is outside every field, or when a field has more than two, which is when the first '<' or quote
+     * after a closing quote is a quote.
+     */
+    bool mark_block_() {
+        if(inside_ && quotes_ == 2) return false;
+        uint64_t quote = block_.quote;
+        uint64_t quoted = sor_prefix_xor(quote) ^ (inside_ && quotes_ == 1 ? ~(uint64_t)0 : 0); // after each byte
+        uint64_t open = block_.open & ~quoted;
+        uint64_t close = block_.close & ~quoted;
+        uint64_t inside = sor_prefix_xor(open | close) ^ (inside_ ? ~(uint64_t)0 : 0);
+        uint64_t before = inside ^ open ^ close;
+        if(((open & before) | (close & ~before) | (block_.newline & inside) | (quote & ~inside)) != 0) return false;
+        uint64_t opening = quote & quoted;
+        uint64_t events = open | opening;
+        // adding a closing quote carries up to the next '<' or opening quote
+        if(((~events + (quote & ~quoted)) & opening) != 0) return false;
+
+        if(inside >> 63) {
+            uint64_t field = ~(uint64_t)0; // the open field's bytes
+            if(open != 0) {
+                field = ~(((uint64_t)2 << (63 - __builtin_clzll(open))) - 1);
+                quotes_ = 0;
+            }
+            uint64_t q = quote & field;
+            quotes_ += (q != 0) + (sor_drop_lowest(q) != 0);
+        }
+        inside_ = inside >> 63;
+        uint64_t bits = open | close | block_.newline;
+#ifdef SIMD_X86
+        if(bmi_) {
+            marked_ += sor_flatten_bmi_(bits, base_, marks_ + marked_);
+            return true;
+        }
+#endif
+        marked_ += sor_flatten(bits, base_, marks_ + marked_);
+        return true;
+    }
+
+    /** Marks the block following the rules, a '<', '>', '"' or newline at a time. */
+    void follow_block_() {
+        for (uint64_t bits = block_.open | block_.close | block_.quote | block_.newline; bits != 0; bits = sor_drop_lowest(bits))
+        {
+            const char* p = base_ + __builtin_ctzll(bits);
+            if(*p == '\n') {
+                if(inside_) marked_--; // the field is cut off, its '<' is the last mark
+                inside_ = false;
+                marks_[marked_++] = p;
+            }
+            else if(!inside_) {
+                if(*p == '<') {
+                    inside_ = true;
+                    quotes_ = 0;
+                    marks_[marked_++] = p;
+                }
+            }
+            else if(*p == '"') {
+                if(quotes_ < 2) quotes_++;
+            }
+            else if(*p == '>' && quotes_ != 1) {
+                inside_ = false;
+                marks_[marked_++] = p;
+            }
+        }
+    }
+};
@@ -1,7 +1,7 @@
 #include <assert.h>
 
 #include "dataframe/dataframe.h"
-#include "dataframe/frame_builder.h"
+#include "dataframe/sor_reader.h"
 
 
 enum class OperationType { GET, TYPE, PRINT, INVALID };
@@ -90,8 +90,8 @@ void executeOperation(DataFrame& df, OperationType ot, size_t col, size_t row) {
 }
 
 DataFrame* buildFrame(char* path) {
-	SOR_FrameBuilder builder(path);
-	DataFrame* frame = builder.build(0);
+	SorReader reader(path);
+	DataFrame* frame = reader.build(*ThreadPool::shared());
 	assert(frame != 0);
 	return frame;
 }
@@ -0,0 +1,208 @@
+#pragma once
+
+#include "../utils/object.h"
+#include "../utils/thread.h"
+#include "key.h"
+#include "value.h"
+
+#define CHUNK_CACHE_BYTES (1 << 26) // 64mb, about 128 full chunks
+
+/**
+ * @brief A value in the cache, linked into the recency list.
+ */
+class CacheEntry : public Object {
+public:
+    Key* k_; // owned
+    Value* v_; // owned
+    size_t bytes_;
+    CacheEntry* newer_; // external
+    CacheEntry* older_; // external
+
+    CacheEntry(Key* k, Value* v) {
+        k_ = dynamic_cast<Key *>(k->clone());
+        v_ = v->clone();
+        bytes_ = v->serialized()->size_;
+        newer_ = nullptr;
+        older_ = nullptr;
+    }
+
+    ~CacheEntry() {
+        delete(k_);
+        delete(v_);
+    }
+};
+
+/**
+ * @brief Copies of values that live on other nodes, shared by every column and dataframe on this node.
+ * Holds at most a fixed number of bytes and evicts the least recently used value to make room.
+ * Entries are found through an open addressed index, removed by shifting their successors back.
+ */
+class ChunkCache : public Object {
+public:
+    Lock lock_;
+    CacheEntry** slots_; // owned, elements owned - nullptr marks an empty slot
+    size_t capacity_; // always a power of 2
+    size_t count_;
+    CacheEntry* newest_; // external
+    CacheEntry* oldest_; // external
+    size_t bytes_; // held right now
+    size_t max_bytes_;
+    Counter hits_;
+    Counter misses_;
+    Counter evictions_;
+
+    ChunkCache(size_t max_bytes) {
+        max_bytes_ = max_bytes;
+        bytes_ = 0;
+        count_ = 0;
+        capacity_ = 16;
+        slots_ = new CacheEntry*[capacity_];
+        for (size_t i = 0; i < capacity_; i++) slots_[i] = nullptr;
+        newest_ = nullptr;
+        oldest_ = nullptr;
+    }
+
+    ChunkCache() : ChunkCache(CHUNK_CACHE_BYTES) {}
+
+    ~ChunkCache() {
+        for (size_t i = 0; i < capacity_; i++)
+        {
+            if(slots_[i] != nullptr) delete(slots_[i]);
+        }
+        delete[](slots_);
+    }
+
+    size_t count() {
+        lock_.lock();
+        size_t c = count_;
+        lock_.unlock();
+        return c;
+    }
+
+    /**
+     * @brief looks up the cached copy of the given key's value, marking it as just used
+     *
+     * @param k - the key
+     * @return Value* - a copy of the value owned by the caller, nullptr if it isn't cached
+     */
+    Value* get(Key* k) {
+        lock_.lock();
+        size_t i = slot_(k);
+        Value* v = nullptr;
+        if(slots_[i] != nullptr) {
+            CacheEntry* e = slots_[i];
+            unlink_(e);
+            link_(e);
+            v = e->v_->clone();
+        }
+        lock_.unlock();
+        if(v == nullptr) misses_.next();
+        else hits_.next();
+        return v;
+    }
+
+    /**
+     * @brief caches a copy of the given value, evicting the least recently used ones until it fits
+     * Values bigger than the whole cache aren't kept.
+     *
+     * @param k - the key
+     * @param v - the value
+     */
+    void put(Key* k, Value* v) {
+        if(v->serialized()->size_ > max_bytes_) return;
+        lock_.lock();
+        size_t i = slot_(k);
+        if(slots_[i] != nullptr) remove_(i);
+        CacheEntry* e = new CacheEntry(k, v);
+        while(bytes_ + e->bytes_ > max_bytes_) {
+            remove_(slot_(oldest_->k_));
+            evictions_.next();
+        }
+        if((count_ + 1) * 2 > capacity_) grow_();
+        insert_(e);
+        lock_.unlock();
+    }
+
+    /**
+     * @brief drops the given key's value, if it's cached
+     *
+     * @param k - the key
+     */
+    void remove(Key* k) {
+        lock_.lock();
+        size_t i = slot_(k);
+        if(slots_[i] != nullptr) remove_(i);
+        lock_.unlock();
+    }
+
+    // the slot holding the given key, or the empty slot it would go in
+    size_t slot_(Key* k) {
+        size_t mask = capacity_ - 1;
+        size_t i = k->hash() & mask;
+        while(slots_[i] != nullptr && !slots_[i]->k_->equals(k)) i = (i + 1) & mask;
+        return i;
+    }
+
+    // adds e to the index and as the newest entry, assumes there's room
+    void insert_(CacheEntry* e) {
+        slots_[slot_(e->k_)] = e;
+        link_(e);
+        bytes_ += e->bytes_;
+        count_++;
+    }
+
+    // deletes the entry in slot i
+    void remove_(size_t i) {
+        CacheEntry* e = slots_[i];
+        unlink_(e);
+        bytes_ -= e->bytes_;
+        count_--;
+        delete(e);
+
+        // shift back any entry that would no longer be reachable from its home slot
+        size_t mask = capacity_ - 1;
+        size_t j = i;
+        while(true) {
+            j = (j + 1) & mask;
+            if(slots_[j] == nullptr) break;
+            size_t home = slots_[j]->k_->hash() & mask;
+            if(((j - home) & mask) >= ((j - i) & mask)) {
+                slots_[i] = slots_[j];
+                i = j;
+            }
+        }
+        slots_[i] = nullptr;
+    }
+
+    void grow_() {
+        CacheEntry** old = slots_;
+        size_t old_capacity = capacity_;
+        capacity_ *= 2;
+        slots_ = new CacheEntry*[capacity_];
+        for (size_t i = 0; i < capacity_; i++) slots_[i] = nullptr;
+        for (size_t i = 0; i < old_capacity; i++)
+        {
+            if(old[i] != nullptr) slots_[slot_(old[i]->k_)] = old[i];
+        }
+        delete[](old);
+    }
+
+    // makes e the newest entry
+    void link_(CacheEntry* e) {
+        e->older_ = newest_;
+        e->newer_ = nullptr;
+        if(newest_ != nullptr) newest_->newer_ = e;
+        newest_ = e;
+        if(oldest_ == nullptr) oldest_ = e;
+    }
+
+    // takes e out of the recency list
+    void unlink_(CacheEntry* e) {
+        if(e->newer_ != nullptr) e->newer_->older_ = e->older_;
+        else newest_ = e->older_;
+        if(e->older_ != nullptr) e->older_->newer_ = e->newer_;
+        else oldest_ = e->newer_;
+        e->newer_ = nullptr;
+        e->older_ = nullptr;
+    }
+};
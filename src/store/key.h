@@ -24,6 +24,7 @@ class Key : public SerializableObject {
         assert(strlen(name) > 0);
         name_ = duplicate(name);
         idx_ = idx;
+        hash_ = hash_me(); // up front, so keys shared between threads never write it
     }
 
     /**
@@ -36,6 +37,7 @@ class Key : public SerializableObject {
         assert(strlen(name) > 0);
         name_ = duplicate(name);
         idx_ = idx;
+        hash_ = hash_me();
     }
 
     /**
@@ -55,11 +57,12 @@ class Key : public SerializableObject {
 
     // inherited from object
     size_t hash_me() {
-        size_t h = 0;
-        for (size_t i = 0; i < strlen(name_); ++i) {
-            h += 31 * name_[i]; // use a prime larger than 26
+        // FNV-1a, so keys that differ in a character or its position spread across the store
+        size_t h = 14695981039346656037UL;
+        for (const char* c = name_; *c != '\0'; c++) {
+            h = (h ^ (unsigned char)*c) * 1099511628211UL;
         }
-        return h;
+        return (h ^ idx_) * 1099511628211UL;
     }
 
     // inherited from object
@@ -68,38 +71,32 @@ class Key : public SerializableObject {
     }
 
     SerialString* serialize() {
-        size_t name_len = strlen(name_);
-        char* arr = new char[sizeof(size_t) + name_len + sizeof(size_t)];
-        size_t pos = 0;
-
-        memcpy(arr, &name_len, sizeof(size_t));
-        pos += sizeof(size_t);
-
-        memcpy(arr + pos, name_, name_len);
-        pos += name_len;
-
-        memcpy(arr + pos, &idx_, sizeof(size_t));
-        pos += sizeof(size_t);
+        Serializer s;
+        serialize_into(s);
+        return s.to_serial();
+    }
 
-        SerialString* ss = new SerialString(arr, pos);
-        delete[](arr);
-        return ss;
+    // the name's length, the name, then the index
+    void serialize_into(Serializer& s) {
+        size_t name_len = strlen(name_);
+        s.write_size(name_len);
+        s.write(name_, name_len);
+        s.write_size(idx_);
     }
 
     static Key* deserialize(SerialString* serial) {
-        size_t pos = 0;
-
-        size_t name_len;
-        memcpy(&name_len, serial->data_, sizeof(size_t));
-        pos += sizeof(size_t);
+        Deserializer d(serial);
+        return deserialize(d);
+    }
 
+    static Key* deserialize(Deserializer& d) {
+        size_t name_len = d.read_size();
+        SerialView name_view = d.read_bytes(name_len);
         char* name = new char[name_len + 1];
-        memcpy(name, serial->data_ + pos, name_len);
+        memcpy(name, name_view.data_, name_len);
         name[name_len] = 0;
-        pos += name_len;
 
-        size_t idx;
-        memcpy(&idx, serial->data_ + pos, sizeof(size_t));
+        size_t idx = d.read_size();
 
         Key* k = new Key(name, idx);
         delete[](name);
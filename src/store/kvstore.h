@@ -3,192 +3,553 @@
 //#include <unistd.h>
 
 #include "../utils/object.h"
+#include "../utils/primitivearray.h"
 #include "key.h"
 #include "value.h"
 #include "message.h"
 #include "network.h"
+#include "cache.h"
 
 #define STARTING_CAPACITY 8
 #define GROWTH_FACTOR 4
 #define GROWTH_THRESHOLD 0.5
 
 /**
- * @brief A node stored in the KVStore that allows for collision handling
- * 
+ * @brief The key value pairs stored locally by a KVStore.
+ * An open addressed table that keeps each key's hash inline, so probing only compares keys whose hashes match.
+ * Entries are removed by shifting their successors back rather than leaving tombstones.
  */
-class KVStore_Node : public Object {
+class KVTable : public Object {
 public:
-    Key* k_; // owned
-    Value* v_; // owned
-    KVStore_Node* next_; // owned
+    size_t* hashes_; // owned
+    Key** keys_; // owned, elements owned - nullptr marks an empty slot
+    Value** values_; // owned, elements owned
+    size_t capacity_; // always a power of 2
+    size_t count_;
 
     /**
-     * @brief Construct a new kvstore node object
+     * @brief Construct a new kvtable object
      * 
-     * @param k - key
-     * @param v - value
+     * @param capacity - the starting capacity, rounded up to a power of 2
      */
-    KVStore_Node(Key* k, Value* v) {
-        k_ = dynamic_cast<Key *>(k->clone());
-        v_ = v->clone();
-        next_ = nullptr;
+    KVTable(size_t capacity) {
+        capacity_ = 1;
+        while(capacity_ < capacity) capacity_ *= 2;
+        count_ = 0;
+        alloc_();
+    }
+
+    ~KVTable() {
+        for (size_t i = 0; i < capacity_; i++)
+        {
+            if(keys_[i] == nullptr) continue;
+            delete(keys_[i]);
+            delete(values_[i]);
+        }
+        free_();
+    }
+
+    void alloc_() {
+        hashes_ = new size_t[capacity_];
+        keys_ = new Key*[capacity_];
+        values_ = new Value*[capacity_];
+        for (size_t i = 0; i < capacity_; i++) keys_[i] = nullptr;
+    }
+
+    void free_() {
+        delete[](hashes_);
+        delete[](keys_);
+        delete[](values_);
+    }
+
+    /** the number of kv pairs */
+    size_t count() { return count_; }
+
+    // the slot holding the given key, or the empty slot it would go in
+    size_t slot_(Key* k, size_t h) {
+        size_t mask = capacity_ - 1;
+        size_t i = h & mask;
+        while(keys_[i] != nullptr && (hashes_[i] != h || !keys_[i]->equals(k))) i = (i + 1) & mask;
+        return i;
     }
 
     /**
-     * @brief Construct a new kvstore node object
+     * @brief grows the table if adding another pair would take it past the threshold
      * 
-     * @param k - key
-     * @param v - value
-     * @param next - next node in the cycle
+     * @return true - if it grew, moving every pair
      */
-    KVStore_Node(Key* k, Value* v, KVStore_Node* next) : KVStore_Node(k, v) {
-        next_ = next;
+    bool grow() {
+        if(count_ + 1 <= capacity_ * GROWTH_THRESHOLD) return false;
+
+        size_t* old_hashes = hashes_;
+        Key** old_keys = keys_;
+        Value** old_values = values_;
+        size_t old_capacity = capacity_;
+        capacity_ *= GROWTH_FACTOR;
+        alloc_();
+
+        // move each pair to its new slot, they're all distinct so there's no need to compare keys
+        size_t mask = capacity_ - 1;
+        for (size_t i = 0; i < old_capacity; i++)
+        {
+            if(old_keys[i] == nullptr) continue;
+            size_t j = old_hashes[i] & mask;
+            while(keys_[j] != nullptr) j = (j + 1) & mask;
+            hashes_[j] = old_hashes[i];
+            keys_[j] = old_keys[i];
+            values_[j] = old_values[i];
+        }
+        delete[](old_hashes);
+        delete[](old_keys);
+        delete[](old_values);
+        return true;
     }
 
     /**
-     * @brief Destroy the kvstore node object
-     * If this has a linked node in succession, we delete that too
+     * @brief Get the value mapped to the given key
+     * 
+     * @param k - the key
+     * @return Value* - the value, owned by this table, nullptr if the key isn't here
      */
-    ~KVStore_Node() {
-        delete(k_);
-        delete(v_);
-        if(next_ != nullptr) delete(next_);
+    Value* get(Key* k) {
+        size_t i = slot_(k, k->hash());
+        return keys_[i] == nullptr ? nullptr : values_[i];
     }
 
     /**
-     * @brief get the number of nodes (inclusive) in this linked set
+     * @brief maps a copy of the given key to a copy of the given value, replacing any value it had
      * 
-     * @return size_t - the number of nodes
+     * @param k - the key
+     * @param v - the value
      */
-    size_t count() {
-        if(next_ == nullptr) return 1;
-        return next_->count() + 1;
+    void set(Key* k, Value* v) {
+        size_t h = k->hash();
+        size_t i = slot_(k, h);
+        if(keys_[i] != nullptr) {
+            delete(values_[i]);
+            values_[i] = v->clone();
+            return;
+        }
+        if(grow()) i = slot_(k, h);
+        hashes_[i] = h;
+        keys_[i] = dynamic_cast<Key *>(k->clone());
+        values_[i] = v->clone();
+        count_++;
     }
 
     /**
-     * @brief append the given node to the end of this set
+     * @brief removes the pair with the given key, if there is one
      * 
-     * @param n - the node to be appended
+     * @param k - the key
      */
-    void pushBack(KVStore_Node* n) {
-        if(next_ == nullptr) {
-            next_ = n;
+    void remove(Key* k) {
+        size_t i = slot_(k, k->hash());
+        if(keys_[i] == nullptr) return;
+        delete(keys_[i]);
+        delete(values_[i]);
+
+        // shift back any entry that would no longer be reachable from its home slot
+        size_t mask = capacity_ - 1;
+        size_t j = i;
+        while(true) {
+            j = (j + 1) & mask;
+            if(keys_[j] == nullptr) break;
+            size_t home = hashes_[j] & mask;
+            if(((j - home) & mask) >= ((j - i) & mask)) {
+                hashes_[i] = hashes_[j];
+                keys_[i] = keys_[j];
+                values_[i] = values_[j];
+                i = j;
+            }
         }
-        else next_->pushBack(n);
+        keys_[i] = nullptr;
+        count_--;
+    }
+};
+
+/**
+ * @brief The eventual result of a get, filled in by whichever thread receives the value.
+ * Owned by whoever asked for the value, who must wait on it (get()) before deleting it.
+ */
+class ValueFuture : public Object {
+public:
+    Lock lock_;
+    Value* v_; // owned until taken by get()
+    bool done_;
+
+    ValueFuture() {
+        v_ = nullptr;
+        done_ = false;
+    }
+
+    ~ValueFuture() {
+        if(v_ != nullptr) delete(v_);
+    }
+
+    /**
+     * @brief provides the value and wakes up anyone waiting on it
+     * 
+     * @param v - the value, consumed
+     */
+    void fulfil(Value* v) {
+        lock_.lock();
+        v_ = v;
+        done_ = true;
+        // notify before unlocking, once the lock is released the waiter may delete this
+        lock_.notify_all();
+        lock_.unlock();
+    }
+
+    /**
+     * @brief checks if the value has arrived
+     */
+    bool ready() {
+        lock_.lock();
+        bool done = done_;
+        lock_.unlock();
+        return done;
+    }
+
+    /**
+     * @brief waits for the value and takes ownership of it, can only be called once
+     * 
+     * @return Value* - the value
+     */
+    Value* get() {
+        lock_.lock();
+        while(!done_) lock_.wait();
+        Value* v = v_;
+        v_ = nullptr;
+        lock_.unlock();
+        return v;
+    }
+};
+
+/**
+ * @brief The requests this node has sent that are still waiting on a reply, keyed by request id.
+ * An open addressed table, entries are removed by shifting their successors back.
+ */
+class PendingTable : public Object {
+public:
+    size_t* ids_; // owned
+    ValueFuture** futures_; // owned, elements external - nullptr marks an empty slot
+    size_t capacity_; // always a power of 2
+    size_t count_;
+    Lock lock_;
+
+    PendingTable() {
+        capacity_ = 16;
+        count_ = 0;
+        ids_ = new size_t[capacity_];
+        futures_ = new ValueFuture*[capacity_];
+        for (size_t i = 0; i < capacity_; i++) futures_[i] = nullptr;
+    }
+
+    ~PendingTable() {
+        delete[](ids_);
+        delete[](futures_);
+    }
+
+    size_t count() {
+        lock_.lock();
+        size_t c = count_;
+        lock_.unlock();
+        return c;
+    }
+
+    // assumes the lock is held and there's a free slot
+    void insert_(size_t id, ValueFuture* f) {
+        size_t i = id & (capacity_ - 1);
+        while(futures_[i] != nullptr) i = (i + 1) & (capacity_ - 1);
+        ids_[i] = id;
+        futures_[i] = f;
     }
 
     /**
-     * @brief pop the last node of this set
+     * @brief registers a request that is waiting on a reply
      * 
-     * @return KVStore_Node* - the popped node
+     * @param id - the id of the request
+     * @param f - where the reply goes, external
      */
-    KVStore_Node* pop() {
-        if(next_ != nullptr) {
-            if(next_->next_ == nullptr) {
-                KVStore_Node* node = next_;
-                next_ = nullptr;
-                return node;
+    void add(size_t id, ValueFuture* f) {
+        lock_.lock();
+        if((count_ + 1) * 2 > capacity_) {
+            size_t* old_ids = ids_;
+            ValueFuture** old_futures = futures_;
+            size_t old_capacity = capacity_;
+            capacity_ *= 2;
+            ids_ = new size_t[capacity_];
+            futures_ = new ValueFuture*[capacity_];
+            for (size_t i = 0; i < capacity_; i++) futures_[i] = nullptr;
+            for (size_t i = 0; i < old_capacity; i++)
+            {
+                if(old_futures[i] != nullptr) insert_(old_ids[i], old_futures[i]);
             }
-            return next_->pop();
+            delete[](old_ids);
+            delete[](old_futures);
         }
-        return nullptr;
+        insert_(id, f);
+        count_++;
+        lock_.unlock();
     }
 
     /**
-     * @brief finds and returns the node with the given key
-     * returns nullptr if the node doesn't exit
+     * @brief removes the request with the given id
      * 
-     * @param k - the key of the node to find
-     * @return KVStore_Node* - the node
+     * @param id - the id of the request
+     * @return ValueFuture* - where its reply goes, nullptr if there's no such request
      */
-    KVStore_Node* find(Key* k) {
-        if(k->equals(k_)) return this;
-        else if(next_ == nullptr) {
-            return nullptr;
+    ValueFuture* take(size_t id) {
+        lock_.lock();
+        size_t mask = capacity_ - 1;
+        size_t i = id & mask;
+        while(futures_[i] != nullptr && ids_[i] != id) i = (i + 1) & mask;
+        ValueFuture* f = futures_[i];
+        if(f != nullptr) {
+            // shift back any entry that would no longer be reachable from its home slot
+            size_t j = i;
+            while(true) {
+                j = (j + 1) & mask;
+                if(futures_[j] == nullptr) break;
+                size_t home = ids_[j] & mask;
+                if(((j - home) & mask) >= ((j - i) & mask)) {
+                    ids_[i] = ids_[j];
+                    futures_[i] = futures_[j];
+                    i = j;
+                }
+            }
+            futures_[i] = nullptr;
+            count_--;
         }
-        return next_->find(k);
+        lock_.unlock();
+        return f;
+    }
+};
+
+#define WAIT_BUCKETS 64
+
+/**
+ * @brief A Reduce waiting on the owning node for chunks that haven't been put yet, with a Waiter
+ * parked on each of them. Whoever answers the last of those finishes it: the reduction goes back
+ * to whoever asked, or nothing if any of the chunks ran out of time.
+ */
+class PendingReduce : public Object {
+public:
+    Reduce* r_; // owned
+    ValueFuture* f_; // external, set if the request came from this node
+    std::atomic<size_t> missing_; // waiters not answered yet, plus one while they're being parked
+    std::atomic<bool> failed_; // whether a waiter timed out
+
+    PendingReduce(Reduce* r, ValueFuture* f) {
+        r_ = r;
+        f_ = f;
+        missing_ = 1;
+        failed_ = false;
+    }
+
+    ~PendingReduce() { delete(r_); }
+};
+
+/**
+ * @brief A get that arrived before its key did, parked on the node that owns the key.
+ * Either a remote request (answered with a Status or Fail), a local future or part of a PendingReduce.
+ */
+class Waiter : public Object {
+public:
+    Key* k_; // owned
+    size_t requester_; // the node that asked
+    size_t id_; // the request id, to answer with
+    ValueFuture* f_; // external, set if the request came from this node
+    PendingReduce* reduce_; // external, set if a reduction is waiting on the key
+    size_t deadline_; // from Thread::now(), 0 means never
+    Waiter* next_; // external, the next waiter in the same list
+
+    Waiter(Key* k, size_t requester, size_t id, ValueFuture* f, size_t timeout) {
+        k_ = dynamic_cast<Key *>(k->clone());
+        requester_ = requester;
+        id_ = id;
+        f_ = f;
+        reduce_ = nullptr;
+        deadline_ = timeout == 0 ? 0 : Thread::now() + timeout;
+        next_ = nullptr;
+    }
+
+    ~Waiter() { delete(k_); }
+};
+
+/**
+ * @brief The gets parked on this node, bucketed by key.
+ * Not synchronized, the KVStore only touches it while holding the same lock it puts under,
+ * so a get can't miss a put between checking for the key and parking. count_ may be read without it.
+ */
+class WaitList : public Object {
+public:
+    Waiter** buckets_; // owned, elements owned
+    std::atomic<size_t> count_;
+
+    WaitList() {
+        count_ = 0;
+        buckets_ = new Waiter*[WAIT_BUCKETS];
+        for (size_t i = 0; i < WAIT_BUCKETS; i++) buckets_[i] = nullptr;
+    }
+
+    ~WaitList() {
+        for (size_t i = 0; i < WAIT_BUCKETS; i++)
+        {
+            Waiter* w = buckets_[i];
+            while(w != nullptr) {
+                Waiter* next = w->next_;
+                delete(w);
+                w = next;
+            }
+        }
+        delete[](buckets_);
     }
 
     /**
-     * @brief Get the Value object of the node with the given key
-     * returns nullptr if the key can't be found
+     * @brief parks the given waiter
      * 
-     * @param k - the key mapped to the value
-     * @return Value* - the value mapped to the key
+     * @param w - the waiter, consumed
      */
-    Value* getValue(Key* k) {
-        KVStore_Node* node = find(k);
-        if(node == nullptr) return nullptr;
-        return node->v_;
+    void add(Waiter* w) {
+        size_t b = w->k_->hash() % WAIT_BUCKETS;
+        w->next_ = buckets_[b];
+        buckets_[b] = w;
+        count_++;
     }
 
     /**
-     * @brief links the given key to the given value in this node set, updating a node if the key already exists
+     * @brief removes every waiter for the given key
      * 
      * @param k - the key
-     * @param v - the new value
+     * @return Waiter* - the removed waiters linked through next_, owned by the caller
      */
-    void set(Key* k, Value* v) {
-        KVStore_Node* node = find(k);
-        if(node == nullptr) pushBack(new KVStore_Node(k, v));
-        else { 
-            delete(node->v_);
-            node->v_ = v->clone();
-        }
+    Waiter* take(Key* k) {
+        if(count_ == 0) return nullptr;
+        return take_if_(k->hash() % WAIT_BUCKETS, k, 0);
     }
 
     /**
-     * @brief removes the node with the given k
+     * @brief removes every waiter whose deadline has passed
      * 
-     * @param k - 
+     * @param now - the current Thread::now()
+     * @return Waiter* - the removed waiters linked through next_, owned by the caller
      */
-    void remove(Key* k) {
-        if(next_ == nullptr) return;
-        else if(next_->k_->equals(k)) {
-            KVStore_Node* node = next_;
-            next_ = node->next_;
-            delete(node);
+    Waiter* take_expired(size_t now) {
+        Waiter* taken = nullptr;
+        for (size_t i = 0; i < WAIT_BUCKETS && count_ > 0; i++)
+        {
+            Waiter* w = take_if_(i, nullptr, now);
+            while(w != nullptr) {
+                Waiter* next = w->next_;
+                w->next_ = taken;
+                taken = w;
+                w = next;
+            }
         }
-        else {
-            next_->remove(k);
+        return taken;
+    }
+
+    // removes the waiters in bucket b that are for k (if given) or expired by now (if given)
+    Waiter* take_if_(size_t b, Key* k, size_t now) {
+        Waiter* taken = nullptr;
+        Waiter** link = &buckets_[b];
+        while(*link != nullptr) {
+            Waiter* w = *link;
+            bool match = k != nullptr ? w->k_->equals(k) : w->deadline_ != 0 && w->deadline_ <= now;
+            if(match) {
+                *link = w->next_;
+                w->next_ = taken;
+                taken = w;
+                count_--;
+            }
+            else link = &w->next_;
         }
+        return taken;
     }
 };
 
 class KVStore; // forward dec
+class NetworkListener; // forward dec
+
+#define DISPATCH_WORKERS 4
+
+/**
+ * @brief Serves the gets a NetworkListener hands off, so a slow request
+ * (e.g. a Get for a big chunk) doesn't hold up the messages behind it.
+ */
+class DispatchWorker : public Thread {
+public:
+    NetworkListener* listener_; // external
+
+    DispatchWorker(NetworkListener* listener) {
+        listener_ = listener;
+    }
+
+    void run();
+};
 
 class NetworkListener : public Thread {
 public:
-    size_t fail_count_;
-    Lock prod_;
-    Lock cons_;
     KVStore* store_; // external
-    Status* s_; // owned
+    std::atomic<bool> running_;
+    MsgChannel work_; // requests waiting for a worker
+    DispatchWorker** workers_; // owned, elements owned
 
     NetworkListener(KVStore* store) {
-        fail_count_ = 0;
         store_ = store;
-        s_ = nullptr;
+        running_ = true;
+        workers_ = new DispatchWorker*[DISPATCH_WORKERS];
+        for (size_t i = 0; i < DISPATCH_WORKERS; i++)
+        {
+            workers_[i] = new DispatchWorker(this);
+        }
     }
 
-    ~NetworkListener() { if(s_ != nullptr) delete(s_); }
+    ~NetworkListener() {
+        for (size_t i = 0; i < DISPATCH_WORKERS; i++)
+        {
+            delete(workers_[i]);
+        }
+        delete[](workers_);
+    }
 
-    Status* await_status() {
-        //prod_.notify_all(); // let producer know we need a status
-        if(s_ == nullptr) { prod_.notify_all(); cons_.wait(); } // wait until s_ available
-        fail_count_ = 0;
-        Status* s = s_;
-        s_ = nullptr;
-        cons_.unlock();
-        prod_.notify_all();
-        return s;
+    /** Stop listening and wait for the listener and its workers to finish */
+    void stop() {
+        running_ = false;
+        join();
     }
 
     void handleGet(Get* g);
 
+    void handleMultiGet(MultiGet* mg);
+
+    void handleReduce(Reduce* r);
+
+    void handleStatus(Status* s);
+
+    void handleMultiStatus(MultiStatus* ms);
+
+    void handleFail(Fail* f);
+
     void run();
 };
 
+#define KV_SHARDS 16 // a power of 2
+
+/**
+ * @brief One stripe of a KVStore, holding the pairs whose keys hash to it and the gets parked on those keys.
+ * Lookups share the lock, anything that changes the table or the waiters takes it exclusively.
+ */
+class KVShard : public Object {
+public:
+    RWLock lock_;
+    KVTable table_;
+    WaitList waiters_;
+
+    KVShard(size_t capacity) : table_(capacity) {}
+};
+
 /**
  * @brief A Key Value Store where keys are a string and values are a serialized object in string form
  * 
@@ -196,12 +557,12 @@ public:
 class KVStore : public Object {
 public:
     size_t idx_;
-    Lock prod_;
-    Lock cons_;
     NetworkIfc* network_; // unowned
+    Counter next_id_; // for requests sent by this store
+    PendingTable pending_; // requests waiting on a reply
+    KVShard** shards_; // owned, elements owned - the pairs stored on this node and the gets waiting on them
+    ChunkCache cache_; // copies of values from other nodes
     NetworkListener listener_;
-    KVStore_Node** nodes_; // owned, elements owned
-    size_t capacity_; 
 
     /**
      * @brief Construct a new KVStore object with a given capacitys
@@ -211,14 +572,11 @@ public:
     KVStore(size_t idx, NetworkIfc* network, size_t capacity) : listener_(this) {
         idx_ = idx;
         network_ = network;
-
-        capacity_ = capacity;
-        nodes_ = new KVStore_Node*[capacity_];
-        for (size_t i = 0; i < capacity_; i++)
+        shards_ = new KVShard*[KV_SHARDS];
+        for (size_t i = 0; i < KV_SHARDS; i++)
         {
-            nodes_[i] = nullptr;
+            shards_[i] = new KVShard((capacity + KV_SHARDS - 1) / KV_SHARDS);
         }
-
         listener_.start();
     }
 
@@ -233,12 +591,9 @@ public:
      * 
      */
     ~KVStore() {
-        listener_.store_ = nullptr;
-        listener_.join();
-        for(size_t i = 0; i < capacity_; i++) {
-            if(nodes_[i] != nullptr) delete(nodes_[i]);
-        }
-        delete[](nodes_);
+        listener_.stop();
+        for (size_t i = 0; i < KV_SHARDS; i++) delete(shards_[i]);
+        delete[](shards_);
     }
 
     /**
@@ -247,113 +602,365 @@ public:
      * @return size_t - the number of kv pairs
      */
     size_t count() {
-        size_t count = 0;
-        for (size_t i = 0; i < capacity_; i++)
+        size_t c = 0;
+        for (size_t i = 0; i < KV_SHARDS; i++)
         {
-            if(nodes_[i] != nullptr) count += nodes_[i]->count();
+            shards_[i]->lock_.lock_shared();
+            c += shards_[i]->table_.count();
+            shards_[i]->lock_.unlock_shared();
         }
-        return count;
+        return c;
+    }
+
+    /** the number of gets parked on this node */
+    size_t parked() {
+        size_t c = 0;
+        for (size_t i = 0; i < KV_SHARDS; i++) c += shards_[i]->waiters_.count_;
+        return c;
+    }
+
+    /** the shard the given key lives in, picked with the hash bits its table doesn't probe with */
+    KVShard* shard_(Key* k) {
+        return shards_[(k->hash() >> 32) & (KV_SHARDS - 1)];
     }
 
     /**
-     * @brief Get the index of the given key
+     * @brief gets the value linked to the given key
+     * Force wait and get if provided with external key (key in another node)
      * 
      * @param k - the key
-     * @return size_t - the index
+     * @return Value* - the linked value
      */
-    size_t get_position(Key* k) {
-        return k->hash() % capacity_;
+    Value* get(Key* k) {
+        if(k->idx_ != idx_) return waitAndGet(k);
+        return find_(k);
     }
 
     /**
-     * @brief inserts a given node into its proper location in the store
+     * @brief gets the value linked to the given key, keeping a copy in the node's cache if it lives elsewhere.
+     * Only for values that don't change once they're put, like the chunks and columns of a dataframe, so
+     * it waits for a local key that hasn't arrived yet rather than giving up on it.
      * 
-     * @param node - the node to be inserted
+     * @param k - the key
+     * @return Value* - the linked value
      */
-    void put_node(KVStore_Node* node) {
-        if(nodes_[get_position(node->k_)] == nullptr) {
-            nodes_[get_position(node->k_)] = node;
-        } else {
-            nodes_[get_position(node->k_)]->pushBack(node);
+    Value* get_cached(Key* k) {
+        if(k->idx_ == idx_) {
+            Value* v = find_(k);
+            return v != nullptr ? v : waitAndGet(k);
         }
+        Value* v = cache_.get(k);
+        if(v != nullptr) return v;
+        v = waitAndGet(k);
+        if(v != nullptr) cache_.put(k, v);
+        return v;
     }
 
     /**
-     * @brief grows the array of nodes when the count reaches a certain threshold
+     * @brief starts getting the value linked to the given key, taking it from the node's cache if it's there.
+     * Unlike get_cached a value fetched from elsewhere isn't added to the cache, so one pass over
+     * a lot of data doesn't push out what's being reused.
      * 
+     * @param k - the key
+     * @return ValueFuture* - the eventual value, owned by the caller
      */
-    void grow() {
-        // do we need to grow?
-        if(((double)count()) / capacity_ <= GROWTH_THRESHOLD) return;
+    ValueFuture* get_cached_async(Key* k) {
+        if(k->idx_ != idx_) {
+            Value* v = cache_.get(k);
+            if(v != nullptr) {
+                ValueFuture* f = new ValueFuture();
+                f->fulfil(v);
+                return f;
+            }
+        }
+        return get_async(k);
+    }
 
-        // yes, grow the array
-        capacity_ *= GROWTH_FACTOR; 
-        KVStore_Node** old = nodes_;
-        nodes_ = new KVStore_Node*[capacity_];
-        for (size_t i = 0; i < capacity_; i++)
+    // looks up a clone of the value for the given local key
+    Value* find_(Key* k) {
+        KVShard* s = shard_(k);
+        s->lock_.lock_shared();
+        Value* v = s->table_.get(k);
+        if(v != nullptr) v = v->clone();
+        s->lock_.unlock_shared();
+        return v;
+    }
+
+    // looks up a clone of the value for the given local key, or parks a waiter for it if it's not there yet
+    Value* find_or_park_(Key* k, size_t requester, size_t id, ValueFuture* f, size_t timeout) {
+        Value* v = find_(k);
+        if(v != nullptr) return v;
+
+        // look again now that puts are shut out, then park
+        KVShard* s = shard_(k);
+        s->lock_.lock();
+        v = s->table_.get(k);
+        if(v != nullptr) v = v->clone();
+        else s->waiters_.add(new Waiter(k, requester, id, f, timeout));
+        s->lock_.unlock();
+        return v;
+    }
+
+    /**
+     * @brief waits until a KV pair with the given key exists and then returns the value
+     * 
+     * @param k - the key
+     * @return Value* - the linked value
+     */
+    Value* waitAndGet(Key* k) {
+        return waitAndGet(k, 0);
+    }
+
+    /**
+     * @brief waits until a KV pair with the given key exists and then returns the value
+     * 
+     * @param k - the key
+     * @param timeout - millis to wait for the key to be put, 0 means forever
+     * @return Value* - the linked value, nullptr if the timeout ran out
+     */
+    Value* waitAndGet(Key* k, size_t timeout) {
+        ValueFuture* f = get_async(k, timeout);
+        Value* v = f->get();
+        delete(f);
+        return v;
+    }
+
+    /**
+     * @brief starts getting the value for the given key without waiting for it.
+     * Any number of these may be in flight at once. If the key hasn't been put yet
+     * the node that owns it holds on to the request and answers once it is.
+     * 
+     * @param k - the key
+     * @param timeout - millis to wait for the key to be put, 0 means forever
+     * @return ValueFuture* - the eventual value (nullptr if the timeout ran out), owned by the caller
+     */
+    ValueFuture* get_async(Key* k, size_t timeout = 0) {
+        ValueFuture* f = new ValueFuture();
+        if(k->idx_ == idx_) {
+            Value* v = find_or_park_(k, idx_, 0, f, timeout);
+            if(v != nullptr) f->fulfil(v);
+            return f;
+        }
+        Get* g = new Get(k);
+        g->sender_ = idx_;
+        g->id_ = next_id_.next() + 1; // 0 means no request
+        g->timeout_ = timeout;
+        pending_.add(g->id_, f);
+        network_->send_message(g);
+        return f;
+    }
+
+    /**
+     * @brief starts getting the values for all the given keys without waiting for them.
+     * Keys homed on the same remote node are asked for in a single MultiGet.
+     * 
+     * @param keys - the keys
+     * @param n - how many keys there are
+     * @return ValueFuture** - the eventual value of each key, in order. The array and its elements are owned by the caller
+     */
+    ValueFuture** get_many(Key** keys, size_t n) {
+        ValueFuture** fs = new ValueFuture*[n];
+        bool* sent = new bool[n];
+        for (size_t i = 0; i < n; i++)
         {
-            nodes_[i] = nullptr;
+            sent[i] = keys[i]->idx_ == idx_;
+            fs[i] = sent[i] ? get_async(keys[i]) : new ValueFuture();
         }
+        for (size_t i = 0; i < n; i++)
+        {
+            if(sent[i]) continue;
+            // gather every key homed on the same node as this one
+            MultiGet* mg = new MultiGet(keys[i]->idx_);
+            size_t first = i;
+            for (size_t j = i; j < n; j++)
+            {
+                if(!sent[j] && keys[j]->idx_ == keys[first]->idx_) mg->add(keys[j]);
+            }
+            mg->sender_ = idx_;
+            mg->id_ = next_id_.reserve(mg->count()) + 1; // 0 means no request
+            size_t id = mg->id_;
+            for (size_t j = i; j < n; j++)
+            {
+                if(sent[j] || keys[j]->idx_ != keys[first]->idx_) continue;
+                pending_.add(id++, fs[j]);
+                sent[j] = true;
+            }
+            network_->send_message(mg);
+        }
+        delete[](sent);
+        return fs;
+    }
 
-        // reinsert each node to its new proper location
-        for (size_t i = 0; i < capacity_ / GROWTH_FACTOR; i++)
+    /**
+     * @brief starts aggregating chunks on the node that holds them, so only the result comes back.
+     * If some of them haven't been put yet the node holds on to the request until they are.
+     * 
+     * @param keys - the chunks' keys, all homed on the same node
+     * @param n - how many keys there are
+     * @param elem - the type of the values in the chunks: 'I', 'F' or 'B'
+     * @param timeout - millis to wait for missing chunks, 0 means forever
+     * @return ValueFuture* - the eventual serialized Aggregate (nullptr if the timeout ran out), owned by the caller
+     */
+    ValueFuture* reduce_async(Key** keys, size_t n, char elem, size_t timeout = 0) {
+        assert(n > 0);
+        ValueFuture* f = new ValueFuture();
+        Reduce* r = new Reduce(keys[0]->idx_, elem);
+        r->timeout_ = timeout;
+        for (size_t i = 0; i < n; i++)
         {
-            if(old[i] != nullptr) {
-                KVStore_Node* node = old[i]->pop();
-                while(node != nullptr) {
-                    put_node(node);
-                    node = old[i]->pop();
-                }
-                put_node(old[i]);
+            assert(keys[i]->idx_ == keys[0]->idx_);
+            r->add(keys[i]);
+        }
+        if(r->target_ == idx_) {
+            start_reduce_(r, f);
+            return f;
+        }
+        r->sender_ = idx_;
+        r->id_ = next_id_.next() + 1; // 0 means no request
+        pending_.add(r->id_, f);
+        network_->send_message(r);
+        return f;
+    }
+
+    /**
+     * @brief aggregates the local chunks under the request's keys, now if they're all here. Otherwise a
+     * waiter is parked on each missing one and the last of them to be answered finishes the reduction.
+     * 
+     * @param r - the request, consumed
+     * @param f - where the result goes, nullptr to answer r's sender
+     */
+    void start_reduce_(Reduce* r, ValueFuture* f) {
+        PendingReduce* pr = new PendingReduce(r, f);
+        for (size_t i = 0; i < r->count(); i++)
+        {
+            KVShard* s = shard_(r->key(i));
+            s->lock_.lock();
+            if(s->table_.get(r->key(i)) == nullptr) {
+                Waiter* w = new Waiter(r->key(i), r->sender_, r->id_, nullptr, r->timeout_);
+                w->reduce_ = pr;
+                pr->missing_++;
+                s->waiters_.add(w);
             }
+            s->lock_.unlock();
         }
-        delete[](old);
+        if(--pr->missing_ == 0) finish_reduce_(pr);
+    }
+
+    // answers a reduction whose chunks have all been put, or which ran out of time waiting, and deletes it
+    void finish_reduce_(PendingReduce* pr) {
+        Reduce* r = pr->r_;
+        Value* result = nullptr;
+        if(!pr->failed_) {
+            Aggregate a;
+            for (size_t i = 0; i < r->count(); i++)
+            {
+                Value* v = find_(r->key(i));
+                assert(v != nullptr);
+                Aggregate chunk = aggregate_chunk(r->elem_, SerialView(v->serialized()));
+                a.merge(chunk);
+                delete(v);
+            }
+            result = new Value(&a);
+        }
+        if(pr->f_ != nullptr) pr->f_->fulfil(result);
+        else {
+            Message* m;
+            if(result == nullptr) m = new Fail(r->key(0));
+            else m = new Status(r->sender_, result);
+            m->sender_ = idx_;
+            m->target_ = r->sender_;
+            m->id_ = r->id_;
+            network_->send_message(m);
+            delete(result);
+        }
+        delete(pr);
     }
 
     /**
-     * @brief gets the value linked to the given key
-     * Force wait and get if provided with external key (key in another node)
+     * @brief answers a Reduce from another node, now if its chunks are here or once they're put
      * 
-     * @param k - the key
-     * @return Value* - the linked value
+     * @param r - the request, consumed
      */
-    Value* get(Key* k) {
-        if(k->idx_ != idx_) return waitAndGet(k);
+    void serve_reduce(Reduce* r) {
+        start_reduce_(r, nullptr);
+    }
 
-        Value* v;
-        prod_.lock();
-        if(nodes_[get_position(k)] == nullptr) v = nullptr;
-        else v = nodes_[get_position(k)]->getValue(k);
-        if (v != nullptr) {
-            v = v->clone();
+    /**
+     * @brief answers a get from another node, now if the key is here or once it's put
+     * 
+     * @param g - the request
+     */
+    void serve(Get* g) {
+        Value* v = find_or_park_(g->k_, g->sender_, g->id_, nullptr, g->timeout_);
+        if(v != nullptr) {
+            Status* s = new Status(g->sender_, v);
+            s->sender_ = idx_;
+            s->id_ = g->id_;
+            network_->send_message(s);
+            delete(v);
         }
-        prod_.unlock();
+    }
 
-        return v;
+    /**
+     * @brief answers a MultiGet from another node. The keys that are here go back together,
+     * the rest are answered one at a time as they're put.
+     * 
+     * @param mg - the request
+     */
+    void serve_many(MultiGet* mg) {
+        MultiStatus* ms = new MultiStatus(mg->sender_);
+        ms->sender_ = idx_;
+        for (size_t i = 0; i < mg->count(); i++)
+        {
+            Value* v = find_or_park_(mg->key(i), mg->sender_, mg->id_ + i, nullptr, 0);
+            if(v != nullptr) ms->add(mg->id_ + i, v);
+        }
+        if(ms->count() > 0) network_->send_message(ms);
+        else delete(ms);
     }
 
     /**
-     * @brief waits until a KV pair with the given key exists and then returns the value
+     * @brief answers the given waiters and deletes them
      * 
-     * @param k - the key
-     * @return Value* - the linked value
+     * @param w - the waiters linked through next_
+     * @param v - the value they were waiting for, nullptr if they ran out of time
      */
-    Value* waitAndGet(Key* k) {
-        Value* v;
-        if(k->idx_ == idx_) {
-            v = get(k);
-            while(v == nullptr) { cons_.unlock(); cons_.wait(); v = get(k); } // TODO: pick actual sleeping time
-            cons_.unlock();
-        }
-        else { // send a request on the network
-            Get* g = new Get(k);
-            g->sender_ = idx_;
-            network_->send_message(g);
-            Status* s = listener_.await_status();
-            v = s->v_->clone();
-            delete(s);
+    void answer_(Waiter* w, Value* v) {
+        while(w != nullptr) {
+            Waiter* next = w->next_;
+            if(w->reduce_ != nullptr) {
+                PendingReduce* pr = w->reduce_;
+                if(v == nullptr) pr->failed_ = true;
+                if(--pr->missing_ == 0) finish_reduce_(pr);
+            }
+            else if(w->f_ != nullptr) w->f_->fulfil(v == nullptr ? nullptr : v->clone());
+            else {
+                Message* m;
+                if(v == nullptr) m = new Fail(w->k_);
+                else m = new Status(w->requester_, v);
+                m->sender_ = idx_;
+                m->target_ = w->requester_;
+                m->id_ = w->id_;
+                network_->send_message(m);
+            }
+            delete(w);
+            w = next;
+        }
+    }
+
+    /**
+     * @brief gives up on the gets that have waited past their timeout
+     */
+    void expire_waiters() {
+        for (size_t i = 0; i < KV_SHARDS; i++)
+        {
+            KVShard* s = shards_[i];
+            if(s->waiters_.count_ == 0) continue;
+            s->lock_.lock();
+            Waiter* w = s->waiters_.take_expired(Thread::now());
+            s->lock_.unlock();
+            answer_(w, nullptr);
         }
-        return v;
     }
 
     /**
@@ -370,17 +977,29 @@ public:
             network_->send_message(p);
         }
         else {
-            prod_.lock();
-            grow();
-            size_t pos = get_position(k);
-            if(nodes_[pos] == nullptr) nodes_[pos] = new KVStore_Node(k, v);
-            else nodes_[pos]->set(k, v);
-            prod_.unlock();
-            cons_.notify_all();
+            KVShard* s = shard_(k);
+            s->lock_.lock();
+            s->table_.set(k, v);
+            Waiter* w = s->waiters_.take(k);
+            s->lock_.unlock();
+            answer_(w, v);
         }
         return this;
     }
 
+    /**
+     * @brief applies every put in the given batch, in order
+     * 
+     * @param mp - the batch, all for keys on this node
+     */
+    void put_many(MultiPut* mp) {
+        for (size_t i = 0; i < mp->count(); i++)
+        {
+            assert(mp->key(i)->idx_ == idx_);
+            put(mp->key(i), mp->value(i));
+        }
+    }
+
     /**
      * @brief removes the kv pair with the given key
      * should only be used locally
@@ -389,69 +1008,181 @@ public:
      */
     void remove(Key* k) {
         assert(k->idx_ == idx_);
-        size_t pos = get_position(k);
-        if(nodes_[pos] == nullptr) return;
-        if(nodes_[pos]->k_->equals(k)) {
-            KVStore_Node* node = nodes_[pos];
-            nodes_[pos] = node->next_;
-            delete(node);
+        KVShard* s = shard_(k);
+        s->lock_.lock();
+        s->table_.remove(k);
+        s->lock_.unlock();
+    }
+};
+
+#define MULTI_PUT_BYTES (1 << 22) // a batch is shipped once its values are this big
+
+/**
+ * @brief Collects puts so the ones headed for the same node travel in one MultiPut.
+ * Puts for keys on this node go straight into the store. Anything still held is sent by flush()
+ * (or on destruction), which must happen before anyone is expected to see those keys.
+ */
+class PutBatch : public Object {
+public:
+    KVStore* store_; // external
+    MultiPut** batches_; // owned, elements owned - one per node, nullptr if nothing is waiting
+    size_t num_nodes_;
+
+    PutBatch(KVStore* store, size_t num_nodes) {
+        store_ = store;
+        num_nodes_ = num_nodes;
+        batches_ = new MultiPut*[num_nodes_];
+        for (size_t i = 0; i < num_nodes_; i++) batches_[i] = nullptr;
+    }
+
+    ~PutBatch() {
+        flush();
+        delete[](batches_);
+    }
+
+    /**
+     * @brief puts the given kv pair, possibly later
+     * 
+     * @param k - the key
+     * @param v - the value
+     */
+    void put(Key* k, Value* v) {
+        if(k->idx_ == store_->idx_) {
+            store_->put(k, v);
+            return;
         }
-        else {
-            nodes_[pos]->remove(k);
+        assert(k->idx_ < num_nodes_);
+        if(batches_[k->idx_] == nullptr) {
+            batches_[k->idx_] = new MultiPut(k->idx_);
+            batches_[k->idx_]->sender_ = store_->idx_;
         }
+        batches_[k->idx_]->add(k, v->clone());
+        if(batches_[k->idx_]->bytes_ >= MULTI_PUT_BYTES) flush(k->idx_);
+    }
+
+    /** sends whatever is being held for the given node */
+    void flush(size_t node) {
+        if(batches_[node] == nullptr) return;
+        store_->network_->send_message(batches_[node]);
+        batches_[node] = nullptr;
+    }
+
+    /** sends everything being held */
+    void flush() {
+        for (size_t i = 0; i < num_nodes_; i++) flush(i);
     }
 };
 
 void NetworkListener::handleGet(Get* g)  {
-    Value* v = store_->get(g->k_);
-    Message* m;
-    if(v == nullptr) m = new Fail(g->k_);
-    else m = new Status(g->sender_, v);
-    m->sender_ = store_->idx_;
-    m->target_ = g->sender_;
-    store_->network_->send_message(m);
+    store_->serve(g);
     delete(g);
 }
 
+void NetworkListener::handleMultiGet(MultiGet* mg) {
+    store_->serve_many(mg);
+    delete(mg);
+}
+
+void NetworkListener::handleReduce(Reduce* r) {
+    store_->serve_reduce(r);
+}
+
+void NetworkListener::handleFail(Fail* f) {
+    // the owner gave up waiting for the key
+    ValueFuture* future = store_->pending_.take(f->id_);
+    if(future != nullptr) future->fulfil(nullptr);
+    delete(f);
+}
+
+void NetworkListener::handleStatus(Status* s) {
+    ValueFuture* f = store_->pending_.take(s->id_);
+    if(f != nullptr) {
+        f->fulfil(s->v_);
+        s->v_ = nullptr;
+    }
+    delete(s);
+}
+
+void NetworkListener::handleMultiStatus(MultiStatus* ms) {
+    for (size_t i = 0; i < ms->count(); i++)
+    {
+        ValueFuture* f = store_->pending_.take(ms->ids_[i]);
+        if(f == nullptr) continue;
+        f->fulfil(ms->values_[i]);
+        ms->values_[i] = nullptr;
+    }
+    delete(ms);
+}
+
+void DispatchWorker::run() {
+    while(listener_->running_) {
+        Message* m = listener_->work_.pop(RECEIVE_TIMEOUT);
+        if(m == nullptr) continue;
+        switch(m->type_) {
+            case MsgType::Get:
+                listener_->handleGet(dynamic_cast<Get *>(m));
+                break;
+            case MsgType::MultiGet:
+                listener_->handleMultiGet(dynamic_cast<MultiGet *>(m));
+                break;
+            case MsgType::Reduce:
+                listener_->handleReduce(dynamic_cast<Reduce *>(m));
+                break;
+            default:
+                assert(false);
+                break;
+        }
+    }
+}
+
 void NetworkListener::run() {
     if(dynamic_cast<PseudoNetwork *>(store_->network_) != nullptr) store_->network_->register_node(store_->idx_);
-    while(store_ != nullptr) { // go forever
-        Message* send;
+    for (size_t i = 0; i < DISPATCH_WORKERS; i++)
+    {
+        workers_[i]->start();
+    }
+    while(running_) { // go until stopped
         Message* m = store_->network_->receive_message();
-        Get* g = dynamic_cast<Get *>(m);
+        store_->expire_waiters();
         Put* p = dynamic_cast<Put *>(m);
-        Fail* f = dynamic_cast<Fail *>(m);
         if(m == nullptr) continue;
         switch(m->type_) {
             case MsgType::Register:
+                delete(m);
                 break; // ignore
             case MsgType::Get:
-                handleGet(g);
+            case MsgType::MultiGet:
+            case MsgType::Reduce:
+                work_.push(m); // may be slow, let a worker take it
+                break;
+            case MsgType::Fail:
+                handleFail(dynamic_cast<Fail *>(m));
                 break;
             case MsgType::Put:
+                // applied in order of arrival, so a later Get from the same node sees it
                 store_->put(p->k_, p->v_);
                 delete(p);
                 break;
+            case MsgType::MultiPut:
+                store_->put_many(dynamic_cast<MultiPut *>(m));
+                delete(m);
+                break;
             case MsgType::Status:
-                if(s_ != nullptr) { cons_.notify_all(); prod_.wait(); }// Wait until s_ consumed
-                s_ = dynamic_cast<Status *>(m);
-                prod_.unlock();
-                cons_.notify_all(); // s_ available
+                handleStatus(dynamic_cast<Status *>(m));
+                break;
+            case MsgType::MultiStatus:
+                handleMultiStatus(dynamic_cast<MultiStatus *>(m));
                 break;
             case MsgType::Directory:
+                delete(m);
                 break; // ignore
-            case MsgType::Fail:
-                // wait, and then resend the get
-                fail_count_ += 1;
-                sleep(fail_count_ * 1000);
-                send = new Get(f->k_);
-                send->sender_ = store_->idx_;
-                store_->network_->send_message(send);
-                delete(f);
-                break;
             default:
                 assert(false);
                 break;
         }
     }
+    for (size_t i = 0; i < DISPATCH_WORKERS; i++)
+    {
+        workers_[i]->join();
+    }
 }
\ No newline at end of file
@@ -5,63 +5,72 @@
 #include <netinet/in.h>
 #include <arpa/inet.h>
 
+#include "../utils/array.h"
 #include "../utils/serial.h"
 #include "../utils/string.h"
 #include "../utils/thread.h"
 #include "key.h"
 #include "value.h"
 
-enum class MsgType { Register = 0, Get, Put, Status, Directory, Fail };
+enum class MsgType { Register = 0, Get, Put, Status, Directory, Fail, MultiGet, MultiPut, MultiStatus, Reduce };
 
 class Message : public SerializableObject {
 public:
     MsgType type_;
     size_t target_;
     size_t sender_; // set by network on send
+    size_t id_; // correlates a reply with its request, 0 if the message isn't part of one
 
     Message(Message& m) {
         type_ = m.type_;
         target_ = m.target_;
         sender_ = m.sender_;
+        id_ = m.id_;
     }
 
     Message(MsgType type, size_t target) {
         type_ = type;
         target_ = target;
+        id_ = 0;
     }
 
     Message(size_t type, size_t target) : Message(static_cast<MsgType>(type), target) { }
 
     SerialString* serialize() {
-        char* arr = new char[3 * sizeof(size_t)];
-        size_t type = static_cast<size_t>(type_);
-        memcpy(arr, &type, sizeof(size_t));
-        memcpy(arr + sizeof(size_t), &target_, sizeof(size_t));
-        memcpy(arr + (2 *sizeof(size_t)), &sender_, sizeof(size_t));
+        Serializer s;
+        serialize_into(s);
+        return s.to_serial();
+    }
 
-        SerialString* ss = new SerialString(arr, 3 * sizeof(size_t));
-        delete[](arr);
-        return ss;
+    // the header: type, target, sender and id
+    void serialize_into(Serializer& s) {
+        s.write_size(static_cast<size_t>(type_));
+        s.write_size(target_);
+        s.write_size(sender_);
+        s.write_size(id_);
     }
 
     static Message* deserialize_(SerialString* serial) {
-        size_t type;
-        size_t target;
-        size_t sender;
+        Deserializer d(serial);
+        return deserialize_(d);
+    }
 
-        memcpy(&type, serial->data_, sizeof(size_t));
-        memcpy(&target, serial->data_ + sizeof(size_t), sizeof(size_t));
-        memcpy(&sender, serial->data_ + (2 * sizeof(size_t)), sizeof(size_t));
+    static Message* deserialize_(Deserializer& d) {
+        size_t type = d.read_size();
+        size_t target = d.read_size();
+        size_t sender = d.read_size();
+        size_t id = d.read_size();
 
         Message* m = new Message(type, target);
         m->sender_ = sender;
+        m->id_ = id;
         return m;
     }
 
     bool equals(Object* other) {
         Message* cast = dynamic_cast<Message *>(other);
         if(cast == nullptr) return false;
-        return (type_ == cast->type_ && target_ == cast->target_ && sender_ == cast->sender_);
+        return (type_ == cast->type_ && target_ == cast->target_ && sender_ == cast->sender_ && id_ == cast->id_);
     }
 
     Object* clone() {
@@ -87,36 +96,21 @@ public:
         port = p;
     } 
 
-    SerialString* serialize() {
-        SerialString* m_ss = Message::serialize();
-        char* arr = new char[m_ss->size_ + sizeof(sockaddr_in) + sizeof(size_t)];
-        size_t pos = 0;
-
-        memcpy(arr + pos, m_ss->data_, m_ss->size_);
-        pos += m_ss->size_;
-        delete(m_ss);
-
-        memcpy(arr + pos, &client, sizeof(sockaddr_in));
-        pos += sizeof(sockaddr_in);
-
-        memcpy(arr + pos, &port, sizeof(size_t));
-        pos += sizeof(size_t);
-
-        SerialString* ss = new SerialString(arr, pos);
-        delete[](arr);
-        return ss;
+    void serialize_into(Serializer& s) {
+        Message::serialize_into(s);
+        s.write(&client, sizeof(sockaddr_in));
+        s.write_size(port);
     }
 
     static Register* deserialize(SerialString* string) {
-        Message* m = Message::deserialize_(string);
-
-        SerialString* substr = new SerialString(string->data_ + (3 * sizeof(size_t)), string->size_ - (3 * sizeof(size_t)));
-        sockaddr_in c;
-        size_t p;
+        Deserializer d(string);
+        return deserialize(d);
+    }
 
-        memcpy(&c, substr->data_, sizeof(sockaddr_in));
-        memcpy(&p, substr->data_ + sizeof(sockaddr_in), sizeof(size_t));
-        delete(substr);
+    static Register* deserialize(Deserializer& d) {
+        Message* m = Message::deserialize_(d);
+        sockaddr_in c = d.read<sockaddr_in>();
+        size_t p = d.read_size();
 
         Register* r = new Register(*m, c, p);
         delete(m);
@@ -140,43 +134,38 @@ public:
 class Get : public Message {
 public:
     Key* k_; // owned
+    size_t timeout_; // millis the owner may hold the request before answering Fail, 0 means forever
 
     Get(Message& m, Key& k) : Message(m) {
         k_ = dynamic_cast<Key *>(k.clone());
+        timeout_ = 0;
     }
 
     Get(Key* k) : Message(MsgType::Get, k->idx_) {
         k_ = dynamic_cast<Key *>(k->clone());
+        timeout_ = 0;
     }
 
     ~Get() { delete(k_); }
 
-    virtual SerialString* serialize() {
-        SerialString* m_ss = Message::serialize();
-        SerialString* k_ss = k_->serialize();
-
-        size_t size = m_ss->size_ + k_ss->size_;
-        char* arr = new char[size];
-        memcpy(arr, m_ss->data_, m_ss->size_);
-        memcpy(arr + m_ss->size_, k_ss->data_, k_ss->size_);
-
-        delete(m_ss);
-        delete(k_ss);
-
-        SerialString* ss = new SerialString(arr, size);
-        delete[](arr);
-
-        return ss;
+    // the header, the key, then the timeout
+    void serialize_into(Serializer& s) {
+        Message::serialize_into(s);
+        k_->serialize_into(s);
+        s.write_size(timeout_);
     }
 
     static Get* deserialize(SerialString* string) {
-        Message* m = Message::deserialize_(string);
+        Deserializer d(string);
+        return deserialize(d);
+    }
 
-        SerialString* key_substr = new SerialString(string->data_ + (3 * sizeof(size_t)), string->size_ - (3 * sizeof(size_t)));
-        Key* k = Key::deserialize(key_substr);
-        delete(key_substr);
+    static Get* deserialize(Deserializer& d) {
+        Message* m = Message::deserialize_(d);
+        Key* k = Key::deserialize(d);
 
         Get* g = new Get(*m, *k);
+        g->timeout_ = d.read_size();
 
         delete(m);
         delete(k);
@@ -187,11 +176,13 @@ public:
         if(!Message::equals(other)) return false;
         Get* cast = dynamic_cast<Get *>(other);
         if(cast == nullptr) return false;
-        return k_->equals(cast->k_);
+        return k_->equals(cast->k_) && timeout_ == cast->timeout_;
     }
 
     Object* clone() {
-        return new Get(*this, *k_);
+        Get* g = new Get(*this, *k_);
+        g->timeout_ = timeout_;
+        return g;
     }
 };
 
@@ -203,11 +194,18 @@ public:
     }
 
     static Fail* deserialize(SerialString* string) {
-        Get* g = Get::deserialize(string);
+        Deserializer d(string);
+        return deserialize(d);
+    }
+
+    static Fail* deserialize(Deserializer& d) {
+        Get* g = Get::deserialize(d);
         Fail* f = new Fail(g->k_);
         f->target_ = g->target_;
         f->sender_ = g->sender_;
+        f->id_ = g->id_;
         f->type_ = MsgType::Fail;
+        delete(g);
         return f;
     }
 
@@ -215,6 +213,7 @@ public:
         Fail* f = new Fail(k_);
         f->target_ = target_;
         f->sender_ = sender_;
+        f->id_ = id_;
         return f;
     }
 };
@@ -233,39 +232,30 @@ public:
         type_ = MsgType::Put;
     }
 
-    ~Put() { delete(v_); }
-
-    SerialString* serialize() {
-        SerialString* g_ss = Get::serialize();
-        SerialString* v_ss = v_->serialized()->clone();
-
-        size_t size = g_ss->size_ + v_ss->size_;
-        char* arr = new char[size];
-        memcpy(arr, g_ss->data_, g_ss->size_);
-        memcpy(arr + g_ss->size_, v_ss->data_, v_ss->size_);
+    // takes ownership of v
+    Put(Message& m, Key& k, Value* v) : Get(m, k) {
+        v_ = v;
+        type_ = MsgType::Put;
+    }
 
-        delete(g_ss);
-        delete(v_ss);
-        
-        SerialString* ss = new SerialString(arr, size);
-        delete[](arr);
+    ~Put() { delete(v_); }
 
-        return ss;
+    // the Get, then the value's bytes which run to the end
+    void serialize_into(Serializer& s) {
+        Get::serialize_into(s);
+        SerialString* v_ss = v_->serialized();
+        s.borrow(v_ss->data_, v_ss->size_);
     }
 
     static Put* deserialize(SerialString* string) {
-        Get* g = Get::deserialize(string);
-        SerialString* g_ss = g->serialize();
-
-        SerialString* val_substr = new SerialString(string->data_ + g_ss->size_, string->size_ - g_ss->size_);
-        Value* v = new Value(val_substr);
-        delete(val_substr);
-        delete(g_ss);
-
-        Put* p = new Put(*g, *g->k_, *v);
+        Deserializer d(string);
+        return deserialize(d);
+    }
 
+    static Put* deserialize(Deserializer& d) {
+        Get* g = Get::deserialize(d);
+        Put* p = new Put(*g, *g->k_, new Value(d.rest()));
         delete(g);
-        delete(v);
         return p;
     }
 
@@ -293,39 +283,31 @@ public:
         v_ = v->clone();
     }
 
+    // takes ownership of v
+    Status(Message& m, Value* v) : Message(m) {
+        v_ = v;
+    }
+
     ~Status() {
         delete(v_);
     }
 
-    SerialString* serialize() {
-        SerialString* m_ss = Message::serialize();
-        SerialString* v_ss = v_->serialized()->clone();
-
-        size_t size = m_ss->size_ + v_ss->size_;
-        char* arr = new char[size];
-        memcpy(arr, m_ss->data_, m_ss->size_);
-        memcpy(arr + m_ss->size_, v_ss->data_, v_ss->size_);
-
-        delete(m_ss);
-        delete(v_ss);
-
-        SerialString* ss = new SerialString(arr, size);
-        delete[](arr);
-
-        return ss;
+    // the header, then the value's bytes which run to the end
+    void serialize_into(Serializer& s) {
+        Message::serialize_into(s);
+        SerialString* v_ss = v_->serialized();
+        s.borrow(v_ss->data_, v_ss->size_);
     }
 
     static Status* deserialize(SerialString* string) {
-        Message* m = Message::deserialize_(string);
-
-        SerialString* val_substr = new SerialString(string->data_ + (3 * sizeof(size_t)), string->size_ - (3 * sizeof(size_t)));
-        Value* v = new Value(val_substr);
-        delete(val_substr);
+        Deserializer d(string);
+        return deserialize(d);
+    }
 
-        Status* s = new Status(*m, *v);
-        
+    static Status* deserialize(Deserializer& d) {
+        Message* m = Message::deserialize_(d);
+        Status* s = new Status(*m, new Value(d.rest()));
         delete(m);
-        delete(v);
         return s;
     }
 
@@ -360,88 +342,44 @@ public:
         addresses_ = addresses;
     }
 
-    SerialString* serialize() {
-        SerialString* m_ss = Message::serialize();
-
-        // serialize addresses
-        SerialString** addresses_ss = new SerialString*[num_nodes_];
-        size_t addresses_size = 0;
-        for (size_t i = 0; i < num_nodes_; i++)
-        {
-            size_t s = addresses_[i]->size();
-            char* str = new char[sizeof(size_t) + s];
-            memcpy(str, &s, sizeof(size_t));
-            memcpy(str + sizeof(size_t), addresses_[i]->c_str(), s);
-
-            addresses_ss[i] = new SerialString(str, s + sizeof(size_t));
-            delete[](str);
-            addresses_size += addresses_ss[i]->size_;
-        }
-        
-
-        size_t size = m_ss->size_ + sizeof(size_t) + (num_nodes_ * sizeof(size_t)) + addresses_size;
-        char* arr = new char[size];
-
-        size_t pos = 0;
-        memcpy(arr, m_ss->data_, m_ss->size_);
-        pos += m_ss->size_;
-        delete(m_ss);
-
-        memcpy(arr + pos, &num_nodes_, sizeof(size_t));
-        pos += sizeof(size_t);
-
-        memcpy(arr + pos, ports_, num_nodes_ * sizeof(size_t));
-        pos += num_nodes_ * sizeof(size_t);
-
+    // the header, the number of nodes, their ports, then each address's length and characters
+    void serialize_into(Serializer& s) {
+        Message::serialize_into(s);
+        s.write_size(num_nodes_);
+        s.write(ports_, num_nodes_ * sizeof(size_t));
         for (size_t i = 0; i < num_nodes_; i++)
         {
-            SerialString* a_ss = addresses_ss[i];
-            memcpy(arr + pos, a_ss->data_, a_ss->size_);
-            pos += a_ss->size_;
-            delete(a_ss);
+            s.write_size(addresses_[i]->size());
+            s.write(addresses_[i]->c_str(), addresses_[i]->size());
         }
-        delete[](addresses_ss);
-
-        SerialString* ss = new SerialString(arr, pos);
-        delete[](arr);
-        
-        return ss;
     }
 
     static Directory* deserialize(SerialString* string) {
-        Message* m = Message::deserialize_(string);
-        size_t nodes;
+        Deserializer d(string);
+        return deserialize(d);
+    }
 
-        size_t pos = 3 * sizeof(size_t);
-        memcpy(&nodes, string->data_ + pos, sizeof(size_t));
-        pos += sizeof(size_t);
+    static Directory* deserialize(Deserializer& d) {
+        Message* m = Message::deserialize_(d);
+        size_t nodes = d.read_size();
 
         size_t* ports = new size_t[nodes];
         String** addresses = new String*[nodes];
 
-        memcpy(ports, string->data_ + pos, nodes * sizeof(size_t));
-        pos += nodes * sizeof(size_t);
+        SerialView ports_view = d.read_bytes(nodes * sizeof(size_t));
+        memcpy(ports, ports_view.data_, ports_view.size_);
 
         for (size_t i = 0; i < nodes; i++)
         {
-            size_t sz;
-            memcpy(&sz, string->data_ + pos, sizeof(size_t));
-            pos += sizeof(size_t);
-
-            char* arr = new char[sz + 1];
-            arr[sz] = '\0';
-
-            memcpy(arr, string->data_ + pos, sz);
-            pos += sz;
-
-            addresses[i] = new String(arr);
-            delete[](arr);
+            size_t sz = d.read_size();
+            SerialView chars = d.read_bytes(sz);
+            addresses[i] = new String(chars.data_, sz);
         }
         
-        Directory* d = new Directory(*m, nodes, ports, addresses);
+        Directory* d_msg = new Directory(*m, nodes, ports, addresses);
 
         delete(m);
-        return d;
+        return d_msg;
     }
 
     bool equals(Object* other) {
@@ -469,24 +407,393 @@ public:
     }
 };
 
-static Message* msg_deserialize(SerialString* serial) {
-    size_t type;
-    memcpy(&type, serial->data_, sizeof(size_t));
-    switch(static_cast<MsgType>(type)) {
+/**
+ * @brief A Get for several keys homed on the same node.
+ * The i-th key is answered under request id id_ + i, either all together in a MultiStatus
+ * or, for keys that haven't been put yet, one Status at a time as they arrive.
+ */
+class MultiGet : public Message {
+public:
+    Array* keys_; // owned, elements owned
+
+    MultiGet(Message& m) : Message(m) {
+        keys_ = new Array();
+    }
+
+    MultiGet(size_t target) : Message(MsgType::MultiGet, target) {
+        keys_ = new Array();
+    }
+
+    ~MultiGet() {
+        for (size_t i = 0; i < keys_->count(); i++) delete(keys_->get(i));
+        delete(keys_);
+    }
+
+    size_t count() { return keys_->count(); }
+
+    Key* key(size_t i) { return dynamic_cast<Key *>(keys_->get(i)); }
+
+    /** adds a clone of the given key to this request */
+    void add(Key* k) { keys_->append(k); }
+
+    // the header, the number of keys, then the keys
+    void serialize_into(Serializer& s) {
+        Message::serialize_into(s);
+        s.write_size(count());
+        for (size_t i = 0; i < count(); i++) key(i)->serialize_into(s);
+    }
+
+    static MultiGet* deserialize(SerialString* string) {
+        Deserializer d(string);
+        return deserialize(d);
+    }
+
+    static MultiGet* deserialize(Deserializer& d) {
+        Message* m = Message::deserialize_(d);
+        MultiGet* mg = new MultiGet(*m);
+        delete(m);
+
+        size_t n = d.read_size();
+        for (size_t i = 0; i < n; i++)
+        {
+            Key* k = Key::deserialize(d);
+            mg->add(k);
+            delete(k);
+        }
+        return mg;
+    }
+
+    bool equals(Object* other) {
+        if(!Message::equals(other)) return false;
+        MultiGet* cast = dynamic_cast<MultiGet *>(other);
+        if(cast == nullptr) return false;
+        return keys_->equals(cast->keys_);
+    }
+
+    Object* clone() {
+        MultiGet* mg = new MultiGet(target_);
+        mg->sender_ = sender_;
+        mg->id_ = id_;
+        for (size_t i = 0; i < count(); i++) mg->add(key(i));
+        return mg;
+    }
+};
+
+/**
+ * @brief Asks a node to aggregate the chunks it holds under the given keys and send back just
+ * the result (as a Status), rather than sending back the chunks.
+ */
+class Reduce : public MultiGet {
+public:
+    char elem_; // the type of the values in the chunks: 'I', 'F' or 'B'
+    size_t timeout_; // millis the owner may wait for missing chunks before answering Fail, 0 means forever
+
+    Reduce(Message& m, char elem) : MultiGet(m) {
+        elem_ = elem;
+        timeout_ = 0;
+    }
+
+    Reduce(size_t target, char elem) : MultiGet(target) {
+        type_ = MsgType::Reduce;
+        elem_ = elem;
+        timeout_ = 0;
+    }
+
+    // the MultiGet, then the type of the values and the timeout
+    void serialize_into(Serializer& s) {
+        MultiGet::serialize_into(s);
+        s.write(&elem_, 1);
+        s.write_size(timeout_);
+    }
+
+    static Reduce* deserialize(SerialString* string) {
+        Deserializer d(string);
+        return deserialize(d);
+    }
+
+    static Reduce* deserialize(Deserializer& d) {
+        MultiGet* mg = MultiGet::deserialize(d);
+        Reduce* r = new Reduce(*mg, d.read<char>());
+        r->timeout_ = d.read_size();
+        for (size_t i = 0; i < mg->count(); i++) r->add(mg->key(i));
+        delete(mg);
+        return r;
+    }
+
+    bool equals(Object* other) {
+        if(!MultiGet::equals(other)) return false;
+        Reduce* cast = dynamic_cast<Reduce *>(other);
+        if(cast == nullptr) return false;
+        return elem_ == cast->elem_ && timeout_ == cast->timeout_;
+    }
+
+    Object* clone() {
+        Reduce* r = new Reduce(target_, elem_);
+        r->sender_ = sender_;
+        r->id_ = id_;
+        r->timeout_ = timeout_;
+        for (size_t i = 0; i < count(); i++) r->add(key(i));
+        return r;
+    }
+};
+
+/**
+ * @brief Several puts bound for the same node, applied there in order.
+ * Values are added one at a time, so a sender can keep appending until the batch is big enough to ship.
+ */
+class MultiPut : public Message {
+public:
+    Array* keys_; // owned, elements owned
+    Value** values_; // owned, elements owned
+    size_t capacity_;
+    size_t bytes_; // serialized size of the values so far
+
+    MultiPut(Message& m) : Message(m) {
+        init_();
+    }
+
+    MultiPut(size_t target) : Message(MsgType::MultiPut, target) {
+        init_();
+    }
+
+    void init_() {
+        keys_ = new Array();
+        capacity_ = 4;
+        values_ = new Value*[capacity_];
+        bytes_ = 0;
+    }
+
+    ~MultiPut() {
+        for (size_t i = 0; i < count(); i++)
+        {
+            delete(keys_->get(i));
+            delete(values_[i]);
+        }
+        delete(keys_);
+        delete[](values_);
+    }
+
+    size_t count() { return keys_->count(); }
+
+    Key* key(size_t i) { return dynamic_cast<Key *>(keys_->get(i)); }
+
+    Value* value(size_t i) { return values_[i]; }
+
+    /**
+     * @brief adds a put to this batch
+     * 
+     * @param k - the key, copied
+     * @param v - the value, consumed
+     */
+    void add(Key* k, Value* v) {
+        if(count() == capacity_) {
+            capacity_ *= 2;
+            Value** values = new Value*[capacity_];
+            memcpy(values, values_, count() * sizeof(Value*));
+            delete[](values_);
+            values_ = values;
+        }
+        values_[count()] = v;
+        keys_->append(k);
+        bytes_ += v->serialized()->size_;
+    }
+
+    // the header, the number of puts, then each key followed by its value's length and bytes
+    void serialize_into(Serializer& s) {
+        Message::serialize_into(s);
+        s.write_size(count());
+        for (size_t i = 0; i < count(); i++)
+        {
+            key(i)->serialize_into(s);
+            SerialString* v_ss = values_[i]->serialized();
+            s.write_size(v_ss->size_);
+            s.borrow(v_ss->data_, v_ss->size_);
+        }
+    }
+
+    static MultiPut* deserialize(SerialString* string) {
+        Deserializer d(string);
+        return deserialize(d);
+    }
+
+    static MultiPut* deserialize(Deserializer& d) {
+        Message* m = Message::deserialize_(d);
+        MultiPut* mp = new MultiPut(*m);
+        delete(m);
+
+        size_t n = d.read_size();
+        for (size_t i = 0; i < n; i++)
+        {
+            Key* k = Key::deserialize(d);
+            size_t v_size = d.read_size();
+            mp->add(k, new Value(d.read_bytes(v_size)));
+            delete(k);
+        }
+        return mp;
+    }
+
+    bool equals(Object* other) {
+        if(!Message::equals(other)) return false;
+        MultiPut* cast = dynamic_cast<MultiPut *>(other);
+        if(cast == nullptr) return false;
+        if(!keys_->equals(cast->keys_)) return false;
+        for (size_t i = 0; i < count(); i++)
+        {
+            if(!values_[i]->equals(cast->values_[i])) return false;
+        }
+        return true;
+    }
+
+    Object* clone() {
+        MultiPut* mp = new MultiPut(target_);
+        mp->sender_ = sender_;
+        mp->id_ = id_;
+        for (size_t i = 0; i < count(); i++) mp->add(key(i), values_[i]->clone());
+        return mp;
+    }
+};
+
+/**
+ * @brief The answers to several requests sent back to the same node, each tagged with its request id.
+ */
+class MultiStatus : public Message {
+public:
+    size_t* ids_; // owned
+    Value** values_; // owned, elements owned
+    size_t count_;
+    size_t capacity_;
+
+    MultiStatus(Message& m) : Message(m) {
+        init_();
+    }
+
+    MultiStatus(size_t target) : Message(MsgType::MultiStatus, target) {
+        init_();
+    }
+
+    void init_() {
+        count_ = 0;
+        capacity_ = 4;
+        ids_ = new size_t[capacity_];
+        values_ = new Value*[capacity_];
+    }
+
+    ~MultiStatus() {
+        for (size_t i = 0; i < count_; i++)
+        {
+            if(values_[i] != nullptr) delete(values_[i]);
+        }
+        delete[](ids_);
+        delete[](values_);
+    }
+
+    size_t count() { return count_; }
+
+    /**
+     * @brief adds an answer
+     * 
+     * @param id - the request id it answers
+     * @param v - the value, consumed
+     */
+    void add(size_t id, Value* v) {
+        if(count_ == capacity_) {
+            capacity_ *= 2;
+            size_t* ids = new size_t[capacity_];
+            Value** values = new Value*[capacity_];
+            memcpy(ids, ids_, count_ * sizeof(size_t));
+            memcpy(values, values_, count_ * sizeof(Value*));
+            delete[](ids_);
+            delete[](values_);
+            ids_ = ids;
+            values_ = values;
+        }
+        ids_[count_] = id;
+        values_[count_] = v;
+        count_++;
+    }
+
+    // the header, the number of answers, then each id followed by its value's length and bytes
+    void serialize_into(Serializer& s) {
+        Message::serialize_into(s);
+        s.write_size(count_);
+        for (size_t i = 0; i < count_; i++)
+        {
+            SerialString* v_ss = values_[i]->serialized();
+            s.write_size(ids_[i]);
+            s.write_size(v_ss->size_);
+            s.borrow(v_ss->data_, v_ss->size_);
+        }
+    }
+
+    static MultiStatus* deserialize(SerialString* string) {
+        Deserializer d(string);
+        return deserialize(d);
+    }
+
+    static MultiStatus* deserialize(Deserializer& d) {
+        Message* m = Message::deserialize_(d);
+        MultiStatus* ms = new MultiStatus(*m);
+        delete(m);
+
+        size_t n = d.read_size();
+        for (size_t i = 0; i < n; i++)
+        {
+            size_t id = d.read_size();
+            size_t v_size = d.read_size();
+            ms->add(id, new Value(d.read_bytes(v_size)));
+        }
+        return ms;
+    }
+
+    bool equals(Object* other) {
+        if(!Message::equals(other)) return false;
+        MultiStatus* cast = dynamic_cast<MultiStatus *>(other);
+        if(cast == nullptr || count_ != cast->count_) return false;
+        for (size_t i = 0; i < count_; i++)
+        {
+            if(ids_[i] != cast->ids_[i] || !values_[i]->equals(cast->values_[i])) return false;
+        }
+        return true;
+    }
+
+    Object* clone() {
+        MultiStatus* ms = new MultiStatus(target_);
+        ms->sender_ = sender_;
+        ms->id_ = id_;
+        for (size_t i = 0; i < count_; i++) ms->add(ids_[i], values_[i]->clone());
+        return ms;
+    }
+};
+
+inline Message* msg_deserialize(SerialView view) {
+    Deserializer d(view);
+    switch(static_cast<MsgType>(Deserializer(view).read_size())) {
         case MsgType::Register:
-            return Register::deserialize(serial);
+            return Register::deserialize(d);
         case MsgType::Get:
-            return Get::deserialize(serial);
+            return Get::deserialize(d);
         case MsgType::Put:
-            return Put::deserialize(serial);
+            return Put::deserialize(d);
         case MsgType::Status:
-            return Status::deserialize(serial);
+            return Status::deserialize(d);
         case MsgType::Directory:
-            return Directory::deserialize(serial);
+            return Directory::deserialize(d);
         case MsgType::Fail:
-            return Fail::deserialize(serial);
+            return Fail::deserialize(d);
+        case MsgType::MultiGet:
+            return MultiGet::deserialize(d);
+        case MsgType::MultiPut:
+            return MultiPut::deserialize(d);
+        case MsgType::MultiStatus:
+            return MultiStatus::deserialize(d);
+        case MsgType::Reduce:
+            return Reduce::deserialize(d);
         default:
             assert(false);
             return nullptr;
     }
-}
\ No newline at end of file
+}
+
+inline Message* msg_deserialize(SerialString* serial) {
+    return msg_deserialize(SerialView(serial));
+}
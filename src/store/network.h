@@ -5,6 +5,11 @@
 #include <sys/socket.h>
 #include <netinet/in.h>
 #include <arpa/inet.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <limits.h>
 
 #include "../utils/object.h"
 #include "../utils/string.h"
@@ -46,6 +51,83 @@ public:
     }
 };
 
+/**
+ * @brief A thread-safe FIFO of messages that consumers can block on.
+ * Messages are owned by the channel until they are popped.
+ */
+class MsgChannel : public Object {
+public:
+    Message** buf_; // owned, elements owned - ring buffer
+    size_t head_;
+    size_t size_;
+    size_t capacity_;
+    Lock lock_;
+
+    MsgChannel() {
+        capacity_ = 16;
+        buf_ = new Message*[capacity_];
+        head_ = 0;
+        size_ = 0;
+    }
+
+    ~MsgChannel() {
+        while(size_ > 0) delete(pop_());
+        delete[](buf_);
+    }
+
+    size_t count() {
+        lock_.lock();
+        size_t c = size_;
+        lock_.unlock();
+        return c;
+    }
+
+    /**
+     * @brief adds a message to the back of the channel and wakes up a waiting consumer
+     * 
+     * @param m - the message, consumed
+     */
+    void push(Message* m) {
+        lock_.lock();
+        if(size_ == capacity_) {
+            Message** buf = new Message*[capacity_ * 2];
+            for (size_t i = 0; i < size_; i++)
+            {
+                buf[i] = buf_[(head_ + i) % capacity_];
+            }
+            delete[](buf_);
+            buf_ = buf;
+            head_ = 0;
+            capacity_ *= 2;
+        }
+        buf_[(head_ + size_++) % capacity_] = m;
+        lock_.unlock();
+        lock_.notify_one();
+    }
+
+    /**
+     * @brief takes the message at the front of the channel, waiting up to millis for one to arrive
+     * 
+     * @param millis - how long to wait if the channel is empty
+     * @return Message* - the message, or nullptr if none arrived in time
+     */
+    Message* pop(size_t millis) {
+        lock_.lock();
+        if(size_ == 0) lock_.wait_for(millis);
+        Message* m = size_ == 0 ? nullptr : pop_();
+        lock_.unlock();
+        return m;
+    }
+
+    // assumes the lock is held and the channel isn't empty
+    Message* pop_() {
+        Message* m = buf_[head_];
+        head_ = (head_ + 1) % capacity_;
+        size_--;
+        return m;
+    }
+};
+
 class Size_t : public Object {
 public:
     size_t value_;
@@ -97,6 +179,7 @@ public:
 
     virtual void send_message(Message* msg) = 0;
 
+    /** Returns the next message for this node, or nullptr if none is available yet. */
     virtual Message* receive_message() = 0;
 };
 
@@ -147,25 +230,282 @@ class NodeInfo : public Object {
 public:
     unsigned id;
     sockaddr_in address;
+    int conn = -1; // long-lived outbound connection to this node, -1 if not connected
+};
+
+#define MAX_SEND_ATTEMPTS 5
+#define RECONNECT_BACKOFF 100 // millis, multiplied by the attempt number
+#define RECEIVE_TIMEOUT 100 // millis receive_message waits before giving up
+#define REACTOR_STAGING 65536 // bytes read off a connection at a time
+#define REACTOR_EVENTS 64
+
+/**
+ * @brief An inbound connection. Frames (a size_t length followed by a serialized message)
+ * are decoded incrementally as bytes arrive, so reading never blocks on a slow peer.
+ */
+class InConn : public Object {
+public:
+    int fd_;
+    size_t slot_; // position in the reactor's list of connections
+    char* staged_; // owned - bytes read but not yet decoded
+    size_t staged_size_;
+    size_t staged_pos_;
+    size_t header_read_; // bytes of the current frame's length read so far
+    size_t frame_size_;
+    char* frame_; // owned - the current frame, nullptr while reading its length
+    size_t frame_read_;
+
+    InConn(int fd) {
+        fd_ = fd;
+        staged_ = new char[REACTOR_STAGING];
+        staged_size_ = 0;
+        staged_pos_ = 0;
+        header_read_ = 0;
+        frame_size_ = 0;
+        frame_ = nullptr;
+        frame_read_ = 0;
+    }
+
+    ~InConn() {
+        close(fd_);
+        delete[](staged_);
+        delete[](frame_);
+    }
+
+    /**
+     * @brief hands a completed frame to the inbox as a message
+     */
+    void emit_(MsgChannel* inbox) {
+        Message* msg = msg_deserialize(SerialView(frame_, frame_size_));
+        delete[](frame_);
+        frame_ = nullptr;
+        header_read_ = 0;
+        if(msg != nullptr) inbox->push(msg);
+    }
+
+    /**
+     * @brief decodes as much of the staged bytes as possible
+     */
+    void decode_(MsgChannel* inbox) {
+        while(staged_pos_ < staged_size_) {
+            size_t avail = staged_size_ - staged_pos_;
+            if(frame_ == nullptr) {
+                size_t n = avail < sizeof(size_t) - header_read_ ? avail : sizeof(size_t) - header_read_;
+                memcpy((char*)&frame_size_ + header_read_, staged_ + staged_pos_, n);
+                staged_pos_ += n;
+                header_read_ += n;
+                if(header_read_ < sizeof(size_t)) continue;
+                if(staged_size_ - staged_pos_ >= frame_size_) {
+                    // the whole frame is already here, decode it in place
+                    Message* msg = msg_deserialize(SerialView(staged_ + staged_pos_, frame_size_));
+                    staged_pos_ += frame_size_;
+                    header_read_ = 0;
+                    if(msg != nullptr) inbox->push(msg);
+                    continue;
+                }
+                frame_ = new char[frame_size_];
+                frame_read_ = 0;
+            } else {
+                size_t n = avail < frame_size_ - frame_read_ ? avail : frame_size_ - frame_read_;
+                memcpy(frame_ + frame_read_, staged_ + staged_pos_, n);
+                staged_pos_ += n;
+                frame_read_ += n;
+            }
+            if(frame_read_ == frame_size_) emit_(inbox);
+        }
+        staged_size_ = 0;
+        staged_pos_ = 0;
+    }
+
+    /**
+     * @brief reads everything available on the connection without blocking
+     * 
+     * @param inbox - where decoded messages go
+     * @return true - if the connection is still open
+     * @return false - if the peer hung up or the connection failed
+     */
+    bool on_readable(MsgChannel* inbox) {
+        while(true) {
+            ssize_t n;
+            if(frame_ != nullptr && frame_size_ - frame_read_ >= REACTOR_STAGING) {
+                // most of a big frame is still to come, read it in place
+                n = read(fd_, frame_ + frame_read_, frame_size_ - frame_read_);
+                if(n > 0) {
+                    frame_read_ += n;
+                    if(frame_read_ == frame_size_) emit_(inbox);
+                }
+            } else {
+                n = read(fd_, staged_, REACTOR_STAGING);
+                if(n > 0) {
+                    staged_size_ = n;
+                    decode_(inbox);
+                }
+            }
+            if(n == 0) return false;
+            if(n < 0) {
+                if(errno == EINTR) continue;
+                return errno == EAGAIN || errno == EWOULDBLOCK;
+            }
+        }
+    }
+};
+
+/**
+ * @brief Watches the listening socket and every inbound connection with epoll,
+ * decoding frames into the inbox as they arrive.
+ */
+class Reactor : public Thread {
+public:
+    int epfd_;
+    int listen_fd_; // external
+    MsgChannel* inbox_; // external
+    std::atomic<bool> running_;
+    InConn** conns_; // owned, elements owned
+    std::atomic<size_t> num_conns_;
+    size_t conns_cap_;
+
+    Reactor(int listen_fd, MsgChannel* inbox) {
+        listen_fd_ = listen_fd;
+        inbox_ = inbox;
+        running_ = true;
+        conns_cap_ = 8;
+        conns_ = new InConn*[conns_cap_];
+        num_conns_ = 0;
+        assert((epfd_ = epoll_create1(0)) >= 0);
+        set_nonblocking(listen_fd_);
+
+        epoll_event ev;
+        ev.events = EPOLLIN;
+        ev.data.ptr = nullptr; // nullptr marks the listening socket
+        assert(epoll_ctl(epfd_, EPOLL_CTL_ADD, listen_fd_, &ev) == 0);
+    }
+
+    ~Reactor() {
+        for (size_t i = 0; i < num_conns_; i++)
+        {
+            delete(conns_[i]);
+        }
+        delete[](conns_);
+        close(epfd_);
+    }
+
+    static void set_nonblocking(int fd) {
+        int flags = fcntl(fd, F_GETFL, 0);
+        assert(flags >= 0 && fcntl(fd, F_SETFL, flags | O_NONBLOCK) == 0);
+    }
+
+    /** Stop watching connections, closing them, and wait for the reactor to finish */
+    void stop() {
+        running_ = false;
+        join();
+    }
+
+    void accept_all_() {
+        while(true) {
+            sockaddr_in sender;
+            socklen_t addrlen = sizeof(sender);
+            int fd = accept(listen_fd_, (sockaddr*)&sender, &addrlen);
+            if(fd < 0) return; // nothing left to accept
+            set_nonblocking(fd);
+            InConn* conn = new InConn(fd);
+            if(num_conns_ == conns_cap_) {
+                InConn** conns = new InConn*[conns_cap_ * 2];
+                memcpy(conns, conns_, num_conns_ * sizeof(InConn*));
+                delete[](conns_);
+                conns_ = conns;
+                conns_cap_ *= 2;
+            }
+            conn->slot_ = num_conns_;
+            conns_[num_conns_++] = conn;
+
+            epoll_event ev;
+            ev.events = EPOLLIN;
+            ev.data.ptr = conn;
+            assert(epoll_ctl(epfd_, EPOLL_CTL_ADD, fd, &ev) == 0);
+        }
+    }
+
+    void remove_(InConn* conn) {
+        epoll_ctl(epfd_, EPOLL_CTL_DEL, conn->fd_, nullptr);
+        InConn* last = conns_[--num_conns_];
+        conns_[conn->slot_] = last;
+        last->slot_ = conn->slot_;
+        delete(conn);
+    }
+
+    void run() {
+        epoll_event* events = new epoll_event[REACTOR_EVENTS];
+        while(running_) {
+            int n = epoll_wait(epfd_, events, REACTOR_EVENTS, RECEIVE_TIMEOUT);
+            for (int i = 0; i < n; i++)
+            {
+                InConn* conn = (InConn*)events[i].data.ptr;
+                if(conn == nullptr) accept_all_();
+                else if(!conn->on_readable(inbox_)) remove_(conn);
+            }
+        }
+        delete[](events);
+    }
 };
 
 class NetworkIP : public NetworkIfc {
 public:
     NodeInfo* nodes_; // all nodes
+    size_t num_nodes_;
+    Lock* conn_locks_; // owned - one per node, serializes frames sent on nodes_[i].conn
+    Serializer* out_; // owned - one per node, reused for every frame sent to it under its conn lock
     size_t this_node_; // our index
     int sock_; // our socket
     sockaddr_in ip_; // our ip
+    MsgChannel inbox_; // messages decoded by the reactor
+    Reactor* reactor_; // owned
+    bool persistent_ = true; // when false, close each connection after a single message
+
+    NetworkIP() {
+        nodes_ = nullptr;
+        num_nodes_ = 0;
+        conn_locks_ = nullptr;
+        out_ = nullptr;
+        reactor_ = nullptr;
+    }
 
-    ~NetworkIP() { close(sock_); }
+    ~NetworkIP() {
+        if(reactor_ != nullptr) {
+            reactor_->stop();
+            delete(reactor_);
+        }
+        for (size_t i = 0; i < num_nodes_; i++)
+        {
+            if(nodes_[i].conn >= 0) close(nodes_[i].conn);
+        }
+        close(sock_);
+        delete[](nodes_);
+        delete[](conn_locks_);
+        delete[](out_);
+    }
 
     size_t index() { return this_node_; }
 
+    /**
+     * @brief sets up one connection lock and output buffer per node
+     * 
+     * @param num_nodes - the number of nodes in the list
+     */
+    void init_nodes_(size_t num_nodes) {
+        delete[](conn_locks_);
+        delete[](out_);
+        num_nodes_ = num_nodes;
+        conn_locks_ = new Lock[num_nodes_];
+        out_ = new Serializer[num_nodes_];
+    }
+
     void server_init(unsigned idx, unsigned port, size_t num_nodes) {
         this_node_ = idx;
         init_sock_(port);
 
         // set up node list
         nodes_ = new NodeInfo[num_nodes];
+        init_nodes_(num_nodes);
         for (size_t i = 0; i < num_nodes; i++)
         {
             nodes_[i].id = 0;
@@ -176,7 +516,7 @@ public:
         // register all nodes
         for (size_t i = 1; i < num_nodes; i++)
         {
-            Register* msg = dynamic_cast<Register*>(receive_message());
+            Register* msg = dynamic_cast<Register*>(await_message_());
             nodes_[msg->sender_].id = msg->sender_;
             nodes_[msg->sender_].address.sin_family = AF_INET;
             nodes_[msg->sender_].address.sin_addr = msg->client.sin_addr;
@@ -208,6 +548,7 @@ public:
 
         // set up node list
         nodes_ = new NodeInfo[1];
+        init_nodes_(1);
         nodes_[0].id = 0;
         nodes_[0].address.sin_family = AF_INET;
         nodes_[0].address.sin_port = htons(server_port);
@@ -225,9 +566,9 @@ public:
         send_message(msg);
 
         // handle directory
-        Directory* ipd = dynamic_cast<Directory*>(receive_message());
+        Directory* ipd = dynamic_cast<Directory*>(await_message_());
         NodeInfo* nodes = new NodeInfo[num_nodes];
-        nodes[0] = nodes_[0];
+        nodes[0] = nodes_[0]; // keeps our connection to the server
         for (size_t i = 0; i < ipd->num_nodes_; i++)
         {
             nodes[i + 1].id = i + 1;
@@ -240,6 +581,7 @@ public:
         }
         delete[](nodes_);
         nodes_ = nodes;
+        init_nodes_(num_nodes);
         delete ipd;
     }
 
@@ -259,6 +601,9 @@ public:
             assert(false);
         }
         assert(listen(sock_, 100) >= 0); // connections queue size
+
+        reactor_ = new Reactor(sock_, &inbox_);
+        reactor_->start();
     }
 
     void register_node(size_t idx) {
@@ -267,42 +612,113 @@ public:
         else client_init(idx, args->port, args->server_adr, args->server_port, args->num_nodes);
     }
 
-    void send_message(Message* msg) {
-        msg->sender_ = index();
-        NodeInfo& tgt = nodes_[msg->target_];
+    /**
+     * @brief writes every buffer in the list to the given socket, in one syscall when it can
+     * 
+     * @param iov - the buffers, advanced past whatever is written
+     * @param n - how many buffers there are
+     * @return true - if everything was written
+     * @return false - if the connection failed
+     */
+    static bool send_all_(int fd, iovec* iov, size_t n) {
+        while(n > 0) {
+            msghdr hdr;
+            memset(&hdr, 0, sizeof(msghdr));
+            hdr.msg_iov = iov;
+            hdr.msg_iovlen = n < IOV_MAX ? n : IOV_MAX;
+            ssize_t wr = sendmsg(fd, &hdr, MSG_NOSIGNAL);
+            if(wr < 0 && errno == EINTR) continue;
+            if(wr <= 0) return false;
+            // skip what was written, the last buffer may have gone out partially
+            while(n > 0 && (size_t)wr >= iov->iov_len) {
+                wr -= iov->iov_len;
+                iov++;
+                n--;
+            }
+            if(n > 0) {
+                iov->iov_base = (char*)iov->iov_base + wr;
+                iov->iov_len -= wr;
+            }
+        }
+        return true;
+    }
 
+    /**
+     * @brief opens a new connection to the given node
+     * 
+     * @param target - the index of the node
+     * @return int - the connected socket, or -1 on failure
+     */
+    int connect_(size_t target) {
         int conn = socket(AF_INET, SOCK_STREAM, 0);
         assert(conn >= 0 && "Unable to create client socket");
-        if(connect(conn, (sockaddr*)&tgt.address, sizeof(sockaddr)) < 0) {
-            perror("Unable to connect to remote node");
-            assert(false);
-        } 
+        if(connect(conn, (sockaddr*)&nodes_[target].address, sizeof(sockaddr)) < 0) {
+            close(conn);
+            return -1;
+        }
+        // frames are small and latency sensitive, don't wait to coalesce them
+        int opt = 1;
+        setsockopt(conn, IPPROTO_TCP, TCP_NODELAY, &opt, sizeof(opt));
+        return conn;
+    }
+
+    /**
+     * @brief sends the message over the connection kept for its target, (re)connecting as needed.
+     * Each message is framed by its serialized size. Large values are written straight from the
+     * message rather than being copied into the frame.
+     * 
+     * @param msg - the message, consumed
+     */
+    void send_message(Message* msg) {
+        msg->sender_ = index();
+        assert(msg->target_ < num_nodes_);
+        NodeInfo& tgt = nodes_[msg->target_];
 
         Logger::log_send(msg);
-        SerialString* ss = msg->serialize();
-        send(conn, &ss->size_, sizeof(size_t), 0);
-        send(conn, ss->data_, ss->size_, 0);
-        delete(ss);
+
+        Lock& lock = conn_locks_[msg->target_];
+        lock.lock();
+        Serializer& out = out_[msg->target_];
+        out.clear();
+        size_t frame_size = out.reserve_size();
+        msg->serialize_into(out);
+        out.patch_size(frame_size, out.size() - sizeof(size_t));
+        bool sent = false;
+        for (size_t attempt = 0; attempt < MAX_SEND_ATTEMPTS && !sent; attempt++)
+        {
+            if(tgt.conn < 0) tgt.conn = connect_(msg->target_);
+            if(tgt.conn < 0) { Thread::sleep(RECONNECT_BACKOFF * (attempt + 1)); continue; }
+            iovec* iov;
+            size_t n = out.iov(&iov);
+            sent = send_all_(tgt.conn, iov, n);
+            if(!sent || !persistent_) { close(tgt.conn); tgt.conn = -1; } // stale connection, retry on a new one
+        }
+        lock.unlock();
+
+        if(!sent) {
+            perror("Unable to send to remote node");
+            assert(false);
+        }
         delete(msg);
     }
 
+    /**
+     * @brief takes the next message decoded by the reactor
+     * 
+     * @return Message* - the message, or nullptr if none arrived within RECEIVE_TIMEOUT
+     */
     Message* receive_message() {
-        sockaddr_in sender;
-        socklen_t addrlen = sizeof(sender);
-        int req = accept(sock_, (sockaddr*)&sender, &addrlen);
-        size_t size = 0;
-        if(read(req, &size, sizeof(size_t)) == 0) assert(false && "Failed to read");
-        char* buf = new char[size];
-        int rd = 0;
-        while(rd != size) rd += read(req, buf + rd, size - rd);
-        SerialString* ss = new SerialString(buf, size);
-        delete[](buf);
-        Message* msg = msg_deserialize(ss);
-        if(msg == nullptr) return nullptr;
-
-        Logger::log_receive(msg);
-        delete(ss);
+        Message* msg = inbox_.pop(RECEIVE_TIMEOUT);
+        if(msg != nullptr) Logger::log_receive(msg);
         return msg;
     }
-};
 
+    /**
+     * @brief waits as long as it takes for the next message, used while setting up the network
+     */
+    Message* await_message_() {
+        Message* msg = receive_message();
+        while(msg == nullptr) msg = receive_message();
+        return msg;
+    }
+};
\ No newline at end of file
@@ -3,18 +3,56 @@
 #include <assert.h>
 #include <time.h>
 #include <string.h>
+#include <atomic>
 
 //#include "../utils/object.h"
 #include "../utils/serial.h"
 #include "../utils/helper.h"
 
+/**
+ * @brief Serialized bytes shared by every copy of a value.
+ * Never modified once built, and freed when the last copy lets go of them.
+ */
+class SharedSerial {
+public:
+    SerialString* ss_; // owned
+    std::atomic<size_t> refs_;
+
+    /**
+     * @brief Construct a new Shared Serial object held by one value
+     * 
+     * @param ss - the bytes, consumed
+     */
+    SharedSerial(SerialString* ss) {
+        ss_ = ss;
+        refs_ = 1;
+    }
+
+    ~SharedSerial() { delete(ss_); }
+
+    /** adds a holder */
+    SharedSerial* retain() {
+        refs_.fetch_add(1);
+        return this;
+    }
+
+    /** drops a holder, deleting this if it was the last */
+    void release() {
+        if(refs_.fetch_sub(1) == 1) delete(this);
+    }
+};
+
 /**
  * @brief a value used in a KVStore
- * 
+ * Copies share their serialized bytes, so cloning a value (as every get does) never copies them.
  */
 class Value : public Sys {
 public:
-    SerialString* serialized_; // owned
+    SerialString* serialized_; // owned by shared_ if it's set, otherwise owned
+    SharedSerial* shared_; // shared
+
+    /** bytes copied into new values since the program started, for measuring */
+    inline static std::atomic<size_t> copied_{0};
 
     /**
      * @brief Construct a new Value object
@@ -22,10 +60,17 @@ public:
      */
     Value() {
         serialized_ = nullptr;
+        shared_ = nullptr;
+    }
+
+    Value(SerialString* ss) : Value() {
+        copied_ += ss->size_;
+        share_(ss->clone());
     }
 
-    Value(SerialString* ss) {
-        serialized_ = ss->clone();
+    Value(SerialView view) : Value() {
+        copied_ += view.size_;
+        share_(view.copy());
     }
 
     /**
@@ -33,8 +78,8 @@ public:
      * 
      * @param so the serializable object stored in this value
      */
-    Value(Serializable* so) {
-        serialized_ = so->serialize();
+    Value(Serializable* so) : Value() {
+        share_(so->serialize());
     }
 
     /**
@@ -42,13 +87,23 @@ public:
      * Checks if serialized exists because child classes may have deleted it (caching)
      */
     virtual ~Value() {
-        if(serialized_ != nullptr) delete(serialized_);
+        if(shared_ != nullptr) shared_->release();
+        else if(serialized_ != nullptr) delete(serialized_);
+    }
+
+    // takes the given bytes as this value's, consumed
+    void share_(SerialString* ss) {
+        shared_ = new SharedSerial(ss);
+        serialized_ = ss;
     }
 
+    /** the number of bytes copied into new values so far */
+    static size_t bytes_copied() { return copied_; }
+
     /**
      * @brief get the serial string stored in this value
      * 
-     * @return char* - the serial string
+     * @return char* - the serial string, which must not be modified
      */
     virtual SerialString* serialized() { return serialized_; }
 
@@ -61,17 +116,25 @@ public:
     virtual bool cachable() { return false; }
 
     /**
-     * @brief clones this value
+     * @brief clones this value, sharing its bytes
      * 
      * @return Value* - the clone of this value
      */
     virtual Value* clone() {
         Value* v = new Value();
-        v->serialized_ = serialized()->clone();
+        if(shared_ != nullptr) {
+            v->shared_ = shared_->retain();
+            v->serialized_ = serialized_;
+        }
+        else {
+            copied_ += serialized()->size_;
+            v->share_(serialized()->clone());
+        }
         return v;
     }
 
     virtual bool equals(Value* other) {
+        if(serialized() == other->serialized()) return true;
         return serialized()->equals(other->serialized());
     }
 };
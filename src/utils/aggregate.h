@@ -0,0 +1,462 @@
+#pragma once
+
+#include <assert.h>
+#include <math.h>
+#include <stdint.h>
+
+#include "serial.h"
+#include "simd.h"
+
+/**
+ * @brief The count, sum, min, max, mean and variance of a set of values, built up a block at a time.
+ * Keeps the mean and the sum of squared differences from it rather than a sum of squares, so
+ * merging blocks (Chan et al.) doesn't lose the variance to cancellation.
+ */
+class Aggregate : public SerializableObject {
+public:
+    size_t count_;
+    double sum_;
+    double min_;
+    double max_;
+    double m2_; // the sum of squared differences from the mean
+
+    Aggregate() {
+        count_ = 0;
+        sum_ = 0;
+        min_ = INFINITY;
+        max_ = -INFINITY;
+        m2_ = 0;
+    }
+
+    Aggregate(size_t count, double sum, double min, double max, double m2) {
+        count_ = count;
+        sum_ = sum;
+        min_ = min;
+        max_ = max;
+        m2_ = m2;
+    }
+
+    size_t count() { return count_; }
+    double sum() { return sum_; }
+    /** the smallest value, infinity if there are none */
+    double min() { return min_; }
+    /** the largest value, -infinity if there are none */
+    double max() { return max_; }
+    /** NaN if there are no values */
+    double mean() { return count_ == 0 ? NAN : sum_ / count_; }
+    /** the population variance, NaN if there are no values */
+    double variance() { return count_ == 0 ? NAN : m2_ / count_; }
+
+    /** folds another set of values into this one */
+    void merge(Aggregate& other) {
+        if(other.count_ == 0) return;
+        if(count_ == 0) {
+            *this = other;
+            return;
+        }
+        double delta = other.mean() - mean();
+        size_t n = count_ + other.count_;
+        m2_ += other.m2_ + delta * delta * ((double)count_ * other.count_ / n);
+        count_ = n;
+        sum_ += other.sum_;
+        if(other.min_ < min_) min_ = other.min_;
+        if(other.max_ > max_) max_ = other.max_;
+    }
+
+    bool equals(Object* other) {
+        Aggregate* cast = dynamic_cast<Aggregate *>(other);
+        if(cast == nullptr) return false;
+        return count_ == cast->count_ && sum_ == cast->sum_ && min_ == cast->min_ && max_ == cast->max_ && m2_ == cast->m2_;
+    }
+
+    Object* clone() { return new Aggregate(count_, sum_, min_, max_, m2_); }
+
+    SerialString* serialize() {
+        Serializer s;
+        serialize_into(s);
+        return s.to_serial();
+    }
+
+    void serialize_into(Serializer& s) {
+        s.write_size(count_);
+        s.write(&sum_, sizeof(double));
+        s.write(&min_, sizeof(double));
+        s.write(&max_, sizeof(double));
+        s.write(&m2_, sizeof(double));
+    }
+
+    static Aggregate deserialize(SerialView view) {
+        Deserializer d(view);
+        Aggregate a;
+        a.count_ = d.read_size();
+        a.sum_ = d.read<double>();
+        a.min_ = d.read<double>();
+        a.max_ = d.read<double>();
+        a.m2_ = d.read<double>();
+        return a;
+    }
+};
+
+/*************************************************************************
+ * Kernels. Each type has a pass for the sum, min and max, and a pass for the
+ * squared differences from the mean, at every instruction set level.
+ */
+
+inline void ints_scalar_(const int* v, size_t n, int64_t* sum, int* min, int* max) {
+    int64_t s = 0;
+    int lo = v[0], hi = v[0];
+    for (size_t i = 0; i < n; i++)
+    {
+        s += v[i];
+        if(v[i] < lo) lo = v[i];
+        if(v[i] > hi) hi = v[i];
+    }
+    *sum = s;
+    *min = lo;
+    *max = hi;
+}
+
+inline double ints_m2_scalar_(const int* v, size_t n, double mean) {
+    double m2 = 0;
+    for (size_t i = 0; i < n; i++) m2 += (v[i] - mean) * (v[i] - mean);
+    return m2;
+}
+
+inline void doubles_scalar_(const double* v, size_t n, double* sum, double* min, double* max) {
+    double s = 0;
+    double lo = v[0], hi = v[0];
+    for (size_t i = 0; i < n; i++)
+    {
+        s += v[i];
+        if(v[i] < lo) lo = v[i];
+        if(v[i] > hi) hi = v[i];
+    }
+    *sum = s;
+    *min = lo;
+    *max = hi;
+}
+
+inline double doubles_m2_scalar_(const double* v, size_t n, double mean) {
+    double m2 = 0;
+    for (size_t i = 0; i < n; i++) m2 += (v[i] - mean) * (v[i] - mean);
+    return m2;
+}
+
+inline size_t bools_scalar_(const bool* v, size_t n) {
+    size_t trues = 0;
+    for (size_t i = 0; i < n; i++) trues += v[i];
+    return trues;
+}
+
+#ifdef SIMD_X86
+
+__attribute__((target("sse4.1")))
+inline void ints_sse41_(const int* v, size_t n, int64_t* sum, int* min, int* max) {
+    __m128i s = _mm_setzero_si128();
+    __m128i lo = _mm_set1_epi32(v[0]);
+    __m128i hi = lo;
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4)
+    {
+        __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i*>(v + i));
+        s = _mm_add_epi64(s, _mm_cvtepi32_epi64(x));
+        s = _mm_add_epi64(s, _mm_cvtepi32_epi64(_mm_srli_si128(x, 8)));
+        lo = _mm_min_epi32(lo, x);
+        hi = _mm_max_epi32(hi, x);
+    }
+    int64_t ss[2];
+    int los[4], his[4];
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(ss), s);
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(los), lo);
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(his), hi);
+    int64_t total = ss[0] + ss[1];
+    int l = los[0], h = his[0];
+    for (size_t j = 1; j < 4; j++)
+    {
+        if(los[j] < l) l = los[j];
+        if(his[j] > h) h = his[j];
+    }
+    for (; i < n; i++)
+    {
+        total += v[i];
+        if(v[i] < l) l = v[i];
+        if(v[i] > h) h = v[i];
+    }
+    *sum = total;
+    *min = l;
+    *max = h;
+}
+
+__attribute__((target("sse4.1")))
+inline double ints_m2_sse41_(const int* v, size_t n, double mean) {
+    __m128d m = _mm_set1_pd(mean);
+    __m128d acc = _mm_setzero_pd();
+    size_t i = 0;
+    for (; i + 2 <= n; i += 2)
+    {
+        __m128d d = _mm_sub_pd(_mm_cvtepi32_pd(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(v + i))), m);
+        acc = _mm_add_pd(acc, _mm_mul_pd(d, d));
+    }
+    double a[2];
+    _mm_storeu_pd(a, acc);
+    return a[0] + a[1] + ints_m2_scalar_(v + i, n - i, mean);
+}
+
+__attribute__((target("sse4.1")))
+inline void doubles_sse41_(const double* v, size_t n, double* sum, double* min, double* max) {
+    __m128d s0 = _mm_setzero_pd(), s1 = _mm_setzero_pd();
+    __m128d lo = _mm_set1_pd(v[0]);
+    __m128d hi = lo;
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4)
+    {
+        __m128d x0 = _mm_loadu_pd(v + i);
+        __m128d x1 = _mm_loadu_pd(v + i + 2);
+        s0 = _mm_add_pd(s0, x0);
+        s1 = _mm_add_pd(s1, x1);
+        lo = _mm_min_pd(lo, _mm_min_pd(x0, x1));
+        hi = _mm_max_pd(hi, _mm_max_pd(x0, x1));
+    }
+    double ss[2], los[2], his[2];
+    _mm_storeu_pd(ss, _mm_add_pd(s0, s1));
+    _mm_storeu_pd(los, lo);
+    _mm_storeu_pd(his, hi);
+    double total = ss[0] + ss[1];
+    double l = los[0] < los[1] ? los[0] : los[1];
+    double h = his[0] > his[1] ? his[0] : his[1];
+    for (; i < n; i++)
+    {
+        total += v[i];
+        if(v[i] < l) l = v[i];
+        if(v[i] > h) h = v[i];
+    }
+    *sum = total;
+    *min = l;
+    *max = h;
+}
+
+__attribute__((target("sse4.1")))
+inline double doubles_m2_sse41_(const double* v, size_t n, double mean) {
+    __m128d m = _mm_set1_pd(mean);
+    __m128d acc0 = _mm_setzero_pd(), acc1 = _mm_setzero_pd();
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4)
+    {
+        __m128d d0 = _mm_sub_pd(_mm_loadu_pd(v + i), m);
+        __m128d d1 = _mm_sub_pd(_mm_loadu_pd(v + i + 2), m);
+        acc0 = _mm_add_pd(acc0, _mm_mul_pd(d0, d0));
+        acc1 = _mm_add_pd(acc1, _mm_mul_pd(d1, d1));
+    }
+    double a[2];
+    _mm_storeu_pd(a, _mm_add_pd(acc0, acc1));
+    return a[0] + a[1] + doubles_m2_scalar_(v + i, n - i, mean);
+}
+
+__attribute__((target("sse4.1")))
+inline size_t bools_sse41_(const bool* v, size_t n) {
+    // bools are single 0 or 1 bytes, so summing the bytes counts the trues
+    __m128i acc = _mm_setzero_si128();
+    __m128i zero = _mm_setzero_si128();
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16)
+    {
+        acc = _mm_add_epi64(acc, _mm_sad_epu8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(v + i)), zero));
+    }
+    uint64_t a[2];
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(a), acc);
+    return a[0] + a[1] + bools_scalar_(v + i, n - i);
+}
+
+__attribute__((target("avx2")))
+inline void ints_avx2_(const int* v, size_t n, int64_t* sum, int* min, int* max) {
+    __m256i s = _mm256_setzero_si256();
+    __m256i lo = _mm256_set1_epi32(v[0]);
+    __m256i hi = lo;
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8)
+    {
+        __m256i x = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(v + i));
+        s = _mm256_add_epi64(s, _mm256_cvtepi32_epi64(_mm256_castsi256_si128(x)));
+        s = _mm256_add_epi64(s, _mm256_cvtepi32_epi64(_mm256_extracti128_si256(x, 1)));
+        lo = _mm256_min_epi32(lo, x);
+        hi = _mm256_max_epi32(hi, x);
+    }
+    int64_t ss[4];
+    int los[8], his[8];
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(ss), s);
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(los), lo);
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(his), hi);
+    int64_t total = ss[0] + ss[1] + ss[2] + ss[3];
+    int l = los[0], h = his[0];
+    for (size_t j = 1; j < 8; j++)
+    {
+        if(los[j] < l) l = los[j];
+        if(his[j] > h) h = his[j];
+    }
+    for (; i < n; i++)
+    {
+        total += v[i];
+        if(v[i] < l) l = v[i];
+        if(v[i] > h) h = v[i];
+    }
+    *sum = total;
+    *min = l;
+    *max = h;
+}
+
+__attribute__((target("avx2")))
+inline double ints_m2_avx2_(const int* v, size_t n, double mean) {
+    __m256d m = _mm256_set1_pd(mean);
+    __m256d acc0 = _mm256_setzero_pd(), acc1 = _mm256_setzero_pd();
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8)
+    {
+        __m256i x = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(v + i));
+        __m256d d0 = _mm256_sub_pd(_mm256_cvtepi32_pd(_mm256_castsi256_si128(x)), m);
+        __m256d d1 = _mm256_sub_pd(_mm256_cvtepi32_pd(_mm256_extracti128_si256(x, 1)), m);
+        acc0 = _mm256_add_pd(acc0, _mm256_mul_pd(d0, d0));
+        acc1 = _mm256_add_pd(acc1, _mm256_mul_pd(d1, d1));
+    }
+    double a[4];
+    _mm256_storeu_pd(a, _mm256_add_pd(acc0, acc1));
+    return a[0] + a[1] + a[2] + a[3] + ints_m2_scalar_(v + i, n - i, mean);
+}
+
+__attribute__((target("avx2")))
+inline void doubles_avx2_(const double* v, size_t n, double* sum, double* min, double* max) {
+    __m256d s0 = _mm256_setzero_pd(), s1 = _mm256_setzero_pd();
+    __m256d lo = _mm256_set1_pd(v[0]);
+    __m256d hi = lo;
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8)
+    {
+        __m256d x0 = _mm256_loadu_pd(v + i);
+        __m256d x1 = _mm256_loadu_pd(v + i + 4);
+        s0 = _mm256_add_pd(s0, x0);
+        s1 = _mm256_add_pd(s1, x1);
+        lo = _mm256_min_pd(lo, _mm256_min_pd(x0, x1));
+        hi = _mm256_max_pd(hi, _mm256_max_pd(x0, x1));
+    }
+    double ss[4], los[4], his[4];
+    _mm256_storeu_pd(ss, _mm256_add_pd(s0, s1));
+    _mm256_storeu_pd(los, lo);
+    _mm256_storeu_pd(his, hi);
+    double total = ss[0] + ss[1] + ss[2] + ss[3];
+    double l = los[0], h = his[0];
+    for (size_t j = 1; j < 4; j++)
+    {
+        if(los[j] < l) l = los[j];
+        if(his[j] > h) h = his[j];
+    }
+    for (; i < n; i++)
+    {
+        total += v[i];
+        if(v[i] < l) l = v[i];
+        if(v[i] > h) h = v[i];
+    }
+    *sum = total;
+    *min = l;
+    *max = h;
+}
+
+__attribute__((target("avx2")))
+inline double doubles_m2_avx2_(const double* v, size_t n, double mean) {
+    __m256d m = _mm256_set1_pd(mean);
+    __m256d acc0 = _mm256_setzero_pd(), acc1 = _mm256_setzero_pd();
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8)
+    {
+        __m256d d0 = _mm256_sub_pd(_mm256_loadu_pd(v + i), m);
+        __m256d d1 = _mm256_sub_pd(_mm256_loadu_pd(v + i + 4), m);
+        acc0 = _mm256_add_pd(acc0, _mm256_mul_pd(d0, d0));
+        acc1 = _mm256_add_pd(acc1, _mm256_mul_pd(d1, d1));
+    }
+    double a[4];
+    _mm256_storeu_pd(a, _mm256_add_pd(acc0, acc1));
+    return a[0] + a[1] + a[2] + a[3] + doubles_m2_scalar_(v + i, n - i, mean);
+}
+
+__attribute__((target("avx2")))
+inline size_t bools_avx2_(const bool* v, size_t n) {
+    __m256i acc = _mm256_setzero_si256();
+    __m256i zero = _mm256_setzero_si256();
+    size_t i = 0;
+    for (; i + 32 <= n; i += 32)
+    {
+        acc = _mm256_add_epi64(acc, _mm256_sad_epu8(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(v + i)), zero));
+    }
+    uint64_t a[4];
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(a), acc);
+    return a[0] + a[1] + a[2] + a[3] + bools_scalar_(v + i, n - i);
+}
+
+#endif
+
+/** the aggregate of n ints */
+inline Aggregate aggregate_of(const int* v, size_t n) {
+    if(n == 0) return Aggregate();
+    int64_t sum;
+    int min, max;
+    double m2;
+    switch(simd_level()) {
+#ifdef SIMD_X86
+        case SIMD_AVX2:
+            ints_avx2_(v, n, &sum, &min, &max);
+            m2 = ints_m2_avx2_(v, n, (double)sum / n);
+            break;
+        case SIMD_SSE41:
+            ints_sse41_(v, n, &sum, &min, &max);
+            m2 = ints_m2_sse41_(v, n, (double)sum / n);
+            break;
+#endif
+        default:
+            ints_scalar_(v, n, &sum, &min, &max);
+            m2 = ints_m2_scalar_(v, n, (double)sum / n);
+            break;
+    }
+    return Aggregate(n, (double)sum, min, max, m2);
+}
+
+/** the aggregate of n doubles, which must not be NaN */
+inline Aggregate aggregate_of(const double* v, size_t n) {
+    if(n == 0) return Aggregate();
+    double sum, min, max, m2;
+    switch(simd_level()) {
+#ifdef SIMD_X86
+        case SIMD_AVX2:
+            doubles_avx2_(v, n, &sum, &min, &max);
+            m2 = doubles_m2_avx2_(v, n, sum / n);
+            break;
+        case SIMD_SSE41:
+            doubles_sse41_(v, n, &sum, &min, &max);
+            m2 = doubles_m2_sse41_(v, n, sum / n);
+            break;
+#endif
+        default:
+            doubles_scalar_(v, n, &sum, &min, &max);
+            m2 = doubles_m2_scalar_(v, n, sum / n);
+            break;
+    }
+    return Aggregate(n, sum, min, max, m2);
+}
+
+/** the aggregate of n bools taken as 0 and 1, of which the given number are true */
+inline Aggregate aggregate_of_trues(size_t trues, size_t n) {
+    if(n == 0) return Aggregate();
+    double m2 = (double)trues * (n - trues) / n;
+    return Aggregate(n, trues, trues == n ? 1 : 0, trues > 0 ? 1 : 0, m2);
+}
+
+/** the aggregate of n bools taken as 0 and 1, so the sum is how many are true */
+inline Aggregate aggregate_of(const bool* v, size_t n) {
+    if(n == 0) return Aggregate();
+    size_t trues;
+    switch(simd_level()) {
+#ifdef SIMD_X86
+        case SIMD_AVX2: trues = bools_avx2_(v, n); break;
+        case SIMD_SSE41: trues = bools_sse41_(v, n); break;
+#endif
+        default: trues = bools_scalar_(v, n); break;
+    }
+    return aggregate_of_trues(trues, n);
+}
@@ -0,0 +1,72 @@
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+
+/*************************************************************************
+ * Helpers for bitmaps stored as arrays of 64 bit words, where bit i is
+ * bit i % 64 of word i / 64. Bits past the last one in use are kept 0.
+ */
+
+#define BITMAP_WORD_BITS 64
+
+/** how many words it takes to hold the given number of bits */
+inline size_t bitmap_words(size_t bits) { return (bits + BITMAP_WORD_BITS - 1) / BITMAP_WORD_BITS; }
+
+inline bool bitmap_get(const uint64_t* words, size_t i) {
+    return (words[i / BITMAP_WORD_BITS] >> (i % BITMAP_WORD_BITS)) & 1;
+}
+
+inline void bitmap_set(uint64_t* words, size_t i, bool b) {
+    uint64_t mask = (uint64_t)1 << (i % BITMAP_WORD_BITS);
+    if(b) words[i / BITMAP_WORD_BITS] |= mask;
+    else words[i / BITMAP_WORD_BITS] &= ~mask;
+}
+
+/** a mask of the bits in use in the last word of a bitmap of the given length */
+inline uint64_t bitmap_tail_mask(size_t bits) {
+    size_t used = bits % BITMAP_WORD_BITS;
+    return used == 0 ? ~(uint64_t)0 : ((uint64_t)1 << used) - 1;
+}
+
+/** how many of the first n bits are set */
+inline size_t bitmap_count(const uint64_t* words, size_t n) {
+    size_t full = n / BITMAP_WORD_BITS;
+    size_t count = 0;
+    for (size_t i = 0; i < full; i++) count += __builtin_popcountll(words[i]);
+    if(n % BITMAP_WORD_BITS != 0) count += __builtin_popcountll(words[full] & bitmap_tail_mask(n));
+    return count;
+}
+
+/** dst &= src, over the words holding n bits */
+inline void bitmap_and(uint64_t* dst, const uint64_t* src, size_t n) {
+    for (size_t i = 0; i < bitmap_words(n); i++) dst[i] &= src[i];
+}
+
+/** dst |= src, over the words holding n bits */
+inline void bitmap_or(uint64_t* dst, const uint64_t* src, size_t n) {
+    for (size_t i = 0; i < bitmap_words(n); i++) dst[i] |= src[i];
+}
+
+/** dst = ~dst, over the words holding n bits, leaving the bits past n 0 */
+inline void bitmap_not(uint64_t* dst, size_t n) {
+    size_t words = bitmap_words(n);
+    for (size_t i = 0; i < words; i++) dst[i] = ~dst[i];
+    if(words > 0) dst[words - 1] &= bitmap_tail_mask(n);
+}
+
+/**
+ * @brief calls f(i) for every set bit i among the first n, in order, a word at a time
+ */
+template<class F>
+inline void bitmap_for_each(const uint64_t* words, size_t n, F f) {
+    for (size_t w = 0; w < bitmap_words(n); w++)
+    {
+        uint64_t bits = words[w];
+        if(w == n / BITMAP_WORD_BITS) bits &= bitmap_tail_mask(n);
+        while(bits != 0) {
+            f(w * BITMAP_WORD_BITS + __builtin_ctzll(bits));
+            bits &= bits - 1;
+        }
+    }
+}
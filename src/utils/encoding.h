@@ -0,0 +1,338 @@
+#pragma once
+
+#include <assert.h>
+#include <stdint.h>
+#include <string.h>
+#include <type_traits>
+
+#include "serial.h"
+
+/*************************************************************************
+ * How a chunk's values are laid out once serialized. Only the values in
+ * use are written, in whichever of these encodings is smallest for them:
+ *
+ * CHUNK_PLAIN - the values as they are, so they can be read in place
+ * CHUNK_FOR   - frame of reference: the smallest value, then each value's
+ *               distance from it in 0, 1, 2 or 4 bytes
+ * CHUNK_DELTA - the first value and the smallest step, then each step's
+ *               distance from that in 0, 1, 2 or 4 bytes, then the value at
+ *               every DELTA_CHECKPOINT'th index. Reading one value is a walk
+ *               of at most DELTA_CHECKPOINT steps from the one before it
+ * CHUNK_RLE   - the distinct runs of values, each with where it ends
+ *
+ * FOR and delta are only tried on integers of up to 32 bits. The encoding
+ * is written ahead of the values along with CHUNK_FORMAT_VERSION, and the
+ * header is a whole word so plain values stay aligned.
+ */
+
+#define CHUNK_FORMAT_VERSION 2
+#define DELTA_CHECKPOINT 128 // steps between the values a delta encoding keeps whole
+
+enum ChunkEncoding { CHUNK_PLAIN = 0, CHUNK_FOR = 1, CHUNK_DELTA = 2, CHUNK_RLE = 3 };
+
+/** whether FOR and delta apply to values of type T */
+template<class T> constexpr bool chunk_packs_integers() {
+    return std::is_integral<T>::value && sizeof(T) <= sizeof(uint32_t);
+}
+
+/** the fewest bytes, 0, 1, 2 or 4, that hold every number up to range. 8 if none of them do */
+inline size_t packed_width(uint64_t range) {
+    if(range == 0) return 0;
+    if(range <= UINT8_MAX) return 1;
+    if(range <= UINT16_MAX) return 2;
+    if(range <= UINT32_MAX) return 4;
+    return 8;
+}
+
+inline uint64_t packed_get(const char* packed, size_t width, size_t i) {
+    switch(width) {
+        case 0: return 0;
+        case 1: return (uint8_t)packed[i];
+        case 2: { uint16_t v; memcpy(&v, packed + 2 * i, 2); return v; }
+        default: { uint32_t v; memcpy(&v, packed + 4 * i, 4); return v; }
+    }
+}
+
+inline void packed_set(char* packed, size_t width, size_t i, uint64_t v) {
+    switch(width) {
+        case 0: break;
+        case 1: packed[i] = (char)(uint8_t)v; break;
+        case 2: { uint16_t w = v; memcpy(packed + 2 * i, &w, 2); break; }
+        default: { uint32_t w = v; memcpy(packed + 4 * i, &w, 4); break; }
+    }
+}
+
+/** how many runs of equal values there are, comparing bits so doubles round trip exactly */
+template<class T> size_t chunk_runs(const T* values, size_t n) {
+    size_t runs = n > 0 ? 1 : 0;
+    for (size_t i = 1; i < n; i++)
+    {
+        if(memcmp(values + i, values + i - 1, sizeof(T)) != 0) runs++;
+    }
+    return runs;
+}
+
+/**
+ * @brief Encodes values as packed offsets from a base. The offsets are either
+ * the values themselves (FOR) or the steps between them (delta).
+ */
+template<class T> class PackedInts {
+public:
+    int64_t base_; // the smallest value, or the smallest step
+    size_t width_;
+
+    // sizes up FOR over the values
+    void plan_for(const T* values, size_t n) {
+        int64_t min = values[0], max = values[0];
+        for (size_t i = 1; i < n; i++)
+        {
+            if(values[i] < min) min = values[i];
+            if(values[i] > max) max = values[i];
+        }
+        base_ = min;
+        width_ = packed_width(max - min);
+    }
+
+    // sizes up delta over the steps between values
+    void plan_delta(const T* values, size_t n) {
+        base_ = 0;
+        width_ = 0;
+        if(n < 2) return;
+        int64_t min = (int64_t)values[1] - values[0], max = min;
+        for (size_t i = 2; i < n; i++)
+        {
+            int64_t step = (int64_t)values[i] - values[i - 1];
+            if(step < min) min = step;
+            if(step > max) max = step;
+        }
+        base_ = min;
+        width_ = packed_width(max - min);
+    }
+
+    static size_t for_size(size_t width, size_t n) { return sizeof(int64_t) + sizeof(size_t) + width * n; }
+
+    // no checkpoints when every step is the same, any value is then a multiplication away
+    static size_t delta_checkpoints(size_t width, size_t n) {
+        return width == 0 || n == 0 ? 0 : (n - 1) / DELTA_CHECKPOINT;
+    }
+
+    static size_t delta_size(size_t width, size_t n) {
+        return sizeof(T) + sizeof(int64_t) + sizeof(size_t) + width * (n > 0 ? n - 1 : 0)
+            + sizeof(T) * delta_checkpoints(width, n);
+    }
+
+    void write_for(Serializer& s, const T* values, size_t n) {
+        s.write(&base_, sizeof(int64_t));
+        s.write_size(width_);
+        char* packed = new char[width_ * n + 1];
+        for (size_t i = 0; i < n; i++) packed_set(packed, width_, i, (int64_t)values[i] - base_);
+        s.write(packed, width_ * n);
+        delete[](packed);
+    }
+
+    void write_delta(Serializer& s, const T* values, size_t n) {
+        s.write(values, sizeof(T));
+        s.write(&base_, sizeof(int64_t));
+        s.write_size(width_);
+        char* packed = new char[width_ * n + 1];
+        for (size_t i = 1; i < n; i++) packed_set(packed, width_, i - 1, (int64_t)values[i] - values[i - 1] - base_);
+        s.write(packed, width_ * (n - 1));
+        delete[](packed);
+        for (size_t c = 1; c <= delta_checkpoints(width_, n); c++) s.write(values + c * DELTA_CHECKPOINT, sizeof(T));
+    }
+
+    static void read_for(Deserializer& d, size_t n, T* out) {
+        int64_t base = d.read<int64_t>();
+        size_t width = d.read_size();
+        const char* packed = d.read_bytes(width * n).data_;
+        for (size_t i = 0; i < n; i++) out[i] = (T)(base + (int64_t)packed_get(packed, width, i));
+    }
+
+    static T read_for_at(Deserializer& d, size_t n, size_t idx) {
+        int64_t base = d.read<int64_t>();
+        size_t width = d.read_size();
+        return (T)(base + (int64_t)packed_get(d.read_bytes(width * n).data_, width, idx));
+    }
+
+    static void read_delta(Deserializer& d, size_t n, T* out) {
+        T first = d.read<T>();
+        int64_t base = d.read<int64_t>();
+        size_t width = d.read_size();
+        const char* packed = d.read_bytes(width * (n - 1)).data_;
+        d.read_bytes(sizeof(T) * delta_checkpoints(width, n));
+        int64_t v = first;
+        out[0] = first;
+        for (size_t i = 1; i < n; i++)
+        {
+            v += base + (int64_t)packed_get(packed, width, i - 1);
+            out[i] = (T)v;
+        }
+    }
+
+    static T read_delta_at(Deserializer& d, size_t n, size_t idx) {
+        T first = d.read<T>();
+        int64_t base = d.read<int64_t>();
+        size_t width = d.read_size();
+        const char* packed = d.read_bytes(width * (n - 1)).data_;
+        if(width == 0) return (T)(first + base * (int64_t)idx);
+        const char* checkpoints = d.read_bytes(sizeof(T) * delta_checkpoints(width, n)).data_;
+        size_t from = idx / DELTA_CHECKPOINT * DELTA_CHECKPOINT;
+        T start = first;
+        if(from > 0) memcpy(&start, checkpoints + sizeof(T) * (from / DELTA_CHECKPOINT - 1), sizeof(T));
+        int64_t v = start;
+        for (size_t i = from; i < idx; i++) v += base + (int64_t)packed_get(packed, width, i);
+        return (T)v;
+    }
+};
+
+/** the size of the run length encoding of values with the given number of runs */
+template<class T> size_t rle_size(size_t runs) { return sizeof(size_t) + runs * (sizeof(T) + sizeof(uint32_t)); }
+
+// the run count, each run's value, then the index one past each run's end
+template<class T> void write_rle(Serializer& s, const T* values, size_t n, size_t runs) {
+    s.write_size(runs);
+    char* run_values = new char[sizeof(T) * runs];
+    uint32_t* ends = new uint32_t[runs];
+    size_t run = 0;
+    for (size_t i = 0; i < n; i++)
+    {
+        if(i > 0 && memcmp(values + i, values + i - 1, sizeof(T)) != 0) run++;
+        memcpy(run_values + sizeof(T) * run, values + i, sizeof(T));
+        ends[run] = i + 1;
+    }
+    s.write(run_values, sizeof(T) * runs);
+    s.write(ends, sizeof(uint32_t) * runs);
+    delete[](run_values);
+    delete[](ends);
+}
+
+template<class T> void read_rle(Deserializer& d, T* out) {
+    size_t runs = d.read_size();
+    const char* run_values = d.read_bytes(sizeof(T) * runs).data_;
+    const char* ends = d.read_bytes(sizeof(uint32_t) * runs).data_;
+    size_t i = 0;
+    for (size_t run = 0; run < runs; run++)
+    {
+        T v;
+        uint32_t end;
+        memcpy(&v, run_values + sizeof(T) * run, sizeof(T));
+        memcpy(&end, ends + sizeof(uint32_t) * run, sizeof(uint32_t));
+        for (; i < end; i++) out[i] = v;
+    }
+}
+
+// binary searches the run ends for the run holding idx
+template<class T> T read_rle_at(Deserializer& d, size_t idx) {
+    size_t runs = d.read_size();
+    const char* run_values = d.read_bytes(sizeof(T) * runs).data_;
+    const char* ends = d.read_bytes(sizeof(uint32_t) * runs).data_;
+    size_t lo = 0, hi = runs - 1;
+    while(lo < hi) {
+        size_t mid = (lo + hi) / 2;
+        uint32_t end;
+        memcpy(&end, ends + sizeof(uint32_t) * mid, sizeof(uint32_t));
+        if(idx < end) hi = mid;
+        else lo = mid + 1;
+    }
+    T v;
+    memcpy(&v, run_values + sizeof(T) * lo, sizeof(T));
+    return v;
+}
+
+/**
+ * @brief writes the header and then the n values in the smallest encoding for them
+ */
+template<class T> void encode_chunk(Serializer& s, const T* values, size_t n) {
+    // ties go to the encodings that are quickest to read one value of
+    ChunkEncoding enc = CHUNK_PLAIN;
+    size_t best = sizeof(T) * n;
+    PackedInts<T> fr, delta;
+    if constexpr (chunk_packs_integers<T>()) {
+        if(n > 0) {
+            fr.plan_for(values, n);
+            if(PackedInts<T>::for_size(fr.width_, n) < best) {
+                enc = CHUNK_FOR;
+                best = PackedInts<T>::for_size(fr.width_, n);
+            }
+        }
+    }
+    size_t runs = chunk_runs(values, n);
+    if(rle_size<T>(runs) < best) {
+        enc = CHUNK_RLE;
+        best = rle_size<T>(runs);
+    }
+    if constexpr (chunk_packs_integers<T>()) {
+        if(n > 0) {
+            // reading one value of a delta encoding is a short walk, so it has to be worth it
+            delta.plan_delta(values, n);
+            size_t delta_size = PackedInts<T>::delta_size(delta.width_, n);
+            if(delta.width_ <= 4 && (delta.width_ == 0 ? delta_size < best : delta_size * 2 <= best)) {
+                enc = CHUNK_DELTA;
+                best = delta_size;
+            }
+        }
+    }
+
+    s.write_size(CHUNK_FORMAT_VERSION << 8 | enc);
+    switch(enc) {
+        case CHUNK_RLE: write_rle(s, values, n, runs); break;
+        case CHUNK_FOR:
+            if constexpr (chunk_packs_integers<T>()) fr.write_for(s, values, n);
+            break;
+        case CHUNK_DELTA:
+            if constexpr (chunk_packs_integers<T>()) delta.write_delta(s, values, n);
+            break;
+        default: s.write(values, sizeof(T) * n); break;
+    }
+}
+
+/** reads the header written by encode_chunk */
+inline ChunkEncoding read_chunk_encoding(Deserializer& d) {
+    size_t header = d.read_size();
+    assert(header >> 8 == CHUNK_FORMAT_VERSION);
+    return (ChunkEncoding)(header & 0xff);
+}
+
+/**
+ * @brief decodes the n values written by encode_chunk into out, leaving d just past them
+ */
+template<class T> void decode_chunk(Deserializer& d, size_t n, T* out) {
+    ChunkEncoding enc = read_chunk_encoding(d);
+    if(n == 0) return;
+    switch(enc) {
+        case CHUNK_RLE: read_rle(d, out); return;
+        case CHUNK_FOR:
+            if constexpr (chunk_packs_integers<T>()) { PackedInts<T>::read_for(d, n, out); return; }
+            break;
+        case CHUNK_DELTA:
+            if constexpr (chunk_packs_integers<T>()) { PackedInts<T>::read_delta(d, n, out); return; }
+            break;
+        case CHUNK_PLAIN:
+            memcpy(out, d.read_bytes(sizeof(T) * n).data_, sizeof(T) * n);
+            return;
+    }
+    assert(false);
+}
+
+/**
+ * @brief the value at idx of the n written by encode_chunk, decoding only what it takes to find it
+ */
+template<class T> T decode_chunk_at(Deserializer& d, size_t n, size_t idx) {
+    assert(idx < n);
+    ChunkEncoding enc = read_chunk_encoding(d);
+    switch(enc) {
+        case CHUNK_RLE: return read_rle_at<T>(d, idx);
+        case CHUNK_FOR:
+            if constexpr (chunk_packs_integers<T>()) return PackedInts<T>::read_for_at(d, n, idx);
+            break;
+        case CHUNK_DELTA:
+            if constexpr (chunk_packs_integers<T>()) return PackedInts<T>::read_delta_at(d, n, idx);
+            break;
+        case CHUNK_PLAIN: {
+            d.read_bytes(sizeof(T) * idx);
+            return d.read<T>();
+        }
+    }
+    assert(false);
+    return T();
+}
@@ -50,6 +50,18 @@ public:
                 s.p("Fail for key ").p(dynamic_cast<Fail *>(m)->k_->name_)
                  .p(" in node ").p(dynamic_cast<Fail *>(m)->k_->idx_);
                 break;
+            case MsgType::MultiGet:
+                s.p("MultiGet for ").p(dynamic_cast<MultiGet *>(m)->count()).p(" keys");
+                break;
+            case MsgType::MultiPut:
+                s.p("MultiPut for ").p(dynamic_cast<MultiPut *>(m)->count()).p(" keys");
+                break;
+            case MsgType::MultiStatus:
+                s.p("MultiStatus with ").p(dynamic_cast<MultiStatus *>(m)->count()).p(" values");
+                break;
+            case MsgType::Reduce:
+                s.p("Reduce of ").p(dynamic_cast<Reduce *>(m)->count()).p(" keys");
+                break;
             default:
                 assert(false);
                 return;
@@ -0,0 +1,50 @@
+#pragma once
+
+#include <assert.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "object.h"
+
+/*************************************************************************
+ * MappedFile::
+ *
+ * A whole file mapped read-only into memory, so it can be scanned in place
+ * without reading it into buffers first. The bytes are not null terminated.
+ * An empty file maps to no bytes at all.
+ */
+class MappedFile : public Object {
+public:
+    int fd_;
+    const char* data_; // owned - the mapping, unmapped on destruction
+    size_t size_;
+
+    MappedFile(const char* path) {
+        fd_ = open(path, O_RDONLY);
+        assert(fd_ >= 0);
+        struct stat st;
+        assert(fstat(fd_, &st) == 0);
+        size_ = st.st_size;
+        data_ = nullptr;
+        if(size_ == 0) return;
+        void* map = mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd_, 0);
+        assert(map != MAP_FAILED);
+        madvise(map, size_, MADV_SEQUENTIAL); // readers go front to back, so let the kernel read ahead
+        data_ = static_cast<const char*>(map);
+    }
+
+    ~MappedFile() {
+        if(data_ != nullptr) munmap(const_cast<char*>(data_), size_);
+        close(fd_);
+    }
+
+    /** The first byte of the file. */
+    const char* begin() { return data_; }
+
+    /** One past the last byte of the file. */
+    const char* end() { return data_ + size_; }
+
+    size_t size() { return size_; }
+};
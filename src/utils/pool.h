@@ -0,0 +1,262 @@
+#pragma once
+
+#include <assert.h>
+#include <atomic>
+#include <thread>
+
+#include "object.h"
+#include "thread.h"
+
+#define TASK_QUEUE_CAPACITY 64 // starting room in each worker's queue, a power of 2
+
+class TaskGroup;
+
+/**
+ * @brief A piece of work for a ThreadPool. Subclasses fill in run().
+ */
+class Task : public Object {
+public:
+    TaskGroup* group_; // external - set when the task is submitted
+
+    Task() { group_ = nullptr; }
+
+    virtual void run() { assert(false); }
+};
+
+/**
+ * @brief Tasks that are waited on together. Must outlive every task submitted with it.
+ */
+class TaskGroup : public Object {
+public:
+    Lock lock_;
+    std::atomic<size_t> pending_;
+
+    TaskGroup() { pending_ = 0; }
+
+    void add() { pending_++; }
+
+    /** marks one task as finished, waking the waiter if it was the last */
+    void done() {
+        lock_.lock();
+        pending_--;
+        if(pending_ == 0) lock_.notify_all();
+        lock_.unlock();
+    }
+
+    bool finished() { return pending_ == 0; }
+};
+
+/**
+ * @brief One worker's tasks, a ring buffer that grows when it fills.
+ * The worker takes its newest task from the back, other workers steal the oldest from the front.
+ */
+class TaskQueue : public Object {
+public:
+    Lock lock_;
+    Task** tasks_; // owned, elements external
+    size_t capacity_; // always a power of 2
+    size_t head_; // the oldest task
+    size_t count_;
+
+    TaskQueue() {
+        capacity_ = TASK_QUEUE_CAPACITY;
+        tasks_ = new Task*[capacity_];
+        head_ = 0;
+        count_ = 0;
+    }
+
+    ~TaskQueue() {
+        delete[](tasks_);
+    }
+
+    void push(Task* t) {
+        lock_.lock();
+        if(count_ == capacity_) grow_();
+        tasks_[(head_ + count_) & (capacity_ - 1)] = t;
+        count_++;
+        lock_.unlock();
+    }
+
+    /** takes the newest task, nullptr if there isn't one */
+    Task* pop() {
+        lock_.lock();
+        Task* t = nullptr;
+        if(count_ > 0) {
+            count_--;
+            t = tasks_[(head_ + count_) & (capacity_ - 1)];
+        }
+        lock_.unlock();
+        return t;
+    }
+
+    /** takes the oldest task, nullptr if there isn't one */
+    Task* steal() {
+        lock_.lock();
+        Task* t = nullptr;
+        if(count_ > 0) {
+            t = tasks_[head_];
+            head_ = (head_ + 1) & (capacity_ - 1);
+            count_--;
+        }
+        lock_.unlock();
+        return t;
+    }
+
+    void grow_() {
+        Task** tasks = new Task*[capacity_ * 2];
+        for (size_t i = 0; i < count_; i++) tasks[i] = tasks_[(head_ + i) & (capacity_ - 1)];
+        delete[](tasks_);
+        tasks_ = tasks;
+        capacity_ *= 2;
+        head_ = 0;
+    }
+};
+
+class ThreadPool;
+
+class PoolWorker : public Thread {
+public:
+    ThreadPool* pool_; // external
+    size_t idx_;
+
+    PoolWorker(ThreadPool* pool, size_t idx) {
+        pool_ = pool;
+        idx_ = idx;
+    }
+
+    void run();
+};
+
+/**
+ * @brief A fixed set of threads that run submitted tasks, kept alive between uses.
+ * Each worker has its own queue and steals from the others once it runs dry, so uneven
+ * tasks even out. Threads waiting on a group run queued tasks while they wait.
+ */
+class ThreadPool : public Object {
+public:
+    size_t size_;
+    TaskQueue** queues_; // owned, elements owned - one per worker
+    PoolWorker** workers_; // owned, elements owned
+    Lock idle_; // workers with nothing to do sleep on this
+    std::atomic<size_t> queued_; // tasks submitted but not yet taken
+    Counter next_queue_; // where the next task from outside the pool goes
+    bool running_;
+
+    /** the index of the worker running on this thread, -1 off the pool */
+    inline static thread_local int current_ = -1;
+
+    ThreadPool(size_t size) {
+        assert(size > 0);
+        size_ = size;
+        queued_ = 0;
+        running_ = true;
+        queues_ = new TaskQueue*[size_];
+        workers_ = new PoolWorker*[size_];
+        for (size_t i = 0; i < size_; i++) queues_[i] = new TaskQueue();
+        for (size_t i = 0; i < size_; i++)
+        {
+            workers_[i] = new PoolWorker(this, i);
+            workers_[i]->start();
+        }
+    }
+
+    ~ThreadPool() {
+        idle_.lock();
+        running_ = false;
+        idle_.notify_all();
+        idle_.unlock();
+        for (size_t i = 0; i < size_; i++)
+        {
+            workers_[i]->join();
+            delete(workers_[i]);
+            delete(queues_[i]);
+        }
+        delete[](workers_);
+        delete[](queues_);
+    }
+
+    /** the pool shared by the whole process, one worker per hardware thread */
+    static ThreadPool* shared() {
+        static ThreadPool pool(std::thread::hardware_concurrency() > 0 ? std::thread::hardware_concurrency() : 1);
+        return &pool;
+    }
+
+    size_t size() { return size_; }
+
+    /**
+     * @brief queues a task to run on the pool, on this worker's own queue if called from one
+     *
+     * @param t - the task, consumed once it has run
+     * @param g - the group it's waited on with
+     */
+    void submit(Task* t, TaskGroup* g) {
+        t->group_ = g;
+        g->add();
+        size_t q = current_ >= 0 ? current_ : next_queue_.next() % size_;
+        queues_[q]->push(t);
+        queued_++;
+        idle_.lock();
+        idle_.notify_one();
+        idle_.unlock();
+    }
+
+    /**
+     * @brief waits for every task in the group to finish, running queued tasks in the meantime
+     *
+     * @param g - the group
+     */
+    void wait(TaskGroup& g) {
+        while(true) {
+            // checked under the lock, so the last done() has let go of g before it can be deleted
+            g.lock_.lock();
+            bool finished = g.finished();
+            g.lock_.unlock();
+            if(finished) return;
+
+            Task* t = take_(current_ >= 0 ? current_ : 0);
+            if(t != nullptr) {
+                run_(t);
+                continue;
+            }
+            g.lock_.lock();
+            // wake up now and then in case there's work to help with
+            if(!g.finished()) g.lock_.wait_for(1);
+            g.lock_.unlock();
+        }
+    }
+
+    // the body of worker idx's thread
+    void work_(size_t idx) {
+        current_ = idx;
+        while(true) {
+            Task* t = take_(idx);
+            if(t != nullptr) {
+                run_(t);
+                continue;
+            }
+            idle_.lock();
+            while(running_ && queued_ == 0) idle_.wait();
+            bool running = running_;
+            idle_.unlock();
+            if(!running) return;
+        }
+    }
+
+    // the newest task on queue idx, or else the oldest on any other queue
+    Task* take_(size_t idx) {
+        if(queued_ == 0) return nullptr;
+        Task* t = queues_[idx]->pop();
+        for (size_t i = 1; t == nullptr && i < size_; i++) t = queues_[(idx + i) % size_]->steal();
+        if(t != nullptr) queued_--;
+        return t;
+    }
+
+    void run_(Task* t) {
+        TaskGroup* g = t->group_;
+        t->run();
+        delete(t);
+        g->done();
+    }
+};
+
+inline void PoolWorker::run() { pool_->work_(idx_); }
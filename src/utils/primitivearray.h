@@ -2,15 +2,21 @@
 
 #include <assert.h>
 #include <string.h>
+#include <stdint.h>
 
 #include "serial.h"
 #include "string.h"
+#include "aggregate.h"
+#include "bitmap.h"
+#include "encoding.h"
 
 #define STARTING_CAPACITY 8
 
 template <class T>
 class PrimitiveArrayChunk : public Serializable {
 public:
+    static const size_t VALUE_BITS = sizeof(T) * 8; // the space each value takes up
+
     T* data_; // owned
     size_t capacity_;
     size_t size_;
@@ -52,6 +58,15 @@ public:
 
     PrimitiveArrayChunk<T>* clone() { return new PrimitiveArrayChunk<T>(this); }
 
+    /** the count, sum, min, max, mean and variance of the values */
+    Aggregate aggregate() { return aggregate_of(data_, size_); }
+
+    /** the values in a plain array, borrowed */
+    const T* values() { return data_; }
+
+    /** copies the values out into the given array, which has room for count() of them */
+    void copy_to(T* out) { memcpy(out, data_, sizeof(T) * size_); }
+
     virtual bool equals(PrimitiveArrayChunk<T>* other) {
         if(other == nullptr) return false;
         if(other->size_ != size_) return false;
@@ -63,55 +78,226 @@ public:
     }
 
     SerialString* serialize() {
-        size_t size = sizeof(size_t) + sizeof(size_t) + (sizeof(T) * capacity_);
-        char* serial = new char[size];
-        size_t pos = 0;
-        
-        // capacity
-        memcpy(serial + pos, &capacity_, sizeof(capacity_));
-        pos += sizeof(size_t);
-
-        // size
-        memcpy(serial + pos, &size_, sizeof(size_t));
-        pos += sizeof(size_t);
-
-        // data
-        memcpy(serial + pos, (void*)data_, sizeof(T) * capacity_);
-        pos += sizeof(T) * capacity_;
-
-        SerialString* s = new SerialString(serial, pos);
-        delete[](serial);
+        Serializer s;
+        serialize_into(s);
+        return s.to_serial();
+    }
 
-        return s;
+    /** only the values in use are written, encoded as compactly as they allow, see encode_chunk */
+    void serialize_into(Serializer& s) {
+        s.write_size(capacity_);
+        s.write_size(size_);
+        encode_chunk(s, data_, size_);
     }
 
     static PrimitiveArrayChunk<T>* deserialize(SerialString* serialized) {
-        size_t pos = 0;
+        Deserializer d(serialized);
+        return deserialize(d);
+    }
 
-        // capacity
-        size_t cap;
-        memcpy(&cap, serialized->data_ + pos, sizeof(size_t));
-        pos += sizeof(size_t);
+    static PrimitiveArrayChunk<T>* deserialize(Deserializer& d) {
+        size_t cap = d.read_size();
         assert(cap != 0);
 
         PrimitiveArrayChunk<T>* chunk = new PrimitiveArrayChunk<T>(cap);
-        
-        // size
-        memcpy(&chunk->size_, serialized->data_ + pos, sizeof(size_t));
-        pos += sizeof(size_t);
+        chunk->size_ = d.read_size();
+        assert(chunk->size_ <= cap);
+        decode_chunk(d, chunk->size_, chunk->data_);
+        return chunk;
+    }
+
+    static T quick_deserialize(SerialString* serialized, size_t idx) {
+        return quick_deserialize(SerialView(serialized), idx);
+    }
+
+    /** decodes just the value at idx, or as little past it as the chunk's encoding allows */
+    static T quick_deserialize(SerialView serialized, size_t idx) {
+        Deserializer d(serialized);
+        d.read_size();
+        size_t count = d.read_size();
+        return decode_chunk_at<T>(d, count, idx);
+    }
+
+    /**
+     * @brief the values of a serialized chunk, read where they are instead of copied out
+     * 
+     * @param serialized - the chunk's bytes
+     * @param count - set to how many values the chunk holds
+     * @return const T* - the values, borrowed from serialized. nullptr if they were encoded or aren't aligned for T
+     */
+    static const T* quick_view(SerialView serialized, size_t* count) {
+        Deserializer d(serialized);
+        size_t cap = d.read_size();
+        *count = d.read_size();
+        assert(*count <= cap);
+        if(read_chunk_encoding(d) != CHUNK_PLAIN) return nullptr;
+        const char* data = d.read_bytes(sizeof(T) * *count).data_;
+        if(reinterpret_cast<uintptr_t>(data) % alignof(T) != 0) return nullptr;
+        return reinterpret_cast<const T*>(data);
+    }
+
+    /** copies a serialized chunk's values out into the given array, which has room for all of them */
+    static void quick_copy(SerialView serialized, T* out) {
+        Deserializer d(serialized);
+        d.read_size();
+        size_t count = d.read_size();
+        decode_chunk(d, count, out);
+    }
+
+    /** the aggregate of a serialized chunk's values, read where they are if they're plain and aligned */
+    static Aggregate quick_aggregate(SerialView serialized) {
+        size_t count;
+        const T* values = quick_view(serialized, &count);
+        if(values != nullptr) return aggregate_of(values, count);
+        T* copy = new T[count];
+        quick_copy(serialized, copy);
+        Aggregate a = aggregate_of(copy, count);
+        delete[](copy);
+        return a;
+    }
+};
+
+/**
+ * @brief Bools are packed 64 to a word, so a chunk of them takes an eighth of the space it would
+ * as bytes, and counting or combining them goes a word at a time.
+ * Only the words in use are serialized.
+ */
+template <>
+class PrimitiveArrayChunk<bool> : public Serializable {
+public:
+    static const size_t VALUE_BITS = 1;
+
+    uint64_t* words_; // owned - bits past size_ are 0
+    size_t capacity_;
+    size_t size_;
+
+    PrimitiveArrayChunk(size_t capacity) {
+        capacity_ = capacity;
+        words_ = new uint64_t[bitmap_words(capacity_)];
+        memset(words_, 0, bitmap_words(capacity_) * sizeof(uint64_t));
+        size_ = 0;
+    }
+
+    PrimitiveArrayChunk(PrimitiveArrayChunk<bool>* chunk) : PrimitiveArrayChunk(chunk->capacity_) {
+        memcpy(words_, chunk->words_, bitmap_words(chunk->size_) * sizeof(uint64_t));
+        size_ = chunk->size_;
+    }
+
+    virtual ~PrimitiveArrayChunk() {
+        delete[](words_);
+    }
+
+    size_t count() { return size_; }
+
+    /** how many of the values are true */
+    size_t trues() { return bitmap_count(words_, size_); }
+
+    virtual bool push_back(bool v) {
+        if(size_ == capacity_) return false;
+        bitmap_set(words_, size_++, v);
+        return true;
+    }
+
+    virtual void set(size_t idx, bool v) {
+        assert(idx < size_);
+        bitmap_set(words_, idx, v);
+    }
+
+    bool get(size_t idx) {
+        assert(idx < size_);
+        return bitmap_get(words_, idx);
+    }
+
+    PrimitiveArrayChunk<bool>* clone() { return new PrimitiveArrayChunk<bool>(this); }
 
-        // data
-        memcpy(chunk->data_, serialized->data_ + pos, sizeof(T) * chunk->capacity_);
-        pos += sizeof(T) * chunk->capacity_;
+    virtual bool equals(PrimitiveArrayChunk<bool>* other) {
+        if(other == nullptr) return false;
+        if(other->size_ != size_) return false;
+        return memcmp(words_, other->words_, bitmap_words(size_) * sizeof(uint64_t)) == 0;
+    }
 
+    Aggregate aggregate() { return aggregate_of_trues(trues(), size_); }
+
+    /** bools aren't kept as a plain array, see copy_to */
+    const bool* values() { return nullptr; }
+
+    void copy_to(bool* out) {
+        for (size_t i = 0; i < size_; i++) out[i] = bitmap_get(words_, i);
+    }
+
+    SerialString* serialize() {
+        Serializer s;
+        serialize_into(s);
+        return s.to_serial();
+    }
+
+    void serialize_into(Serializer& s) {
+        s.write_size(capacity_);
+        s.write_size(size_);
+        s.write(words_, bitmap_words(size_) * sizeof(uint64_t));
+    }
+
+    static PrimitiveArrayChunk<bool>* deserialize(SerialString* serialized) {
+        Deserializer d(serialized);
+        return deserialize(d);
+    }
+
+    static PrimitiveArrayChunk<bool>* deserialize(Deserializer& d) {
+        size_t cap = d.read_size();
+        assert(cap != 0);
+
+        PrimitiveArrayChunk<bool>* chunk = new PrimitiveArrayChunk<bool>(cap);
+        chunk->size_ = d.read_size();
+        assert(chunk->size_ <= cap);
+        size_t bytes = bitmap_words(chunk->size_) * sizeof(uint64_t);
+        memcpy(chunk->words_, d.read_bytes(bytes).data_, bytes);
         return chunk;
     }
 
-    static T quick_deserialize(SerialString* serialized, size_t idx) {
-        // skip capacity, size, and elements before idx
-        size_t pos = sizeof(size_t) + sizeof(size_t) + sizeof(T) * idx;
+    static bool quick_deserialize(SerialString* serialized, size_t idx) {
+        return quick_deserialize(SerialView(serialized), idx);
+    }
 
-        return ((T*)(serialized->data_ + pos))[0];
+    static bool quick_deserialize(SerialView serialized, size_t idx) {
+        // skip capacity, size, and the words before idx's
+        size_t pos = sizeof(size_t) + sizeof(size_t) + sizeof(uint64_t) * (idx / BITMAP_WORD_BITS);
+        assert(pos + sizeof(uint64_t) <= serialized.size_);
+
+        uint64_t word;
+        memcpy(&word, serialized.data_ + pos, sizeof(uint64_t));
+        return (word >> (idx % BITMAP_WORD_BITS)) & 1;
+    }
+
+    /** bools can't be read in place as a plain array, so this is always nullptr, see quick_copy */
+    static const bool* quick_view(SerialView serialized, size_t* count) {
+        Deserializer d(serialized);
+        d.read_size();
+        *count = d.read_size();
+        return nullptr;
+    }
+
+    static void quick_copy(SerialView serialized, bool* out) {
+        Deserializer d(serialized);
+        PrimitiveArrayChunk<bool>* chunk = deserialize(d);
+        chunk->copy_to(out);
+        delete(chunk);
+    }
+
+    /** counts the trues of a serialized chunk a word at a time, without copying it */
+    static Aggregate quick_aggregate(SerialView serialized) {
+        Deserializer d(serialized);
+        d.read_size();
+        size_t count = d.read_size();
+        const char* bytes = d.read_bytes(bitmap_words(count) * sizeof(uint64_t)).data_;
+        size_t trues = 0;
+        for (size_t i = 0; i < bitmap_words(count); i++)
+        {
+            uint64_t word;
+            memcpy(&word, bytes + i * sizeof(uint64_t), sizeof(uint64_t));
+            if(i == count / BITMAP_WORD_BITS) word &= bitmap_tail_mask(count);
+            trues += __builtin_popcountll(word);
+        }
+        return aggregate_of_trues(trues, count);
     }
 };
 
@@ -157,16 +343,36 @@ public:
     }
 
     virtual void grow() {
-        if(chunks_ == capacity_) {
-            capacity_ *= 2;
-            PrimitiveArrayChunk<T>** new_data = new PrimitiveArrayChunk<T>*[capacity_];
-            memcpy(new_data, data_, chunks_ * sizeof(PrimitiveArrayChunk<T>*));
-            delete[](data_);
-            data_ = new_data;
-        }
+        make_room_();
         data_[chunks_++] = new PrimitiveArrayChunk<T>(chunk_size_);
     }
 
+    /**
+     * @brief moves other's chunks onto the end of this array, leaving other empty. This array's chunks must
+     * all be full, or it must hold nothing, so each value lands at the index it would have if pushed back.
+     */
+    void take_chunks(PrimitiveArray<T>* other) {
+        assert(other->chunk_size_ == chunk_size_);
+        if(chunks_ == 1 && data_[0]->count() == 0) delete(data_[--chunks_]);
+        assert(chunks_ == 0 || data_[chunks_ - 1]->count() == chunk_size_);
+        for (size_t i = 0; i < other->chunks_; i++)
+        {
+            make_room_();
+            data_[chunks_++] = other->data_[i];
+        }
+        other->chunks_ = 0;
+        other->grow();
+    }
+
+    void make_room_() {
+        if(chunks_ < capacity_) return;
+        capacity_ *= 2;
+        PrimitiveArrayChunk<T>** new_data = new PrimitiveArrayChunk<T>*[capacity_];
+        memcpy(new_data, data_, chunks_ * sizeof(PrimitiveArrayChunk<T>*));
+        delete[](data_);
+        data_ = new_data;
+    }
+
     virtual void push_back(T v) {
         if(data_[chunks_ - 1]->push_back(v)) return;
         grow();
@@ -190,6 +396,17 @@ public:
 
     virtual PrimitiveArray<T>* clone() { return new PrimitiveArray<T>(this); }
 
+    /** the count, sum, min, max, mean and variance of every value, a chunk at a time */
+    Aggregate aggregate() {
+        Aggregate a;
+        for (size_t i = 0; i < chunks_; i++)
+        {
+            Aggregate chunk = data_[i]->aggregate();
+            a.merge(chunk);
+        }
+        return a;
+    }
+
     virtual bool equals(PrimitiveArray<T>* other) {
         if(other == nullptr) return false;
         if(other->count() != count()) return false;
@@ -201,88 +418,177 @@ public:
     }
 
     virtual SerialString* serialize() {
-        size_t serialized_chunk_size = sizeof(size_t) + sizeof(size_t) + (sizeof(T) * chunk_size_) + (sizeof(bool) * chunk_size_);
-        char* serial = new char[sizeof(size_t) + sizeof(size_t) + (serialized_chunk_size * chunks_) + 1];
-        serial[sizeof(size_t) + sizeof(size_t) + (serialized_chunk_size * chunks_)] = '\0';
-        size_t pos = 0;
-
-        // chunks
-        memcpy(&serial[pos], &chunks_, sizeof(size_t));
-        pos += sizeof(size_t);
-
-        // chunk size
-        memcpy(&serial[pos], &chunk_size_, sizeof(size_t));
-        pos += sizeof(size_t);
+        Serializer s;
+        serialize_into(s);
+        return s.to_serial();
+    }
 
-        // data
+    virtual void serialize_into(Serializer& s) {
+        s.write_size(chunks_);
+        s.write_size(chunk_size_);
         for (size_t i = 0; i < chunks_; i++) {
-            SerialString* serialized_chunk = data_[i]->serialize();
-            memcpy(&serial[pos], serialized_chunk->data_, serialized_chunk->size_);
-            pos += serialized_chunk->size_;
-            delete(serialized_chunk);
+            data_[i]->serialize_into(s);
         }
-
-        SerialString* s = new SerialString(serial, pos);
-        delete[](serial);
-        
-        return s;
     }
 
     static PrimitiveArray<T>* deserialize(SerialString* serialized) {
-        size_t chunks;
-        size_t chunk_size;
-        size_t pos = 0;
-        
-        // chunks
-        memcpy(&chunks, &serialized->data_[pos], sizeof(size_t));
-        pos += sizeof(size_t);
-
-        // chunk size
-        memcpy(&chunk_size, &serialized->data_[pos], sizeof(size_t));
-        pos += sizeof(size_t);
+        Deserializer d(serialized);
+        return deserialize(d);
+    }
 
-        PrimitiveArray<T>* arr = new PrimitiveArray<T>(chunk_size, chunks * 2);
+    static PrimitiveArray<T>* deserialize(Deserializer& d) {
+        size_t chunks = d.read_size();
+        size_t chunk_size = d.read_size();
 
-        // data
-        size_t serialized_chunk_size = sizeof(size_t) + sizeof(size_t) + (sizeof(T) * arr->chunk_size_) + (sizeof(bool) * arr->chunk_size_);
+        PrimitiveArray<T>* arr = new PrimitiveArray<T>(chunk_size, chunks * 2);
         for (size_t i = 0; i < chunks; i++) {
-            SerialString* serial = new SerialString(&serialized->data_[pos], serialized_chunk_size);
-            arr->data_[arr->chunks_++] = PrimitiveArrayChunk<T>::deserialize(serial);
-            pos += serialized_chunk_size;
-            delete(serial);
+            arr->data_[arr->chunks_++] = PrimitiveArrayChunk<T>::deserialize(d);
         }
-
         return arr;
     }
 };
 
-class StringArrayChunk : public PrimitiveArrayChunk<String *> {
+/** the schema type of the values the aggregate kernels take */
+template<class T> char elem_type();
+template<> inline char elem_type<int>() { return 'I'; }
+template<> inline char elem_type<double>() { return 'F'; }
+template<> inline char elem_type<bool>() { return 'B'; }
+
+/** the aggregate of a serialized chunk holding values of the given type */
+inline Aggregate aggregate_chunk(char type, SerialView serialized) {
+    switch(type) {
+        case 'I': return PrimitiveArrayChunk<int>::quick_aggregate(serialized);
+        case 'F': return PrimitiveArrayChunk<double>::quick_aggregate(serialized);
+        case 'B': return PrimitiveArrayChunk<bool>::quick_aggregate(serialized);
+        default:
+            assert(false);
+            return Aggregate();
+    }
+}
+
+#define STRING_VIEW_BLOCK 1024 // views are made this many at a time, so they never move once handed out
+#define STRING_IDENTITY_CODES 0xff // sent in place of a code width when string i is entry i, so no codes follow
+
+/**
+ * @brief Strings kept as a dictionary of the distinct ones plus a code per string saying which
+ * entry it is. The entries sit back to back in one byte heap, each with its terminator, with an
+ * array of where each one starts. It is laid out the same way serialized, codes packed as narrow
+ * as they allow, so any string can be found in O(1) either way, a whole chunk is read in with
+ * one copy of the heap, and a column with few distinct strings costs little more than its codes.
+ * get returns a view: a String pointing into the heap rather than owning its characters,
+ * good for as long as the chunk is. Views are repointed if the heap moves.
+ */
+class StringArrayChunk : public Serializable {
 public:
-    StringArrayChunk(size_t capacity) : PrimitiveArrayChunk<String *>(capacity) {}
-
-    StringArrayChunk(StringArrayChunk* chunk) : PrimitiveArrayChunk<String *>(chunk->capacity_) {
-        for (size_t i = 0; i < chunk->size_; i++)
+    size_t capacity_;
+    size_t size_;
+    uint32_t* codes_; // owned - the entry each string is
+    size_t entries_;
+    size_t entries_capacity_;
+    uint32_t* offsets_; // owned - entry i is heap_[offsets_[i]] up to offsets_[i + 1], entries_ + 1 of them in use
+    char* heap_; // owned
+    size_t heap_capacity_;
+    uint32_t* slots_; // owned - hash table from entries to their code + 1, 0 if empty. Built when first needed
+    size_t slot_count_;
+    String** views_; // owned, as are the blocks of views, made as they're needed. The views don't own their characters
+
+    StringArrayChunk(size_t capacity) {
+        capacity_ = capacity;
+        size_ = 0;
+        codes_ = new uint32_t[capacity_];
+        entries_ = 0;
+        entries_capacity_ = 16;
+        offsets_ = new uint32_t[entries_capacity_ + 1];
+        offsets_[0] = 0;
+        heap_capacity_ = 64;
+        heap_ = new char[heap_capacity_];
+        slots_ = nullptr;
+        slot_count_ = 0;
+        views_ = new String*[capacity_ / STRING_VIEW_BLOCK + 1];
+        memset(views_, 0, sizeof(String*) * (capacity_ / STRING_VIEW_BLOCK + 1));
+    }
+
+    StringArrayChunk(StringArrayChunk* chunk) : StringArrayChunk(chunk->capacity_) {
+        load_dictionary_(chunk->entries_, chunk->offsets_, chunk->heap_);
+        memcpy(codes_, chunk->codes_, sizeof(uint32_t) * chunk->size_);
+        load_codes_(chunk->size_);
+    }
+
+    virtual ~StringArrayChunk() {
+        for (size_t b = 0; b <= capacity_ / STRING_VIEW_BLOCK; b++)
         {
-            push_back(chunk->get(i));
+            if(views_[b] == nullptr) continue;
+            // the characters are the heap's, not the views'
+            for (size_t i = 0; i < STRING_VIEW_BLOCK; i++) views_[b][i].steal();
+            delete[](views_[b]);
         }
+        delete[](views_);
+        delete[](codes_);
+        delete[](offsets_);
+        delete[](heap_);
+        if(slots_ != nullptr) delete[](slots_);
     }
 
-    // strings are owned
-    ~StringArrayChunk() {
-        for (size_t i = 0; i < size_; i++) {
-            delete(data_[i]);
-        }
+    size_t count() { return size_; }
+
+    /** the number of distinct strings in the dictionary */
+    size_t entries() { return entries_; }
+
+    /** the bytes the dictionary's strings take up in the heap, terminators included */
+    size_t heap_size() { return offsets_[entries_]; }
+
+    /** which dictionary entry the string at idx is. Strings are equal exactly when their codes are */
+    uint32_t code(size_t idx) {
+        assert(idx < size_);
+        return codes_[idx];
+    }
+
+    /** the codes of the strings from idx on, borrowed */
+    const uint32_t* codes(size_t idx) { return codes_ + idx; }
+
+    /**
+     * @brief looks up the code of a string
+     * 
+     * @param s - the string
+     * @param code - set to its code if it is in the dictionary
+     * @return true - if some string in the chunk equals s
+     */
+    bool find(String* s, uint32_t* code) {
+        build_slots_();
+        size_t slot = find_slot_(s->size() > 0 ? s->c_str() : "", s->size());
+        if(slots_[slot] == 0) return false;
+        *code = slots_[slot] - 1;
+        return true;
     }
 
+    /** copies the string into the dictionary if it isn't there already, the chunk doesn't keep v */
     bool push_back(String* v) {
-        return PrimitiveArrayChunk<String *>::push_back(v->clone());
+        if(size_ == capacity_) return false;
+        codes_[size_++] = intern_(v);
+        point_view_(size_ - 1);
+        return true;
     }
 
+    /** makes the string at idx another entry, the old one stays in the dictionary */
     void set(size_t idx, String* v) {
-        PrimitiveArrayChunk<String *>::set(idx, v->clone());
+        assert(idx < size_);
+        codes_[idx] = intern_(v);
+        point_view_(idx);
+    }
+
+    /** a view of the string at idx, owned by the chunk */
+    String* get(size_t idx) {
+        assert(idx < size_);
+        return &views_[idx / STRING_VIEW_BLOCK][idx % STRING_VIEW_BLOCK];
     }
 
-    bool equals(PrimitiveArrayChunk<String *>* other) {
+    /**
+     * @brief the views of the strings from idx on, next to each other in memory up to the end of
+     * idx's block of STRING_VIEW_BLOCK, owned by the chunk
+     */
+    String* views(size_t idx) { return get(idx); }
+
+    bool equals(StringArrayChunk* other) {
         if(other == nullptr) return false;
         if(other->size_ != size_) return false;
         for (size_t i = 0; i < size_; i++)
@@ -295,94 +601,213 @@ public:
     StringArrayChunk* clone() { return new StringArrayChunk(this); }
 
     SerialString* serialize() {
-        // data
-        SerialString** serial_data = new SerialString*[size_];
-        size_t data_size = 0;
-        for (size_t i = 0; i < size_; i++)
-        {
-            serial_data[i] = get(i)->serialize();
-            data_size += serial_data[i]->size_;
-        }
-
-        char* serial = new char[sizeof(size_t) + sizeof(size_t) + data_size];
-        size_t pos = 0;
-        
-        // capacity
-        memcpy(serial + pos, &capacity_, sizeof(size_t));
-        pos += sizeof(size_t);
+        Serializer s;
+        serialize_into(s);
+        return s.to_serial();
+    }
 
-        // size
-        memcpy(serial + pos, &size_, sizeof(size_t));
-        pos += sizeof(size_t);
+    /** the capacity and count, the dictionary as its size, offsets and heap, then the codes */
+    void serialize_into(Serializer& s) {
+        s.write_size(capacity_);
+        s.write_size(size_);
+        s.write_size(entries_);
+        s.write(offsets_, sizeof(uint32_t) * (entries_ + 1));
+        s.write(heap_, heap_size());
 
-        // data
+        bool identity = entries_ == size_;
+        uint32_t max = 0;
         for (size_t i = 0; i < size_; i++)
         {
-            memcpy(&serial[pos], serial_data[i]->data_, serial_data[i]->size_);
-            pos += serial_data[i]->size_;
-            delete(serial_data[i]);
+            if(codes_[i] != i) identity = false;
+            if(codes_[i] > max) max = codes_[i];
         }
-        delete[](serial_data);
-
-        SerialString* s = new SerialString(serial, pos);
-        delete[](serial);
-
-        return s;
+        if(identity) {
+            s.write_size(STRING_IDENTITY_CODES);
+            return;
+        }
+        size_t width = packed_width(max);
+        s.write_size(width);
+        char* packed = new char[width * size_ + 1];
+        for (size_t i = 0; i < size_; i++) packed_set(packed, width, i, codes_[i]);
+        s.write(packed, width * size_);
+        delete[](packed);
     }
 
     static StringArrayChunk* deserialize(SerialString* serialized) {
-        size_t pos = 0;
+        Deserializer d(serialized);
+        return deserialize(d);
+    }
 
-        // capacity
-        size_t cap;
-        memcpy(&cap, &serialized->data_[pos], sizeof(size_t));
-        pos += sizeof(size_t);
+    static StringArrayChunk* deserialize(Deserializer& d) {
+        size_t cap = d.read_size();
         assert(cap != 0);
+        size_t sz = d.read_size();
+        assert(sz <= cap);
+        size_t entries = d.read_size();
 
         StringArrayChunk* chunk = new StringArrayChunk(cap);
-        
-        // size
-        memcpy(&chunk->size_, &serialized->data_[pos], sizeof(size_t));
-        pos += sizeof(size_t);
+        const uint32_t* offsets = reinterpret_cast<const uint32_t*>(d.read_bytes(sizeof(uint32_t) * (entries + 1)).data_);
+        uint32_t heap_size;
+        memcpy(&heap_size, offsets + entries, sizeof(uint32_t));
+        chunk->load_dictionary_(entries, offsets, d.read_bytes(heap_size).data_);
+
+        size_t width = d.read_size();
+        if(width == STRING_IDENTITY_CODES) {
+            for (size_t i = 0; i < sz; i++) chunk->codes_[i] = i;
+        } else {
+            const char* packed = d.read_bytes(width * sz).data_;
+            for (size_t i = 0; i < sz; i++) chunk->codes_[i] = packed_get(packed, width, i);
+        }
+        chunk->load_codes_(sz);
+        return chunk;
+    }
 
-        // data
-        for (size_t i = 0; i < chunk->size_; i++)
+    /**
+     * @brief the characters of the string at idx of a serialized chunk, read where they are
+     * 
+     * @param serialized - the chunk's bytes
+     * @param idx - which string
+     * @param len - set to its length
+     * @return const char* - the string, zero terminated and borrowed from serialized
+     */
+    static const char* quick_view(SerialView serialized, size_t idx, size_t* len) {
+        Deserializer d(serialized);
+        d.read_size();
+        size_t sz = d.read_size();
+        assert(idx < sz);
+        size_t entries = d.read_size();
+        SerialView offsets = d.read_bytes(sizeof(uint32_t) * (entries + 1));
+        uint32_t heap_size;
+        memcpy(&heap_size, offsets.data_ + sizeof(uint32_t) * entries, sizeof(uint32_t));
+        const char* heap = d.read_bytes(heap_size).data_;
+
+        size_t width = d.read_size();
+        size_t code = width == STRING_IDENTITY_CODES ? idx : packed_get(d.read_bytes(width * sz).data_, width, idx);
+        assert(code < entries);
+        uint32_t start, end;
+        memcpy(&start, offsets.data_ + sizeof(uint32_t) * code, sizeof(uint32_t));
+        memcpy(&end, offsets.data_ + sizeof(uint32_t) * (code + 1), sizeof(uint32_t));
+        *len = end - start - 1;
+        return heap + start;
+    }
+
+    static String* quick_deserialize(SerialString* serialized, size_t idx) {
+        return quick_deserialize(SerialView(serialized), idx);
+    }
+
+    /** a copy of the string at idx of a serialized chunk, owned by the caller */
+    static String* quick_deserialize(SerialView serialized, size_t idx) {
+        size_t len;
+        const char* str = quick_view(serialized, idx, &len);
+        return new String(str, len);
+    }
+
+    // takes on the given dictionary, only into an empty chunk
+    void load_dictionary_(size_t entries, const uint32_t* offsets, const char* heap) {
+        assert(size_ == 0 && entries_ == 0);
+        reserve_entries_(entries);
+        memcpy(offsets_, offsets, sizeof(uint32_t) * (entries + 1));
+        assert(offsets_[0] == 0);
+        reserve_heap_(offsets_[entries]);
+        entries_ = entries;
+        memcpy(heap_, heap, offsets_[entries_]);
+    }
+
+    // takes on the first sz codes, already in codes_
+    void load_codes_(size_t sz) {
+        size_ = sz;
+        for (size_t i = 0; i < size_; i++)
         {
-            SerialString* sub_ss = new SerialString(serialized->data_ + pos, serialized->size_ - pos);
-            String* str = String::deserialize(sub_ss);
-            pos += str->size() + sizeof(size_t);
+            assert(codes_[i] < entries_);
+            point_view_(i);
+        }
+    }
 
-            chunk->set(i, str);
-            delete(str);
-            delete(sub_ss);
+    // the code of the given string, adding it to the dictionary if it's new
+    uint32_t intern_(String* v) {
+        build_slots_();
+        size_t len = v->size();
+        size_t slot = find_slot_(len > 0 ? v->c_str() : "", len);
+        if(slots_[slot] != 0) return slots_[slot] - 1;
+
+        reserve_entries_(entries_ + 1);
+        reserve_heap_(offsets_[entries_] + len + 1);
+        // v could be one of our own views, so its characters are only looked at once the heap is settled
+        if(len > 0) memcpy(heap_ + offsets_[entries_], v->c_str(), len);
+        heap_[offsets_[entries_] + len] = 0;
+        offsets_[entries_ + 1] = offsets_[entries_] + len + 1;
+        uint32_t code = entries_++;
+        slots_[slot] = code + 1;
+        if(entries_ * 2 > slot_count_) rehash_(slot_count_ * 2);
+        return code;
+    }
+
+    static size_t hash_bytes_(const char* str, size_t len) {
+        size_t hash = 0;
+        for (size_t i = 0; i < len; ++i) hash = str[i] + (hash << 6) + (hash << 16) - hash;
+        return hash;
+    }
+
+    // the slot holding the given string, or the empty one it would go in
+    size_t find_slot_(const char* str, size_t len) {
+        size_t slot = hash_bytes_(str, len) & (slot_count_ - 1);
+        while(slots_[slot] != 0) {
+            uint32_t c = slots_[slot] - 1;
+            if(offsets_[c + 1] - offsets_[c] - 1 == len && memcmp(heap_ + offsets_[c], str, len) == 0) return slot;
+            slot = (slot + 1) & (slot_count_ - 1);
         }
+        return slot;
+    }
 
-        return chunk;
+    void build_slots_() {
+        if(slots_ != nullptr) return;
+        size_t count = 64;
+        while(count < entries_ * 2) count *= 2;
+        rehash_(count);
     }
 
-    static String* quick_deserialize(SerialString* serialized, size_t idx) {
-        size_t pos = 0;
-
-        // skip capacity
-        pos += sizeof(size_t);
-        
-        // size
-        size_t sz;
-        memcpy(&sz, &serialized->data_[pos], sizeof(size_t));
-        pos += sizeof(size_t);
-
-        // jump through data until we reach the index
-        size_t str_sz;
-        while(idx > 0) {
-            str_sz = ((size_t*)&serialized->data_[pos])[0];
-            pos += str_sz + sizeof(size_t);
-            idx--;
+    // rebuilds the hash table with the given number of slots, a power of 2
+    void rehash_(size_t count) {
+        if(slots_ != nullptr) delete[](slots_);
+        slot_count_ = count;
+        slots_ = new uint32_t[slot_count_];
+        memset(slots_, 0, sizeof(uint32_t) * slot_count_);
+        for (size_t c = 0; c < entries_; c++)
+        {
+            slots_[find_slot_(heap_ + offsets_[c], offsets_[c + 1] - offsets_[c] - 1)] = c + 1;
         }
-        
-        // grab the string
-        str_sz = ((size_t*)&serialized->data_[pos])[0];
-        pos += sizeof(size_t);
-        return new String(&serialized->data_[pos], str_sz);
+    }
+
+    void reserve_entries_(size_t entries) {
+        if(entries <= entries_capacity_) return;
+        while(entries_capacity_ < entries) entries_capacity_ *= 2;
+        uint32_t* offsets = new uint32_t[entries_capacity_ + 1];
+        memcpy(offsets, offsets_, sizeof(uint32_t) * (entries_ + 1));
+        delete[](offsets_);
+        offsets_ = offsets;
+    }
+
+    // makes room for the given number of bytes in the heap, repointing the views if it moves
+    void reserve_heap_(size_t bytes) {
+        assert(bytes <= UINT32_MAX);
+        if(bytes <= heap_capacity_) return;
+        while(heap_capacity_ < bytes) heap_capacity_ *= 2;
+        char* heap = new char[heap_capacity_];
+        memcpy(heap, heap_, offsets_[entries_]);
+        delete[](heap_);
+        heap_ = heap;
+        for (size_t i = 0; i < size_; i++) point_view_(i);
+    }
+
+    // points the view of string i at its entry in the heap, making its block if need be
+    void point_view_(size_t i) {
+        String*& block = views_[i / STRING_VIEW_BLOCK];
+        if(block == nullptr) block = new String[STRING_VIEW_BLOCK];
+        String& view = block[i % STRING_VIEW_BLOCK];
+        uint32_t c = codes_[i];
+        view.cstr_ = heap_ + offsets_[c];
+        view.size_ = offsets_[c + 1] - offsets_[c] - 1;
+        view.hash_ = 0;
     }
 };
 
@@ -427,16 +852,36 @@ public:
     }
 
     virtual void grow() {
-        if(chunks_ == capacity_) {
-            capacity_ *= 2;
-            StringArrayChunk** new_data = new StringArrayChunk*[capacity_];
-            memcpy(new_data, data_, chunks_ * sizeof(StringArrayChunk*));
-            delete[](data_);
-            data_ = new_data;
-        }
+        make_room_();
         data_[chunks_++] = new StringArrayChunk(chunk_size_);
     }
 
+    /**
+     * @brief moves other's chunks onto the end of this array, leaving other empty. This array's chunks must
+     * all be full, or it must hold nothing, so each value lands at the index it would have if pushed back.
+     */
+    void take_chunks(StringArray* other) {
+        assert(other->chunk_size_ == chunk_size_);
+        if(chunks_ == 1 && data_[0]->count() == 0) delete(data_[--chunks_]);
+        assert(chunks_ == 0 || data_[chunks_ - 1]->count() == chunk_size_);
+        for (size_t i = 0; i < other->chunks_; i++)
+        {
+            make_room_();
+            data_[chunks_++] = other->data_[i];
+        }
+        other->chunks_ = 0;
+        other->grow();
+    }
+
+    void make_room_() {
+        if(chunks_ < capacity_) return;
+        capacity_ *= 2;
+        StringArrayChunk** new_data = new StringArrayChunk*[capacity_];
+        memcpy(new_data, data_, chunks_ * sizeof(StringArrayChunk*));
+        delete[](data_);
+        data_ = new_data;
+    }
+
     virtual void push_back(String* v) {
         if(data_[chunks_ - 1]->push_back(v)) return;
         grow();
@@ -471,70 +916,39 @@ public:
     }
 
     virtual SerialString* serialize() {
-        SerialString** chunk_serial = new SerialString*[chunks_];
-        size_t chunks_size = 0;
-        for (size_t i = 0; i < chunks_; i++)
-        {
-            chunk_serial[i] = data_[i]->serialize();
-            chunks_size += chunk_serial[i]->size_;
-        }
-        
-
-        char* serial = new char[sizeof(size_t) + sizeof(size_t) + chunks_size];
-        size_t pos = 0;
-
-        // chunks
-        memcpy(&serial[pos], &chunks_, sizeof(size_t));
-        pos += sizeof(size_t);
+        Serializer s;
+        serialize_into(s);
+        return s.to_serial();
+    }
 
-        // chunk size
-        memcpy(&serial[pos], &chunk_size_, sizeof(size_t));
-        pos += sizeof(size_t);
+    virtual void serialize_into(Serializer& s) {
+        s.write_size(chunks_);
+        s.write_size(chunk_size_);
 
-        // data
+        // each chunk is prefixed with its size
         for (size_t i = 0; i < chunks_; i++)
         {
-            memcpy(&serial[pos], &chunk_serial[i]->size_, sizeof(size_t));
-            pos += sizeof(size_t);
-
-            memcpy(&serial[pos], chunk_serial[i]->data_, chunk_serial[i]->size_);
-            pos += chunk_serial[i]->size_;
-            delete(chunk_serial[i]);
+            size_t at = s.reserve_size();
+            size_t start = s.size();
+            data_[i]->serialize_into(s);
+            s.patch_size(at, s.size() - start);
         }
-        delete[](chunk_serial);
-        
-        SerialString* s = new SerialString(serial, pos);
-        delete[](serial);
-        return s;
     }
 
     static StringArray* deserialize(SerialString* serialized) {
-        size_t chunks;
-        size_t chunk_size;
-        size_t pos = 0;
-        
-        // chunks
-        memcpy(&chunks, &serialized->data_[pos], sizeof(size_t));
-        pos += sizeof(size_t);
-
-        // chunk size
-        memcpy(&chunk_size, &serialized->data_[pos], sizeof(size_t));
-        pos += sizeof(size_t);
+        Deserializer d(serialized);
+        return deserialize(d);
+    }
 
-        StringArray* arr = new StringArray(chunk_size, chunks * 2);
+    static StringArray* deserialize(Deserializer& d) {
+        size_t chunks = d.read_size();
+        size_t chunk_size = d.read_size();
 
-        // data
+        StringArray* arr = new StringArray(chunk_size, chunks * 2);
         for (size_t i = 0; i < chunks; i++) {
-            size_t size;
-            memcpy(&size, &serialized->data_[pos], sizeof(size_t));
-            pos += sizeof(size_t);
-
-            SerialString* s = new SerialString(&serialized->data_[pos], size);
-            arr->data_[arr->chunks_++] = StringArrayChunk::deserialize(s);
-            pos += s->size_;
-            delete(s);
+            Deserializer chunk_d(d.read_bytes(d.read_size()));
+            arr->data_[arr->chunks_++] = StringArrayChunk::deserialize(chunk_d);
         }
-
         return arr;
     }
 };
\ No newline at end of file
@@ -2,6 +2,9 @@
 
 #pragma once
 
+#include <assert.h>
+#include <sys/uio.h>
+
 #include "object.h"
 
 class SerialString {
@@ -35,9 +38,240 @@ public:
 	}
 };
 
+/**
+ * @brief A borrowed look at serialized bytes. Doesn't own or copy them, so it must not outlive them.
+ */
+class SerialView {
+public:
+	const char* data_; // external
+	size_t size_;
+
+	SerialView(const char* data, size_t size) {
+		data_ = data;
+		size_ = size;
+	}
+
+	SerialView(SerialString* ss) : SerialView(ss->data_, ss->size_) { }
+
+	/** the bytes from pos to the end */
+	SerialView sub(size_t pos) { return SerialView(data_ + pos, size_ - pos); }
+
+	/** len bytes starting at pos */
+	SerialView sub(size_t pos, size_t len) { return SerialView(data_ + pos, len); }
+
+	/** an owned copy of the bytes */
+	SerialString* copy() { return new SerialString(data_, size_); }
+};
+
+/**
+ * @brief Reads fields off of a view in the order they were written.
+ */
+class Deserializer {
+public:
+	SerialView view_;
+	size_t pos_;
+
+	Deserializer(SerialView view) : view_(view) {
+		pos_ = 0;
+	}
+
+	Deserializer(SerialString* ss) : Deserializer(SerialView(ss)) { }
+
+	template<class T> T read() {
+		assert(pos_ + sizeof(T) <= view_.size_);
+		T t;
+		memcpy(&t, view_.data_ + pos_, sizeof(T));
+		pos_ += sizeof(T);
+		return t;
+	}
+
+	size_t read_size() { return read<size_t>(); }
+
+	/** borrows the next len bytes */
+	SerialView read_bytes(size_t len) {
+		assert(pos_ + len <= view_.size_);
+		SerialView v = view_.sub(pos_, len);
+		pos_ += len;
+		return v;
+	}
+
+	/** borrows everything that hasn't been read yet */
+	SerialView rest() { return read_bytes(remaining()); }
+
+	size_t remaining() { return view_.size_ - pos_; }
+};
+
+#define SERIAL_BORROW_MIN 4096 // payloads at least this big are referenced where they are instead of copied
+
+/**
+ * @brief Builds a serialized form in one growable buffer that can be reused between messages.
+ * Large payloads can be borrowed rather than copied, in which case the result is a list of
+ * iovecs for writev/sendmsg and the borrowed bytes must stay alive until it has been written.
+ */
+class Serializer {
+public:
+	char* buf_; // owned
+	size_t size_; // bytes in buf_
+	size_t capacity_;
+	size_t mark_; // start of the part of buf_ not yet in a segment
+	// segments in order, a borrowed segment has a pointer, a buffered one has nullptr and an offset into buf_
+	const char** seg_data_; // owned, elements external
+	size_t* seg_off_; // owned
+	size_t* seg_len_; // owned
+	size_t segs_;
+	size_t seg_capacity_;
+	size_t borrowed_; // total bytes borrowed
+	iovec* iov_; // owned, filled in by iov()
+
+	Serializer() {
+		capacity_ = 256;
+		buf_ = new char[capacity_];
+		seg_capacity_ = 8;
+		seg_data_ = new const char*[seg_capacity_];
+		seg_off_ = new size_t[seg_capacity_];
+		seg_len_ = new size_t[seg_capacity_];
+		iov_ = new iovec[seg_capacity_];
+		clear();
+	}
+
+	~Serializer() {
+		delete[](buf_);
+		delete[](seg_data_);
+		delete[](seg_off_);
+		delete[](seg_len_);
+		delete[](iov_);
+	}
+
+	/** forgets everything written, keeping the memory for the next use */
+	void clear() {
+		size_ = 0;
+		mark_ = 0;
+		segs_ = 0;
+		borrowed_ = 0;
+	}
+
+	/** the total number of bytes written or borrowed */
+	size_t size() { return size_ + borrowed_; }
+
+	void write(const void* data, size_t len) {
+		if(size_ + len > capacity_) {
+			while(size_ + len > capacity_) capacity_ *= 2;
+			char* buf = new char[capacity_];
+			memcpy(buf, buf_, size_);
+			delete[](buf_);
+			buf_ = buf;
+		}
+		memcpy(buf_ + size_, data, len);
+		size_ += len;
+	}
+
+	void write_size(size_t v) { write(&v, sizeof(size_t)); }
+
+	/**
+	 * @brief leaves room for a size_t to be filled in by patch_size once it's known
+	 * 
+	 * @return size_t - where it goes
+	 */
+	size_t reserve_size() {
+		size_t at = size_;
+		write_size(0);
+		return at;
+	}
+
+	void patch_size(size_t at, size_t v) { memcpy(buf_ + at, &v, sizeof(size_t)); }
+
+	/**
+	 * @brief adds the given bytes without copying them if they're big enough to be worth it
+	 * 
+	 * @param data - the bytes, external. Must stay alive until this is written out or cleared
+	 * @param len - how many bytes
+	 */
+	void borrow(const char* data, size_t len) {
+		if(len < SERIAL_BORROW_MIN) {
+			write(data, len);
+			return;
+		}
+		close_();
+		add_seg_(data, 0, len);
+		borrowed_ += len;
+	}
+
+	/**
+	 * @brief the serialized form as a list of iovecs, owned by this serializer
+	 * 
+	 * @param out - set to the list
+	 * @return size_t - how many iovecs there are
+	 */
+	size_t iov(iovec** out) {
+		close_();
+		for (size_t i = 0; i < segs_; i++)
+		{
+			iov_[i].iov_base = (void*)(seg_data_[i] != nullptr ? seg_data_[i] : buf_ + seg_off_[i]);
+			iov_[i].iov_len = seg_len_[i];
+		}
+		*out = iov_;
+		return segs_;
+	}
+
+	/** an owned copy of the serialized form, for when it can't be written out directly */
+	SerialString* to_serial() {
+		if(segs_ == 0) return new SerialString(buf_, size_);
+		iovec* vs;
+		size_t n = iov(&vs);
+		char* arr = new char[size()];
+		size_t pos = 0;
+		for (size_t i = 0; i < n; i++)
+		{
+			memcpy(arr + pos, vs[i].iov_base, vs[i].iov_len);
+			pos += vs[i].iov_len;
+		}
+		SerialString* ss = new SerialString(arr, pos);
+		delete[](arr);
+		return ss;
+	}
+
+	// ends the current buffered segment
+	void close_() {
+		if(size_ == mark_) return;
+		add_seg_(nullptr, mark_, size_ - mark_);
+		mark_ = size_;
+	}
+
+	void add_seg_(const char* data, size_t off, size_t len) {
+		if(segs_ == seg_capacity_) {
+			seg_capacity_ *= 2;
+			const char** d = new const char*[seg_capacity_];
+			size_t* o = new size_t[seg_capacity_];
+			size_t* l = new size_t[seg_capacity_];
+			memcpy(d, seg_data_, segs_ * sizeof(const char*));
+			memcpy(o, seg_off_, segs_ * sizeof(size_t));
+			memcpy(l, seg_len_, segs_ * sizeof(size_t));
+			delete[](seg_data_);
+			delete[](seg_off_);
+			delete[](seg_len_);
+			delete[](iov_);
+			seg_data_ = d;
+			seg_off_ = o;
+			seg_len_ = l;
+			iov_ = new iovec[seg_capacity_];
+		}
+		seg_data_[segs_] = data;
+		seg_off_[segs_] = off;
+		seg_len_[segs_] = len;
+		segs_++;
+	}
+};
+
 class Serializable {
 public:
 	virtual SerialString* serialize() { return nullptr; }
+
+	/** appends the serialized form to the given serializer, copying it by default */
+	virtual void serialize_into(Serializer& s) {
+		SerialString* ss = serialize();
+		s.write(ss->data_, ss->size_);
+		delete(ss);
+	}
 };
 
 class SerializableObject : public Object, public Serializable {
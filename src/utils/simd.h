@@ -0,0 +1,34 @@
+#pragma once
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define SIMD_X86
+#endif
+
+// instruction sets the vectorized kernels can use, each one implies the ones before it
+#define SIMD_SCALAR 0
+#define SIMD_SSE41 1
+#define SIMD_AVX2 2
+
+/** the best instruction set this cpu supports */
+inline int simd_detect() {
+#ifdef SIMD_X86
+    if(__builtin_cpu_supports("avx2")) return SIMD_AVX2;
+    if(__builtin_cpu_supports("sse4.1")) return SIMD_SSE41;
+#endif
+    return SIMD_SCALAR;
+}
+
+inline int& simd_level_() {
+    static int level = simd_detect();
+    return level;
+}
+
+/** the instruction set the kernels use, the best supported one unless it's been lowered */
+inline int simd_level() { return simd_level_(); }
+
+/** makes the kernels use at most the given instruction set, e.g. to compare them. Can't go past what the cpu supports. */
+inline void set_simd_level(int level) {
+    int best = simd_detect();
+    simd_level_() = level < best ? level : best;
+}
@@ -26,7 +26,7 @@ public:
     String(char const* cstr, size_t len) {
        size_ = len;
        cstr_ = new char[size_ + 1];
-       memcpy(cstr_, cstr, size_ + 1);
+       memcpy(cstr_, cstr, size_);
        cstr_[size_] = 0; // terminate
     }
     /** Builds a string from a char*, steal must be true, we do not copy!
@@ -90,19 +90,25 @@ public:
     }
 
     SerialString* serialize() {
-        char* s = new char[size() + sizeof(size_t)];
-        memcpy(s, &size_, sizeof(size_t));
-        memcpy(s + sizeof(size_t), cstr_, size_);
+        Serializer s;
+        serialize_into(s);
+        return s.to_serial();
+    }
 
-        SerialString* serial = new SerialString(s, size_ + sizeof(size_t));
-        delete[](s);
-        return serial;
+    void serialize_into(Serializer& s) {
+        s.write_size(size_);
+        s.write(cstr_, size_);
     }
 
     static String* deserialize(SerialString* serial) {
-        size_t sz;
-        memcpy(&sz, serial->data_, sizeof(size_t));
-        return new String(serial->data_ + sizeof(size_t), sz);
+        Deserializer d(serial);
+        return deserialize(d);
+    }
+
+    static String* deserialize(Deserializer& d) {
+        size_t sz = d.read_size();
+        SerialView str = d.read_bytes(sz);
+        return new String(str.data_, sz);
     }
  };
 
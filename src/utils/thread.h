@@ -3,6 +3,7 @@
 #include <cstdlib>
 #include <thread>
 #include <mutex>
+#include <shared_mutex>
 #include <condition_variable>
 #include <sstream>
 #include <atomic>
@@ -30,6 +31,12 @@ public:
        std::this_thread::sleep_for(std::chrono::milliseconds(millis));
     }
 
+    /** Milliseconds on a monotonic clock, for measuring deadlines. */
+    static size_t now() {
+        return std::chrono::duration_cast<std::chrono::milliseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
     /** Subclass responsibility, the body of the run method */
     virtual void run() { assert(false); }
 
@@ -66,8 +73,35 @@ public:
      */
     void wait() { cv_.wait(mtx_); }
 
+    /** Like wait(), but gives up after millis milliseconds.
+     *  Returns false if no notification arrived in time. */
+    bool wait_for(size_t millis) {
+        return cv_.wait_for(mtx_, std::chrono::milliseconds(millis)) == std::cv_status::no_timeout;
+    }
+
     // Notify all threads waiting on this lock
     void notify_all() { cv_.notify_all(); }
+
+    // Notify a single thread waiting on this lock
+    void notify_one() { cv_.notify_one(); }
+};
+
+/** A lock that any number of readers can hold at once, or a single writer. */
+class RWLock : public Object {
+public:
+    std::shared_mutex mtx_;
+
+    /** Request exclusive ownership of this lock, waiting out every reader. */
+    void lock() { mtx_.lock(); }
+
+    /** Release exclusive ownership. */
+    void unlock() { mtx_.unlock(); }
+
+    /** Request shared ownership of this lock, only waits on a writer. */
+    void lock_shared() { mtx_.lock_shared(); }
+
+    /** Release shared ownership. */
+    void unlock_shared() { mtx_.unlock_shared(); }
 };
 
 /** A simple thread-safe counter. */
@@ -81,6 +115,10 @@ public:
         size_t r = next_++;
         return r;
     }
+    /** Claims n consecutive values at once, returning the first */
+    size_t reserve(size_t n) {
+        return next_.fetch_add(n);
+    }
     size_t prev() {
         size_t r = next_--;
         return r;
@@ -0,0 +1,105 @@
+#include <assert.h>
+
+#include "../../src/dataframe/distributed_dataframe.h"
+#include "../../src/utils/timer.h"
+#include "../test.h"
+
+#define BENCH_VALUES (1 << 16) // stays in cache, so it's the kernels being timed and not memory
+#define BENCH_REPS 2000
+#define BENCH_ROWS 1000000
+
+class BenchAggregate : public Test {
+public:
+    const char* level_name_(int level) {
+        switch(level) {
+            case SIMD_AVX2: return "avx2";
+            case SIMD_SSE41: return "sse4.1";
+            default: return "scalar";
+        }
+    }
+
+    template<class T> void time_kernel_(const char* type, T* values) {
+        double checksum = 0;
+        Timer t;
+        t.start();
+        for (size_t i = 0; i < BENCH_REPS; i++) checksum += aggregate_of(values, BENCH_VALUES).variance();
+        t.stop();
+        assert(checksum > 0);
+        p("aggregate_of ").p(type).p(", ").p(level_name_(simd_level())).p(": ")
+            .p((double)BENCH_VALUES * BENCH_REPS / (t.get_time_elapsed() / 1000)).pln(" values/sec");
+    }
+
+    /** Times the kernels at every instruction set level the cpu supports */
+    void bench_kernels() {
+        int* ints = new int[BENCH_VALUES];
+        double* doubles = new double[BENCH_VALUES];
+        bool* bools = new bool[BENCH_VALUES];
+        for (size_t i = 0; i < BENCH_VALUES; i++)
+        {
+            ints[i] = i * 7919 % 1000;
+            doubles[i] = ints[i] / 3.0;
+            bools[i] = ints[i] % 2 == 0;
+        }
+        int best = simd_level();
+        for (int level = SIMD_SCALAR; level <= best; level++)
+        {
+            set_simd_level(level);
+            time_kernel_("int", ints);
+            time_kernel_("double", doubles);
+            time_kernel_("bool", bools);
+        }
+        set_simd_level(best);
+        delete[](ints);
+        delete[](doubles);
+        delete[](bools);
+    }
+
+    /** Times summing a column spread over three nodes with aggregate, against a get_double loop */
+    void bench_distributed() {
+        args = new Args();
+        args->num_nodes = 3;
+        PseudoNetwork net(3);
+        KVStore** stores = new KVStore*[3];
+        for (size_t i = 0; i < 3; i++) stores[i] = new KVStore(i, &net);
+
+        double* arr = new double[BENCH_ROWS];
+        for (size_t i = 0; i < BENCH_ROWS; i++) arr[i] = i;
+        double expected = (double)BENCH_ROWS * (BENCH_ROWS - 1) / 2;
+        Key k("bench-aggregate", 0);
+        delete(DistributedDataFrame::fromArray(&k, stores[0], BENCH_ROWS, arr));
+        Value* v = stores[1]->waitAndGet(&k);
+        DistributedDataFrame* df = DistributedDataFrame::deserialize(v->serialized(), stores[1]);
+        delete(v);
+
+        Timer t;
+        t.start();
+        double sum = df->aggregate<double>(0).sum();
+        t.stop();
+        assert(sum == expected);
+        p("DistributedDataFrame aggregate sum: ").p(BENCH_ROWS / (t.get_time_elapsed() / 1000)).pln(" rows/sec");
+
+        t.restart();
+        sum = 0;
+        for (size_t i = 0; i < BENCH_ROWS; i++) sum += df->get_double(0, i);
+        t.stop();
+        assert(sum == expected);
+        p("DistributedDataFrame get_double sum: ").p(BENCH_ROWS / (t.get_time_elapsed() / 1000)).pln(" rows/sec");
+
+        delete(df);
+        delete[](arr);
+        for (size_t i = 0; i < 3; i++) delete(stores[i]);
+        delete[](stores);
+        delete(args);
+    }
+
+    bool run() {
+        bench_kernels();
+        bench_distributed();
+        return true;
+    }
+};
+
+int main() {
+    BenchAggregate bench;
+    bench.testSuccess();
+}
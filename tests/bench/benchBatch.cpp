@@ -0,0 +1,150 @@
+#include <assert.h>
+
+#include "../../src/dataframe/dataframe.h"
+#include "../../src/utils/timer.h"
+#include "../test.h"
+
+#define BENCH_ROWS 2000000
+
+/** Sums the double column a row at a time */
+class SumRower : public Rower {
+public:
+    double sum = 0;
+
+    bool accept(Row& r) {
+        sum += r.get_double(1);
+        delete(r.get_string(2));
+        return true;
+    }
+
+    void join_delete(Rower* other) {
+        sum += dynamic_cast<SumRower *>(other)->sum;
+        delete(other);
+    }
+
+    Object* clone() { return new SumRower(); }
+};
+
+/** Sums the double column a batch at a time */
+class SumBatcher : public Batcher {
+public:
+    double sum = 0;
+
+    void accept(ColumnBatch& b) {
+        const double* vals = b.doubles(1);
+        double s = 0;
+        for (size_t i = 0; i < b.count(); i++) s += vals[i];
+        sum += s;
+    }
+
+    void join_delete(Batcher* other) {
+        sum += dynamic_cast<SumBatcher *>(other)->sum;
+        delete(other);
+    }
+
+    Object* clone() { return new SumBatcher(); }
+};
+
+/** Keeps rows whose int is under a threshold, a row at a time */
+class UnderRower : public Rower {
+public:
+    bool accept(Row& r) { return r.get_int(0) < 100; }
+};
+
+/** Keeps rows whose int is under a threshold, a batch at a time */
+class UnderBatcher : public Batcher {
+public:
+    void accept(ColumnBatch& b) {
+        const int* vals = b.ints(0);
+        for (size_t i = 0; i < b.count(); i++) b.select(i, vals[i] < 100);
+    }
+};
+
+class BenchBatch : public Test {
+public:
+    DataFrame* df_;
+    double expected_;
+
+    BenchBatch() {
+        Schema s("IFS");
+        df_ = new DataFrame(s);
+        Row r(df_->get_schema());
+        String name("a short string");
+        expected_ = 0;
+        for (size_t i = 0; i < BENCH_ROWS; i++)
+        {
+            r.set(0, (int)(i % 1000));
+            r.set(1, (double)i);
+            r.set(2, &name);
+            df_->add_row(r);
+            expected_ += i;
+        }
+    }
+
+    ~BenchBatch() {
+        delete(df_);
+    }
+
+    /** Times summing one column of three with map against map_batch, and the same in parallel */
+    void bench_sum() {
+        Timer t;
+        SumRower rower;
+        t.start();
+        df_->map(rower);
+        t.stop();
+        assert(rower.sum == expected_);
+        p("DataFrame map sum: ").p(BENCH_ROWS / (t.get_time_elapsed() / 1000)).pln(" rows/sec");
+
+        SumBatcher batcher;
+        t.restart();
+        df_->map_batch(batcher);
+        t.stop();
+        assert(batcher.sum == expected_);
+        p("DataFrame map_batch sum: ").p(BENCH_ROWS / (t.get_time_elapsed() / 1000)).pln(" rows/sec");
+
+        SumRower prower;
+        t.restart();
+        df_->pmap(prower);
+        t.stop();
+        assert(prower.sum == expected_);
+        p("DataFrame pmap sum: ").p(BENCH_ROWS / (t.get_time_elapsed() / 1000)).pln(" rows/sec");
+
+        SumBatcher pbatcher;
+        t.restart();
+        df_->pmap_batch(pbatcher);
+        t.stop();
+        assert(pbatcher.sum == expected_);
+        p("DataFrame pmap_batch sum: ").p(BENCH_ROWS / (t.get_time_elapsed() / 1000)).pln(" rows/sec");
+    }
+
+    /** Times filter against filter_batch keeping a tenth of the rows */
+    void bench_filter() {
+        Timer t;
+        UnderRower rower;
+        t.start();
+        DataFrame* kept = df_->filter(rower);
+        t.stop();
+        assert(kept->nrows() == BENCH_ROWS / 10);
+        delete(kept);
+        p("DataFrame filter: ").p(BENCH_ROWS / (t.get_time_elapsed() / 1000)).pln(" rows/sec");
+
+        UnderBatcher batcher;
+        t.restart();
+        kept = df_->filter_batch(batcher);
+        t.stop();
+        assert(kept->nrows() == BENCH_ROWS / 10);
+        delete(kept);
+        p("DataFrame filter_batch: ").p(BENCH_ROWS / (t.get_time_elapsed() / 1000)).pln(" rows/sec");
+    }
+
+    bool run() {
+        bench_sum();
+        bench_filter();
+        return true;
+    }
+};
+
+int main() {
+    BenchBatch bench;
+    bench.testSuccess();
+}
@@ -0,0 +1,187 @@
+#include <assert.h>
+
+#include "../../src/dataframe/distributed_dataframe.h"
+#include "../../src/utils/timer.h"
+#include "../test.h"
+
+#define BENCH_ROWS 1000000
+#define BENCH_GETS 20000 // spread evenly over the rows, so most land in the chunk the last one did
+#define BENCH_CHUNKS 4 // chunks a scan takes turns reading from
+
+/** Writes ascending ids with uneven gaps, the kind of int column that gets delta encoded */
+class IdWriter : public Writer {
+public:
+    size_t i_ = 0;
+
+    void visit(Row& r) override { r.set(0, (int)(i_ * 3 + i_ % 5)); i_++; }
+
+    bool done() override { return i_ == BENCH_ROWS; }
+};
+
+class BenchDataFrame : public Test {
+public:
+    PseudoNetwork* net_;
+    KVStore** stores_;
+
+    BenchDataFrame() {
+        args = new Args();
+        args->num_nodes = 3;
+        net_ = new PseudoNetwork(3);
+        stores_ = new KVStore*[3];
+        for (size_t i = 0; i < 3; i++) stores_[i] = new KVStore(i, net_);
+    }
+
+    ~BenchDataFrame() {
+        for (size_t i = 0; i < 3; i++) delete(stores_[i]);
+        delete[](stores_);
+        delete(net_);
+        delete(args);
+    }
+
+    /** Times get_double over a column spread across three nodes, printing its rate and the bytes it copies */
+    void bench_get_double() {
+        double* arr = new double[BENCH_ROWS];
+        for (size_t i = 0; i < BENCH_ROWS; i++) arr[i] = i;
+        Key k("bench-df", 0);
+        delete(DistributedDataFrame::fromArray(&k, stores_[0], BENCH_ROWS, arr));
+
+        // read it from another node, like the demo's consumers do
+        Value* df_value = stores_[1]->waitAndGet(&k);
+        DistributedDataFrame* df = DistributedDataFrame::deserialize(df_value->serialized(), stores_[1]);
+        delete(df_value);
+
+        size_t stride = BENCH_ROWS / BENCH_GETS;
+        size_t copied = Value::bytes_copied();
+        Timer t;
+        t.start();
+        for (size_t i = 0; i < BENCH_GETS; i++)
+        {
+            assert(df->get_double(0, i * stride) == arr[i * stride]);
+        }
+        t.stop();
+        copied = Value::bytes_copied() - copied;
+
+        p("DistributedDataFrame get_double: ").p(BENCH_GETS / (t.get_time_elapsed() / 1000)).pln(" gets/sec");
+        p("DistributedDataFrame get_double: ").p((double)copied / BENCH_GETS).pln(" bytes copied per get");
+
+        delete(df);
+        delete[](arr);
+    }
+
+    /** Times get_double taking turns between rows in different remote chunks, printing the cache's counters */
+    void bench_alternating() {
+        double* arr = new double[BENCH_ROWS];
+        for (size_t i = 0; i < BENCH_ROWS; i++) arr[i] = i;
+        Key k("bench-df-alt", 0);
+        delete(DistributedDataFrame::fromArray(&k, stores_[0], BENCH_ROWS, arr));
+
+        Value* df_value = stores_[1]->waitAndGet(&k);
+        DistributedDataFrame* df = DistributedDataFrame::deserialize(df_value->serialized(), stores_[1]);
+        delete(df_value);
+
+        ChunkCache& cache = stores_[1]->cache_;
+        size_t hits = cache.hits_.next_;
+        size_t misses = cache.misses_.next_;
+        size_t apart = BENCH_ROWS / BENCH_CHUNKS;
+        Timer t;
+        t.start();
+        for (size_t i = 0; i < BENCH_GETS; i++)
+        {
+            size_t row = (i % BENCH_CHUNKS) * apart + i / BENCH_CHUNKS;
+            assert(df->get_double(0, row) == arr[row]);
+        }
+        t.stop();
+
+        p("DistributedDataFrame alternating get_double: ").p(BENCH_GETS / (t.get_time_elapsed() / 1000)).pln(" gets/sec");
+        p("DistributedDataFrame alternating get_double: ").p(cache.hits_.next_ - hits).p(" hits, ")
+            .p(cache.misses_.next_ - misses).p(" misses, ").p(cache.evictions_.next_).pln(" evictions");
+
+        delete(df);
+        delete[](arr);
+    }
+
+    /** Times get_int over every row of a delta encoded id column read from another node */
+    void bench_get_int_delta() {
+        Key k("bench-df-ids", 0);
+        IdWriter w;
+        delete(DistributedDataFrame::fromWriter(&k, stores_[0], "I", w));
+
+        Value* df_value = stores_[1]->waitAndGet(&k);
+        DistributedDataFrame* df = DistributedDataFrame::deserialize(df_value->serialized(), stores_[1]);
+        delete(df_value);
+
+        Timer t;
+        t.start();
+        for (size_t i = 0; i < BENCH_ROWS; i++)
+        {
+            assert(df->get_int(0, i) == (int)(i * 3 + i % 5));
+        }
+        t.stop();
+
+        p("DistributedDataFrame delta get_int: ").p(BENCH_ROWS / (t.get_time_elapsed() / 1000)).pln(" gets/sec");
+        p("DistributedDataFrame delta get_int: ").p(t.get_time_elapsed() * 1000000 / BENCH_ROWS).pln(" ns per get");
+
+        delete(df);
+    }
+
+    double scan_sum_(DistributedDataFrame* df) {
+        double sum = 0;
+        ChunkScan<double>* scan = df->scan<double>(0);
+        while(scan->next()) {
+            const double* data = scan->data();
+            for (size_t i = 0; i < scan->count(); i++) sum += data[i];
+        }
+        delete(scan);
+        return sum;
+    }
+
+    /** Sums a column read from another node with a chunk scan and with get_double, printing both rates */
+    void bench_scan() {
+        double* arr = new double[BENCH_ROWS];
+        for (size_t i = 0; i < BENCH_ROWS; i++) arr[i] = i;
+        Key k("bench-df-scan", 0);
+        delete(DistributedDataFrame::fromArray(&k, stores_[0], BENCH_ROWS, arr));
+
+        Value* df_value = stores_[1]->waitAndGet(&k);
+        DistributedDataFrame* df = DistributedDataFrame::deserialize(df_value->serialized(), stores_[1]);
+        delete(df_value);
+        double expected = (double)BENCH_ROWS * (BENCH_ROWS - 1) / 2;
+
+        Timer t;
+        t.start();
+        double sum = scan_sum_(df);
+        t.stop();
+        assert(sum == expected);
+        p("DistributedDataFrame scan sum: ").p(BENCH_ROWS / (t.get_time_elapsed() / 1000)).pln(" rows/sec");
+
+        // get_double leaves the remote chunks in the node's cache
+        t.restart();
+        sum = 0;
+        for (size_t i = 0; i < BENCH_ROWS; i++) sum += df->get_double(0, i);
+        t.stop();
+        assert(sum == expected);
+        p("DistributedDataFrame get_double sum: ").p(BENCH_ROWS / (t.get_time_elapsed() / 1000)).pln(" rows/sec");
+
+        t.restart();
+        sum = scan_sum_(df);
+        t.stop();
+        assert(sum == expected);
+        p("DistributedDataFrame scan sum, cached: ").p(BENCH_ROWS / (t.get_time_elapsed() / 1000)).pln(" rows/sec");
+
+        delete(df);
+        delete[](arr);
+    }
+
+    bool run() {
+        bench_get_double();
+        bench_alternating();
+        bench_get_int_delta();
+        bench_scan();
+        return true;
+    }
+};
+
+int main() {
+    BenchDataFrame bench;
+    bench.testSuccess();
+}
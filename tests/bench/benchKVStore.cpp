@@ -0,0 +1,109 @@
+#include <assert.h>
+
+#include "../../src/store/kvstore.h"
+#include "../../src/utils/timer.h"
+#include "../test.h"
+
+#define BENCH_KEYS 1000000
+#define STRESS_OPS 1000000 // split between the threads
+#define STRESS_PUT_EVERY 10 // one op in this many is a put, the rest are gets
+
+/** Hammers a store with a mix of gets and puts of keys that are already there */
+class StressThread : public Thread {
+public:
+    KVStore* store_;
+    Key** keys_; // external
+    size_t nkeys_;
+    size_t ops_;
+    size_t seed_;
+
+    StressThread(KVStore* store, Key** keys, size_t nkeys, size_t ops, size_t seed) {
+        store_ = store;
+        keys_ = keys;
+        nkeys_ = nkeys;
+        ops_ = ops;
+        seed_ = seed;
+    }
+
+    void run() {
+        SerialString ss("another value", 13);
+        Value v(&ss);
+        size_t x = seed_;
+        for (size_t i = 0; i < ops_; i++)
+        {
+            x = x * 6364136223846793005UL + 1442695040888963407UL;
+            Key* k = keys_[(x >> 33) % nkeys_];
+            if(i % STRESS_PUT_EVERY == 0) store_->put(k, &v);
+            else delete(store_->get(k));
+        }
+    }
+};
+
+class BenchKVStore : public Test {
+public:
+    /** Times putting then getting BENCH_KEYS local keys, printing the ops per second of each */
+    void bench() {
+        PseudoNetwork net(1);
+        KVStore store(0, &net);
+        SerialString ss("a small value", 13);
+        Value v(&ss);
+
+        Key** keys = new Key*[BENCH_KEYS];
+        char name[32];
+        for (size_t i = 0; i < BENCH_KEYS; i++)
+        {
+            snprintf(name, sizeof(name), "bench-c%zu", i);
+            keys[i] = new Key(name, 0);
+            keys[i]->hash(); // so hashing isn't timed
+        }
+
+        Timer t;
+        t.start();
+        for (size_t i = 0; i < BENCH_KEYS; i++) store.put(keys[i], &v);
+        t.stop();
+        double puts = BENCH_KEYS / (t.get_time_elapsed() / 1000);
+        assert(store.count() == BENCH_KEYS);
+
+        Timer t2;
+        t2.start();
+        for (size_t i = 0; i < BENCH_KEYS; i++) delete(store.get(keys[i]));
+        t2.stop();
+        double gets = BENCH_KEYS / (t2.get_time_elapsed() / 1000);
+
+        p("KVStore put: ").p(puts).pln(" ops/sec");
+        p("KVStore get: ").p(gets).pln(" ops/sec");
+
+        for (size_t threads = 1; threads <= 8; threads *= 2) stress(&store, keys, threads);
+
+        for (size_t i = 0; i < BENCH_KEYS; i++) delete(keys[i]);
+        delete[](keys);
+    }
+
+    /** Splits STRESS_OPS between the given number of threads and prints the total ops per second */
+    void stress(KVStore* store, Key** keys, size_t threads) {
+        StressThread** ts = new StressThread*[threads];
+        for (size_t i = 0; i < threads; i++)
+        {
+            ts[i] = new StressThread(store, keys, BENCH_KEYS, STRESS_OPS / threads, i + 1);
+        }
+        Timer t;
+        t.start();
+        for (size_t i = 0; i < threads; i++) ts[i]->start();
+        for (size_t i = 0; i < threads; i++) ts[i]->join();
+        t.stop();
+        for (size_t i = 0; i < threads; i++) delete(ts[i]);
+        delete[](ts);
+
+        p("KVStore stress with ").p(threads).p(" threads: ").p(STRESS_OPS / (t.get_time_elapsed() / 1000)).pln(" ops/sec");
+    }
+
+    bool run() {
+        bench();
+        return true;
+    }
+};
+
+int main() {
+    BenchKVStore bench;
+    bench.testSuccess();
+}
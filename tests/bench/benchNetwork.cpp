@@ -0,0 +1,87 @@
+#include <assert.h>
+
+#include "../../src/store/network.h"
+#include "../../src/utils/timer.h"
+#include "../test.h"
+
+#define BENCH_MESSAGES 10000
+
+/** Receives and discards a fixed number of messages */
+class ReceiverThread : public Thread {
+public:
+    NetworkIP* net_;
+    size_t count_;
+
+    ReceiverThread(NetworkIP* net, size_t count) {
+        net_ = net;
+        count_ = count;
+    }
+
+    void run() {
+        size_t received = 0;
+        while(received < count_) {
+            Message* m = net_->receive_message();
+            if(m == nullptr) continue;
+            delete(m);
+            received++;
+        }
+    }
+};
+
+class BenchNetworkIP : public Test {
+public:
+    /** Sets up a node of a two node network on localhost, without registering through a server */
+    void setup(NetworkIP& net, size_t idx, unsigned* ports) {
+        net.this_node_ = idx;
+        net.init_sock_(ports[idx]);
+        net.nodes_ = new NodeInfo[2];
+        net.init_nodes_(2);
+        for (size_t i = 0; i < 2; i++)
+        {
+            net.nodes_[i].id = i;
+            net.nodes_[i].address.sin_family = AF_INET;
+            net.nodes_[i].address.sin_port = htons(ports[i]);
+            inet_pton(AF_INET, "127.0.0.1", &net.nodes_[i].address.sin_addr);
+        }
+    }
+
+    /** Sends BENCH_MESSAGES gets from node 0 to node 1 and returns the messages per second */
+    double bench(bool persistent, unsigned base_port) {
+        unsigned ports[2] = { base_port, base_port + 1 };
+        NetworkIP sender;
+        NetworkIP receiver;
+        setup(sender, 0, ports);
+        setup(receiver, 1, ports);
+        sender.persistent_ = persistent;
+
+        ReceiverThread rt(&receiver, BENCH_MESSAGES);
+        rt.start();
+
+        Key k("bench", 1);
+        Timer t;
+        t.start();
+        for (size_t i = 0; i < BENCH_MESSAGES; i++)
+        {
+            Get* g = new Get(&k);
+            sender.send_message(g);
+        }
+        rt.join();
+        t.stop();
+
+        return BENCH_MESSAGES / (t.get_time_elapsed() / 1000);
+    }
+
+    bool run() {
+        double per_message = bench(false, 9400);
+        double persistent = bench(true, 9402);
+        p("NetworkIP connect per message: ").p(per_message).pln(" msgs/sec");
+        p("NetworkIP persistent connections: ").p(persistent).pln(" msgs/sec");
+        p("Speedup: ").p(persistent / per_message).pln("x");
+        return true;
+    }
+};
+
+int main() {
+    BenchNetworkIP bench;
+    bench.testSuccess();
+}
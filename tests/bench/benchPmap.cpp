@@ -0,0 +1,90 @@
+#include <assert.h>
+#include <math.h>
+#include <thread>
+
+#include "../../src/dataframe/dataframe.h"
+#include "../../src/utils/timer.h"
+#include "../test.h"
+
+#define BENCH_ROWS 2000000
+#define BENCH_REPS 5 // pmaps timed per pool size
+
+/** Does a little arithmetic on every row so there's something to split up */
+class WorkRower : public Rower {
+public:
+    double sum = 0;
+    size_t rows = 0;
+
+    bool accept(Row& r) {
+        sum += sqrt(r.get_double(1) * r.get_int(0));
+        rows++;
+        return true;
+    }
+
+    void join_delete(Rower* other) {
+        WorkRower* o = dynamic_cast<WorkRower *>(other);
+        sum += o->sum;
+        rows += o->rows;
+        delete(o);
+    }
+
+    Object* clone() { return new WorkRower(); }
+};
+
+class BenchPmap : public Test {
+public:
+    DataFrame* df_;
+
+    BenchPmap() {
+        Schema s("ID");
+        df_ = new DataFrame(s);
+        Row r(df_->get_schema());
+        for (size_t i = 0; i < BENCH_ROWS; i++)
+        {
+            r.set(0, (int)(i % 1000));
+            r.set(1, (double)i);
+            df_->add_row(r);
+        }
+    }
+
+    ~BenchPmap() {
+        delete(df_);
+    }
+
+    /** Times map and then pmap on pools of 1 up to one worker per hardware thread, printing rows/sec for each */
+    void bench_scaling() {
+        WorkRower seq;
+        Timer t;
+        t.start();
+        df_->map(seq);
+        t.stop();
+        p("DataFrame map: ").p(BENCH_ROWS / (t.get_time_elapsed() / 1000)).pln(" rows/sec");
+
+        size_t max = std::thread::hardware_concurrency() > 0 ? std::thread::hardware_concurrency() : 1;
+        for (size_t size = 1; ; size = size * 2 > max ? max : size * 2)
+        {
+            ThreadPool pool(size);
+            t.restart();
+            for (size_t i = 0; i < BENCH_REPS; i++)
+            {
+                WorkRower par;
+                df_->pmap(par, pool);
+                assert(par.rows == BENCH_ROWS);
+                assert(fabs(par.sum - seq.sum) <= 1e-9 * seq.sum);
+            }
+            t.stop();
+            p("DataFrame pmap, ").p(size).p(" workers: ").p(BENCH_ROWS * BENCH_REPS / (t.get_time_elapsed() / 1000)).pln(" rows/sec");
+            if(size == max) break;
+        }
+    }
+
+    bool run() {
+        bench_scaling();
+        return true;
+    }
+};
+
+int main() {
+    BenchPmap bench;
+    bench.testSuccess();
+}
@@ -0,0 +1,144 @@
+#include <assert.h>
+#include <stdio.h>
+
+#include "../../src/dataframe/frame_builder.h"
+#include "../../src/dataframe/sor_reader.h"
+#include "../../src/utils/timer.h"
+#include "../test.h"
+
+#define BENCH_SOR_FILE "bench-sor.tmp"
+#define BENCH_SOR_MB 1024 // the size of the file streamed through SorReader, can be given as the first argument
+#define BENCH_SOR_BUILD_MB 32 // the size of the file both readers build a dataframe from, the second argument
+#define BENCH_SOR_SCHEMA "IFBS"
+
+class BenchSor : public Test {
+public:
+    size_t stream_mb_;
+    size_t build_mb_;
+
+    BenchSor(size_t stream_mb, size_t build_mb) {
+        stream_mb_ = stream_mb;
+        build_mb_ = build_mb;
+    }
+
+    /** Writes rows of an int, a double, a bool and a quoted string until the file is at least mb megabytes. */
+    size_t write_file_(size_t mb) {
+        FILE* f = fopen(BENCH_SOR_FILE, "w");
+        assert(f != nullptr);
+        size_t bytes = 0;
+        for (size_t i = 0; bytes < mb << 20; i++)
+        {
+            int n = fprintf(f, "<%d> <%d.%02d> <%d> <\"word %zu\">\n", (int)(i * 7919 % 100000) - 50000,
+                (int)(i % 1000), (int)(i % 97), (int)(i % 3 == 0), i % 5000);
+            assert(n > 0);
+            bytes += n;
+        }
+        fclose(f);
+        return bytes;
+    }
+
+    double mb_per_sec_(size_t bytes, Timer& t) { return (bytes / (double)(1 << 20)) / (t.get_time_elapsed() / 1000); }
+
+    const char* level_name_(int level) {
+        switch(level) {
+            case SIMD_AVX2: return "avx2";
+            case SIMD_SSE41: return "sse4.1";
+            default: return "scalar";
+        }
+    }
+
+    /** Times finding the fields of every row, then counting the rows, with SorScanner at each instruction set level. */
+    void bench_scan(size_t bytes) {
+        MappedFile file(BENCH_SOR_FILE);
+        int best = simd_level();
+        for (int level = SIMD_SCALAR; level <= best; level++)
+        {
+            set_simd_level(level);
+            SorScanner scanner(file.end());
+            const char* pos = file.begin();
+            const char* starts[4];
+            const char* stops[4];
+            size_t fields = 0;
+            Timer t;
+            t.start();
+            while(pos < file.end()) fields += scanner.next_row(&pos, starts, stops, 4);
+            t.stop();
+            p("SorScanner fields, ").p(level_name_(level)).p(", ").p(fields).p(" fields: ").p(mb_per_sec_(bytes, t)).pln(" MB/sec");
+
+            t.restart();
+            size_t rows = scanner.count_rows(file.begin());
+            t.stop();
+            assert(rows * 4 == fields);
+            p("SorScanner rows, ").p(level_name_(level)).p(": ").p(mb_per_sec_(bytes, t)).pln(" MB/sec");
+        }
+        set_simd_level(best);
+    }
+
+    /** Streams every row of a large file through SorReader without keeping them, so it's parsing being timed. */
+    void bench_stream(size_t bytes) {
+        Schema sch(BENCH_SOR_SCHEMA);
+        Row row(sch);
+        long checksum = 0;
+        Timer t;
+        t.start();
+        SorReader reader(BENCH_SOR_FILE, sch);
+        while(!reader.done()) {
+            reader.visit(row);
+            checksum += row.get_int(0) + (long)row.get_double(1) + row.get_bool(2) + row.get_string(3)->size();
+        }
+        t.stop();
+        assert(checksum != 0);
+        p("SorReader stream, ").p(bytes >> 20).p(" MB, ").p(reader.rows()).p(" rows: ")
+            .p(mb_per_sec_(bytes, t)).pln(" MB/sec");
+    }
+
+    /** Builds a dataframe from the same file with SorReader, serially and on thread pools, and with SOR_FrameBuilder. */
+    void bench_build() {
+        size_t bytes = write_file_(build_mb_);
+        Schema sch(BENCH_SOR_SCHEMA);
+        Timer t;
+        t.start();
+        SorReader reader(BENCH_SOR_FILE, sch);
+        DataFrame* df = reader.build();
+        t.stop();
+        size_t rows = df->nrows();
+        delete(df);
+        p("SorReader build on this thread, ").p(rows).p(" rows: ").p(mb_per_sec_(bytes, t)).pln(" MB/sec");
+
+        // on more threads than the cpu has, this shows the overhead of splitting rather than a speedup
+        for (size_t threads = 2; threads <= 8; threads *= 2)
+        {
+            ThreadPool pool(threads);
+            t.restart();
+            SorReader parallel(BENCH_SOR_FILE, sch);
+            df = parallel.build(pool);
+            t.stop();
+            assert(df->nrows() == rows);
+            delete(df);
+            p("SorReader build on ").p(threads).p(" threads, ").p((size_t)std::thread::hardware_concurrency()).p(" cpus: ")
+                .p(mb_per_sec_(bytes, t)).pln(" MB/sec");
+        }
+
+        t.restart();
+        SOR_FrameBuilder builder(BENCH_SOR_FILE, sch);
+        df = builder.build(0);
+        t.stop();
+        assert(df->nrows() >= rows); // it counts the end of the file as one more, empty row
+        delete(df);
+        p("SOR_FrameBuilder build, ").p(rows).p(" rows: ").p(mb_per_sec_(bytes, t)).pln(" MB/sec");
+    }
+
+    bool run() {
+        size_t bytes = write_file_(stream_mb_);
+        bench_scan(bytes);
+        bench_stream(bytes);
+        bench_build();
+        remove(BENCH_SOR_FILE);
+        return true;
+    }
+};
+
+int main(int argc, char** argv) {
+    BenchSor bench(argc > 1 ? atoi(argv[1]) : BENCH_SOR_MB, argc > 2 ? atoi(argv[2]) : BENCH_SOR_BUILD_MB);
+    bench.testSuccess();
+}
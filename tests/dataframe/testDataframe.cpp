@@ -321,6 +321,236 @@ void testDataframeFunctionality() {
 // In this test, we are creating a custom Fielder implementation that collects data of users and their stored IDs (int).
 // We will then map the Fielder onto the Dataframe. We will implement a Rower that interates through the Dataframe to collect the corresponding data.
 
+/** Sums an int column and checks the rows come in order */
+class OrderRower : public Rower {
+public:
+	size_t sum = 0;
+	size_t rows = 0;
+	bool in_order = true;
+	int first = 0;
+	int last = 0;
+
+	bool accept(Row& r) {
+		int v = r.get_int(0);
+		if(rows == 0) first = v;
+		else if(v != last + 1) in_order = false;
+		last = v;
+		sum += v;
+		rows++;
+		delete(r.get_string(1));
+		return true;
+	}
+
+	// other covers the rows right after ours
+	void join_delete(Rower* other) {
+		OrderRower* o = dynamic_cast<OrderRower *>(other);
+		if(o->rows > 0) {
+			if(!o->in_order || (rows > 0 && o->first != last + 1)) in_order = false;
+			if(rows == 0) first = o->first;
+			last = o->last;
+		}
+		sum += o->sum;
+		rows += o->rows;
+		delete(o);
+	}
+
+	Object* clone() { return new OrderRower(); }
+};
+
+void testPmap() {
+	Schema s("IS");
+	DataFrame df(s);
+	Row r(df.get_schema());
+	String name("row");
+	size_t n = 100000;
+	for (size_t i = 0; i < n; ++i)
+	{
+		r.set(0, (int)i);
+		r.set(1, &name);
+		df.add_row(r);
+	}
+
+	OrderRower seq;
+	df.map(seq);
+	assert(seq.rows == n && seq.in_order);
+
+	ThreadPool pool(3);
+	OrderRower par;
+	df.pmap(par, pool);
+	assert(par.rows == n);
+	assert(par.sum == seq.sum);
+	assert(par.in_order);
+
+	// a few rows is less than a chunk, and is mapped in place
+	DataFrame small(s);
+	for (size_t i = 0; i < 10; ++i)
+	{
+		r.set(0, (int)i);
+		small.add_row(r);
+	}
+	OrderRower few;
+	small.pmap(few);
+	assert(few.rows == 10 && few.in_order);
+}
+
+/** Sums the int column of each batch, checks the batches come in order, and keeps the even rows */
+class OrderBatcher : public Batcher {
+public:
+	size_t sum = 0;
+	size_t rows = 0;
+	bool in_order = true;
+	size_t first = 0;
+	size_t next = 0; // the row the next batch should start on
+
+	void accept(ColumnBatch& b) {
+		if(rows == 0) first = b.start();
+		else if(b.start() != next) in_order = false;
+		const int* vals = b.ints(0);
+		for (size_t i = 0; i < b.count(); ++i)
+		{
+			if((size_t)vals[i] != b.start() + i) in_order = false;
+			assert(b.strings(1)[i].equals(&b.strings(1)[0]));
+			sum += vals[i];
+			b.select(i, vals[i] % 2 == 0);
+		}
+		rows += b.count();
+		next = b.start() + b.count();
+	}
+
+	// other covers the rows right after ours
+	void join_delete(Batcher* other) {
+		OrderBatcher* o = dynamic_cast<OrderBatcher *>(other);
+		if(o->rows > 0) {
+			if(!o->in_order || (rows > 0 && o->first != next)) in_order = false;
+			if(rows == 0) first = o->first;
+			next = o->next;
+		}
+		sum += o->sum;
+		rows += o->rows;
+		delete(o);
+	}
+
+	Object* clone() { return new OrderBatcher(); }
+};
+
+// keeps the rows whose bool is set or whose int is even, combining bitmaps a word at a time
+class BoolBatcher : public Batcher {
+public:
+	uint64_t evens[BATCH_ROWS / 64];
+	size_t selected = 0;
+
+	void accept(ColumnBatch& b) {
+		memset(evens, 0, sizeof(evens));
+		for (size_t i = 0; i < b.count(); ++i) bitmap_set(evens, i, b.ints(0)[i] % 2 == 0);
+		b.select_and(b.bools(3));
+		b.select_or(evens);
+		selected += b.selected_count();
+	}
+
+	void join_delete(Batcher* other) {
+		selected += dynamic_cast<BoolBatcher *>(other)->selected;
+		delete(other);
+	}
+
+	Object* clone() { return new BoolBatcher(); }
+};
+
+void testMapBatch() {
+	Schema s("ISFB");
+	DataFrame df(s);
+	Row r(df.get_schema());
+	String name("row");
+	size_t n = 100003;
+	for (size_t i = 0; i < n; ++i)
+	{
+		r.set(0, (int)i);
+		r.set(1, &name);
+		r.set(2, (double)i / 2);
+		r.set(3, i % 3 == 0);
+		df.add_row(r);
+	}
+	// the double and string columns have the smallest chunks
+	assert(df.batch_rows() == DOUBLE_CHUNK_SIZE);
+
+	OrderRower rows;
+	df.map(rows);
+
+	OrderBatcher seq;
+	df.map_batch(seq);
+	assert(seq.rows == n && seq.in_order);
+	assert(seq.sum == rows.sum);
+
+	ThreadPool pool(3);
+	OrderBatcher par;
+	df.pmap_batch(par, pool);
+	assert(par.rows == n && par.in_order);
+	assert(par.sum == seq.sum);
+
+	// the batch's values are the dataframe's
+	ColumnBatch batch(df.get_schema());
+	df.fill_batch(DOUBLE_CHUNK_SIZE * 3, 10, batch);
+	assert(batch.count() == 10);
+	for (size_t i = 0; i < batch.count(); ++i)
+	{
+		size_t row = DOUBLE_CHUNK_SIZE * 3 + i;
+		assert(batch.ints(0)[i] == df.get_int(0, row));
+		assert(&batch.strings(1)[i] == df.get_string(1, row));
+		assert(batch.doubles(2)[i] == df.get_double(2, row));
+		assert(bitmap_get(batch.bools(3), i) == df.get_bool(3, row));
+	}
+
+	OrderBatcher evens;
+	DataFrame* kept = df.filter_batch(evens);
+	assert(kept->nrows() == (n + 1) / 2);
+	for (size_t i = 0; i < kept->nrows(); i += 999)
+	{
+		assert(kept->get_int(0, i) == (int)(i * 2));
+		assert(kept->get_string(1, i)->equals(&name));
+		assert(kept->get_double(2, i) == (double)i);
+		assert(kept->get_bool(3, i) == (i * 2 % 3 == 0));
+	}
+	delete(kept);
+
+	// strings are matched on their codes
+	Schema cs("SI");
+	DataFrame colors(cs);
+	Row cr(colors.get_schema());
+	const char* names[3] = { "red", "green", "blue" };
+	for (size_t i = 0; i < 5000; ++i)
+	{
+		String c(names[i % 3]);
+		cr.set(0, &c);
+		cr.set(1, (int)i);
+		colors.add_row(cr);
+	}
+	String green("green");
+	DataFrame* greens = colors.filter_equal(0, &green);
+	assert(greens->nrows() == 1667);
+	for (size_t i = 0; i < greens->nrows(); ++i)
+	{
+		assert(greens->get_string(0, i)->equals(&green));
+		assert(greens->get_int(1, i) == (int)(i * 3 + 1));
+	}
+	delete(greens);
+	String purple("purple");
+	greens = colors.filter_equal(0, &purple);
+	assert(greens->nrows() == 0);
+	delete(greens);
+
+	// every multiple of 2 or 3
+	BoolBatcher either;
+	kept = df.filter_batch(either);
+	size_t expected = n / 2 + 1 + n / 3 + 1 - (n / 6 + 1);
+	assert(either.selected == expected && kept->nrows() == expected);
+	for (size_t i = 0; i < kept->nrows(); i += 777)
+	{
+		int v = kept->get_int(0, i);
+		assert(v % 2 == 0 || v % 3 == 0);
+		assert(kept->get_bool(3, i) == (v % 3 == 0));
+	}
+	delete(kept);
+}
+
 int main(int argc, char** argv) {
 	Test t;
     testDataFrame();
@@ -332,5 +562,11 @@ int main(int argc, char** argv) {
     testDataframeFunctionality();
 	t.OK("DataFrame component functionality tests -- passed.");
 
+    testPmap();
+	t.OK("DataFrame::pmap(r) -- passed.");
+
+    testMapBatch();
+	t.OK("DataFrame::map_batch(b) -- passed.");
+
     return 0;
 }
\ No newline at end of file
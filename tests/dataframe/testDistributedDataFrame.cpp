@@ -0,0 +1,398 @@
+#include <assert.h>
+
+#include "../test.h"
+#include "../../src/dataframe/distributed_dataframe.h"
+
+#define ROWS 200000 // a few chunks, so they spread over every node
+
+/** Adds up every column of a mixed dataframe, checking the strings as it goes */
+class SumRower : public Rower {
+public:
+    size_t rows_ = 0;
+    double doubles_ = 0;
+    size_t ints_ = 0;
+
+    bool accept(Row& r) override {
+        char expected[16];
+        snprintf(expected, 16, "s%zu", r.get_idx() % 7);
+        assert(strcmp(r.get_string(1)->c_str(), expected) == 0);
+        assert(r.get_double(0) == r.get_idx() * 0.5);
+        rows_++;
+        doubles_ += r.get_double(0);
+        ints_ += r.get_int(2);
+        return true;
+    }
+
+    void join_delete(Rower* other) override {
+        SumRower* o = dynamic_cast<SumRower *>(other);
+        rows_ += o->rows_;
+        doubles_ += o->doubles_;
+        ints_ += o->ints_;
+        delete(o);
+    }
+
+    Object* clone() override { return new SumRower(); }
+};
+
+/** Adds up the counts of the strings SumRower expects, as rows of a string and a count */
+class GroupRower : public Rower {
+public:
+    size_t counts_[7] = { 0 };
+    size_t rows_ = 0;
+
+    bool accept(Row& r) override {
+        int which;
+        assert(sscanf(r.get_string(0)->c_str(), "s%d", &which) == 1 && which < 7);
+        counts_[which] += r.get_int(1);
+        rows_++;
+        return true;
+    }
+};
+
+/** Writes the rows SumRower expects, one at a time */
+class MixedWriter : public Writer {
+public:
+    double* arr_; // external
+    size_t i_ = 0;
+    String* str_ = nullptr; // owned, the last string written
+
+    MixedWriter(double* arr) { arr_ = arr; }
+
+    ~MixedWriter() { delete(str_); }
+
+    void visit(Row& r) override {
+        char buf[16];
+        snprintf(buf, 16, "s%zu", i_ % 7);
+        delete(str_);
+        str_ = new String(buf);
+        r.set(0, arr_[i_]);
+        r.set(1, str_);
+        r.set(2, (int)i_);
+        i_++;
+    }
+
+    bool done() override { return i_ == ROWS; }
+};
+
+/** Writes a bool column where every third row is true */
+class ThirdsWriter : public Writer {
+public:
+    size_t i_ = 0;
+
+    void visit(Row& r) override { r.set(0, i_++ % 3 == 0); }
+
+    bool done() override { return i_ == ROWS; }
+};
+
+class TestDistributedDataFrame : public Test {
+public:
+    PseudoNetwork* net;
+    KVStore** stores;
+    double* arr;
+
+    TestDistributedDataFrame() {
+        args = new Args();
+        args->num_nodes = 3;
+        net = new PseudoNetwork(3);
+        stores = new KVStore*[3];
+        for (size_t i = 0; i < 3; i++) stores[i] = new KVStore(i, net);
+        arr = new double[ROWS];
+        for (size_t i = 0; i < ROWS; i++) arr[i] = i * 0.5;
+    }
+
+    ~TestDistributedDataFrame() {
+        for (size_t i = 0; i < 3; i++) delete(stores[i]);
+        delete[](stores);
+        delete(net);
+        delete(args);
+        delete[](arr);
+    }
+
+    bool testGet() {
+        Key k("ddf-get", 0);
+        delete(DistributedDataFrame::fromArray(&k, stores[0], ROWS, arr));
+
+        Value* v = stores[1]->waitAndGet(&k);
+        DistributedDataFrame* df = DistributedDataFrame::deserialize(v->serialized(), stores[1]);
+        delete(v);
+        assert(df->columns_[0] == nullptr);
+        for (size_t i = 0; i < ROWS; i += 997)
+        {
+            assert(df->get_double(0, i) == arr[i]);
+        }
+        assert(df->get_double(0, ROWS - 1) == arr[ROWS - 1]);
+        delete(df);
+        OK("DistributedDataFrame::get_double(col, row) -- passed.");
+        return true;
+    }
+
+    bool testColumnsResident() {
+        Key k("ddf-resident", 0);
+        delete(DistributedDataFrame::fromArray(&k, stores[0], ROWS, arr));
+
+        Value* v = stores[2]->waitAndGet(&k);
+        DistributedDataFrame* df = DistributedDataFrame::deserialize(v->serialized(), stores[2]);
+        delete(v);
+
+        // the column is decoded once and reused
+        df->get_double(0, 0);
+        Object* decoded = df->columns_[0];
+        assert(decoded != nullptr);
+        df->get_double(0, ROWS / 2);
+        assert(df->columns_[0] == decoded);
+
+        // adding a column drops what was decoded
+        Key other("ddf-resident-other", 0);
+        df->add_column(&other, 'F');
+        assert(df->columns_[0] == nullptr);
+        assert(df->columns_[1] == nullptr);
+        assert(df->get_double(0, 7) == arr[7]);
+        assert(df->columns_[0] != nullptr);
+        delete(df);
+        OK("DistributedDataFrame keeps decoded columns until a column is added -- passed.");
+        return true;
+    }
+
+    bool testScan() {
+        Key k("ddf-scan", 0);
+        delete(DistributedDataFrame::fromArray(&k, stores[0], ROWS, arr));
+
+        Value* v = stores[1]->waitAndGet(&k);
+        DistributedDataFrame* df = DistributedDataFrame::deserialize(v->serialized(), stores[1]);
+        delete(v);
+
+        ChunkScan<double>* scan = df->scan<double>(0);
+        size_t rows = 0;
+        size_t chunks = 0;
+        while(scan->next()) {
+            assert(scan->first_row() == rows);
+            for (size_t i = 0; i < scan->count(); i++)
+            {
+                assert(scan->data()[i] == arr[rows + i]);
+            }
+            rows += scan->count();
+            chunks++;
+        }
+        assert(rows == ROWS);
+        assert(chunks == ROWS / scan->col_->chunk_size_ + 1);
+        assert(!scan->next());
+        delete(scan);
+
+        // stopping partway through is fine too
+        scan = df->scan<double>(0);
+        assert(scan->next());
+        delete(scan);
+        delete(df);
+        OK("DistributedDataFrame::scan(col) -- passed.");
+        return true;
+    }
+
+    // stores a dataframe of doubles, strings, and ints, the ints' chunks don't line up with the others
+    void build_mixed_(Key* k) {
+        Schema sch("", k);
+        DistributedDataFrame ddf(sch);
+        DistributedColumn<double> doubles(0);
+        DistributedStringColumn strings(1);
+        DistributedColumn<int> ints(2);
+        doubles.set_store(stores[0]);
+        strings.set_store(stores[0]);
+        ints.set_store(stores[0]);
+        char buf[16];
+        for (size_t i = 0; i < ROWS; i++)
+        {
+            doubles.push_back(arr[i], ddf.get_schema().get_name());
+            snprintf(buf, 16, "s%zu", i % 7);
+            String str(buf);
+            strings.push_back(&str, ddf.get_schema().get_name());
+            ints.push_back((int)i, ddf.get_schema().get_name());
+        }
+
+        Column<double>* dc = &doubles;
+        Column<String *>* sc = &strings;
+        Column<int>* ic = &ints;
+        Serializable* cols[3] = { dc, sc, ic };
+        const char* types = "FSI";
+        for (size_t c = 0; c < 3; c++)
+        {
+            char* name = ddf.get_schema().build_col_key(c);
+            Key ck(name, 0);
+            delete[](name);
+            Value cv(cols[c]);
+            stores[0]->put(&ck, &cv);
+            ddf.add_column(&ck, types[c]);
+        }
+        Value dv(&ddf);
+        stores[0]->put(k, &dv);
+    }
+
+    bool testLocalMap() {
+        Key k("ddf-local-map", 0);
+        build_mixed_(&k);
+        size_t expected_ints = (size_t)ROWS * (ROWS - 1) / 2;
+        double expected_doubles = expected_ints * 0.5;
+
+        SumRower total;
+        for (size_t i = 0; i < 3; i++)
+        {
+            Value* v = stores[i]->waitAndGet(&k);
+            DistributedDataFrame* df = DistributedDataFrame::deserialize(v->serialized(), stores[i]);
+            delete(v);
+            assert(df->nrows() == ROWS);
+            SumRower here;
+            df->local_map(here);
+            assert(here.rows_ > 0 && here.rows_ < ROWS); // every node holds some of it
+            total.rows_ += here.rows_;
+            total.doubles_ += here.doubles_;
+            total.ints_ += here.ints_;
+            delete(df);
+        }
+        assert(total.rows_ == ROWS);
+        assert(total.doubles_ == expected_doubles);
+        assert(total.ints_ == expected_ints);
+
+        Value* v = stores[1]->waitAndGet(&k);
+        DistributedDataFrame* df = DistributedDataFrame::deserialize(v->serialized(), stores[1]);
+        delete(v);
+        SumRower all;
+        df->map(all);
+        assert(all.rows_ == ROWS);
+        assert(all.doubles_ == expected_doubles);
+        assert(all.ints_ == expected_ints);
+        delete(df);
+        OK("DistributedDataFrame::local_map(r) and map(r) -- passed.");
+        return true;
+    }
+
+    bool testFromWriter() {
+        Key k("ddf-writer", 0);
+        MixedWriter w(arr);
+        DistributedDataFrame* built = DistributedDataFrame::fromWriter(&k, stores[0], "FSI", w);
+        assert(built->get_schema().width() == 3);
+        assert(built->nrows() == ROWS);
+        delete(built);
+
+        Value* v = stores[2]->waitAndGet(&k);
+        DistributedDataFrame* df = DistributedDataFrame::deserialize(v->serialized(), stores[2]);
+        delete(v);
+        // the finished chunks went out to the other nodes
+        Array* keys = df->get_column<DistributedColumn<double>>(0)->keys_;
+        assert(keys->count() == ROWS / df->get_column<DistributedColumn<double>>(0)->chunk_size_);
+        assert(dynamic_cast<Key *>(keys->get(1))->idx_ == 1);
+        assert(dynamic_cast<Key *>(keys->get(2))->idx_ == 2);
+        SumRower all;
+        df->map(all);
+        size_t expected_ints = (size_t)ROWS * (ROWS - 1) / 2;
+        assert(all.rows_ == ROWS);
+        assert(all.ints_ == expected_ints);
+        assert(all.doubles_ == expected_ints * 0.5);
+        delete(df);
+        OK("DistributedDataFrame::fromWriter(k, store, schema, w) -- passed.");
+        return true;
+    }
+
+    bool testAggregate() {
+        Key k("ddf-aggregate", 0);
+        build_mixed_(&k);
+        Value* v = stores[1]->waitAndGet(&k);
+        DistributedDataFrame* df = DistributedDataFrame::deserialize(v->serialized(), stores[1]);
+        delete(v);
+
+        double n = ROWS;
+        Aggregate ints = df->aggregate<int>(2);
+        assert(ints.count() == ROWS);
+        assert(ints.sum() == n * (n - 1) / 2);
+        assert(ints.min() == 0 && ints.max() == n - 1);
+        assert(ints.mean() == (n - 1) / 2);
+        assert(fabs(ints.variance() - (n * n - 1) / 12) < 1e-9 * ints.variance());
+
+        Aggregate doubles = df->aggregate<double>(0);
+        assert(doubles.count() == ROWS);
+        assert(doubles.sum() == n * (n - 1) / 4);
+        assert(doubles.min() == 0 && doubles.max() == (n - 1) / 2);
+        assert(fabs(doubles.variance() - (n * n - 1) / 48) < 1e-9 * doubles.variance());
+        delete(df);
+
+        Key bk("ddf-aggregate-bools", 0);
+        ThirdsWriter w;
+        delete(DistributedDataFrame::fromWriter(&bk, stores[0], "B", w));
+        size_t trues = (ROWS + 2) / 3;
+        v = stores[2]->waitAndGet(&bk);
+        df = DistributedDataFrame::deserialize(v->serialized(), stores[2]);
+        delete(v);
+        Aggregate b = df->aggregate<bool>(0);
+        assert(b.count() == ROWS);
+        assert(b.sum() == trues);
+        assert(b.min() == 0 && b.max() == 1);
+        double p = trues / n;
+        assert(fabs(b.variance() - p * (1 - p)) < 1e-12);
+        delete(df);
+        OK("DistributedDataFrame::aggregate(col) -- passed.");
+        return true;
+    }
+
+    bool testGetString() {
+        Key k("ddf-get-string", 0);
+        build_mixed_(&k);
+        Value* v = stores[1]->waitAndGet(&k);
+        DistributedDataFrame* df = DistributedDataFrame::deserialize(v->serialized(), stores[1]);
+        delete(v);
+        DistributedStringColumn* col = df->get_column<DistributedStringColumn>(1);
+        assert(col->keys_->count() > 0 && col->last_chunk_->count() > 0);
+
+        // the first row comes from a stored chunk, the last from the unfinished one
+        size_t rows[2] = { 0, ROWS - 1 };
+        char buf[16];
+        for (size_t i = 0; i < 2; i++)
+        {
+            snprintf(buf, 16, "s%zu", rows[i] % 7);
+            String expected(buf);
+            String* view = col->get(rows[i]);
+            assert(view == col->get(rows[i])); // borrowed from the column, not made per lookup
+            String* copy = df->get_string(1, rows[i]);
+            assert(copy != view && copy->equals(&expected));
+            delete(copy);
+            assert(view->equals(&expected));
+        }
+        assert(col->stored_[0].load() != nullptr);
+        delete(df);
+        OK("DistributedDataFrame::get_string(col, row) -- passed.");
+        return true;
+    }
+
+    bool testGroupCount() {
+        Key k("ddf-group-count", 0);
+        build_mixed_(&k);
+        GroupRower total;
+        size_t chunks = 0;
+        for (size_t i = 0; i < 3; i++)
+        {
+            Value* v = stores[i]->waitAndGet(&k);
+            DistributedDataFrame* df = DistributedDataFrame::deserialize(v->serialized(), stores[i]);
+            delete(v);
+            chunks += df->get_column<DistributedStringColumn>(1)->keys_->count();
+            df->local_group_count(1, total);
+            delete(df);
+        }
+        // every chunk has all seven strings, the last one included
+        assert(total.rows_ == 7 * (chunks / 3 + 1));
+        for (size_t s = 0; s < 7; s++) assert(total.counts_[s] == ROWS / 7 + (s < ROWS % 7 ? 1 : 0));
+        OK("DistributedDataFrame::local_group_count(col, r) -- passed.");
+        return true;
+    }
+
+    bool run() {
+        return testGet()
+            && testColumnsResident()
+            && testScan()
+            && testLocalMap()
+            && testFromWriter()
+            && testAggregate()
+            && testGetString()
+            && testGroupCount();
+    }
+};
+
+int main() {
+    TestDistributedDataFrame test;
+    test.testSuccess();
+}
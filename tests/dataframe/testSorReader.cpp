@@ -0,0 +1,209 @@
+#include <assert.h>
+#include <stdio.h>
+
+#include "../../src/dataframe/sor_reader.h"
+#include "../test.h"
+
+#define SOR_TEST_FILE "sor-reader-test.tmp"
+
+class TestSorReader : public Test {
+public:
+    bool parses_int_(const char* s, int expected) {
+        int i;
+        return sor_parse_int(s, s + strlen(s), &i) && i == expected;
+    }
+
+    bool parses_double_(const char* s, double expected) {
+        double d;
+        return sor_parse_double(s, s + strlen(s), &d) && d == expected;
+    }
+
+    void testParsers() {
+        assert(parses_int_("42", 42));
+        assert(parses_int_("+101", 101));
+        assert(parses_int_("-2147483648", INT32_MIN));
+        assert(parses_int_("2147483647", INT32_MAX));
+        assert(!parses_int_("2147483648", 0));
+        assert(!parses_int_("1.5", 0));
+        assert(!parses_int_("-", 0));
+
+        // the fast path has to round exactly like strtod
+        assert(parses_double_("0.1", 0.1));
+        assert(parses_double_("-10.55", -10.55));
+        assert(parses_double_("+3", 3));
+        assert(parses_double_("1e-5", 1e-5));
+        assert(parses_double_(".5", 0.5));
+        assert(parses_double_("3.14159265358979323846", strtod("3.14159265358979323846", nullptr)));
+        assert(parses_double_("1.7976931348623157e308", 1.7976931348623157e308));
+        assert(!parses_double_("1.2.3", 0));
+        assert(!parses_double_("1e", 0));
+        assert(!parses_double_("nan", 0));
+
+        const char* fields[] = { "", "0", "1", "+1", "12", "-3.5", "1e3", "\"12\"", "hello" };
+        const char types[] = { 0, 'B', 'B', 'I', 'I', 'F', 'F', 'S', 'S' };
+        for (size_t i = 0; i < 9; i++) assert(sor_classify(fields[i], fields[i] + strlen(fields[i])) == types[i]);
+        OK("SoR field parsers -- passed.");
+    }
+
+    /** The scanner at the current simd level has to agree with the byte at a time helpers on the given text. */
+    void check_scanner_(const char* text, size_t len) {
+        const char* end = text + len;
+        SorScanner scanner(end);
+        const char* pos = text;
+        const char* expected_pos = text;
+        const char* starts[3];
+        const char* stops[3];
+        while(expected_pos < end) {
+            size_t fields = scanner.next_row(&pos, starts, stops, 3); // rows with more fields get cut short
+            const char *s, *e;
+            size_t expected = 0;
+            for (; sor_next_field(&expected_pos, end, &s, &e); expected++)
+            {
+                if(expected < 3) assert(starts[expected] == s && stops[expected] == e);
+            }
+            assert(fields == expected && pos == expected_pos);
+            // skipping blank lines like SorReader does shouldn't lose the scanner's place
+            while(rand() % 2 == 0 && pos < end && (sor_space(*pos) || *pos == '\n')) pos++;
+            expected_pos = pos;
+        }
+        size_t rows = sor_count_rows(text, end);
+        assert(SorScanner(end).count_rows(text) == rows);
+        for (size_t n = 0; n <= rows + 1; n++) assert(SorScanner(end).skip_rows(text, n) == sor_skip_rows(text, end, n));
+    }
+
+    void testScanner() {
+        const char bytes[] = "<>\"\n \t\rab1";
+        char* text = new char[1000];
+        srand(4500);
+        int best = simd_level();
+        for (int level = SIMD_SCALAR; level <= best; level++)
+        {
+            set_simd_level(level);
+            for (size_t round = 0; round < 2000; round++)
+            {
+                // mostly plain bytes, so fields and lines run across blocks, or mostly SoR when the round is odd
+                size_t len = rand() % 1000;
+                for (size_t i = 0; i < len; i++) text[i] = rand() % 4 == 0 ? bytes[rand() % 10] : 'a' + rand() % 26;
+                for (size_t i = 0; round % 2 == 1 && i + 12 < len; i += 1 + rand() % 12) memcpy(text + i, "<1> <\"x y\"> ", 12);
+                check_scanner_(text, len);
+            }
+            const char* sor = "<1> <\"a > b\"> <x>\n\n  \t\n<2><\"q\"\"r>\"> <unclosed\n<3>";
+            check_scanner_(sor, strlen(sor));
+        }
+        set_simd_level(best);
+        delete[](text);
+        OK("SorScanner agrees with the byte at a time helpers -- passed.");
+    }
+
+    void write_file_(const char* text) {
+        FILE* f = fopen(SOR_TEST_FILE, "w");
+        assert(f != nullptr);
+        fputs(text, f);
+        fclose(f);
+    }
+
+    void testInferAndBuild() {
+        write_file_(
+            "<\"apple banana\"> <1> <-2345> <hey> <1.0303>\n"
+            "<\"row > boat\">   <0> <+101> < you > <10.55>\n"
+            "<>               <1> <1.5> <box> <>\n"
+            "<\"tree trunk\">   <0>\n"
+            "\n"
+            "<\"c d\">          <1> <9> <\"hey\"> <494> <extra>\n");
+        SorReader reader(SOR_TEST_FILE);
+        assert(strcmp(reader.get_schema().col_types, "SBFSFS") == 0);
+        DataFrame* df = reader.build();
+        assert(df->nrows() == 5);
+        assert(reader.rows() == 5);
+
+        assert(strcmp(df->get_string(0, 0)->c_str(), "apple banana") == 0);
+        assert(strcmp(df->get_string(0, 1)->c_str(), "row > boat") == 0);
+        assert(df->get_string(0, 2)->size() == 0);
+        assert(df->get_bool(1, 0) && !df->get_bool(1, 1) && df->get_bool(1, 4));
+        assert(df->get_double(2, 0) == -2345 && df->get_double(2, 1) == 101 && df->get_double(2, 2) == 1.5);
+        assert(df->get_double(2, 3) == 0);
+        assert(strcmp(df->get_string(3, 1)->c_str(), "you") == 0);
+        assert(strcmp(df->get_string(3, 4)->c_str(), "hey") == 0);
+        assert(df->get_double(4, 0) == 1.0303 && df->get_double(4, 1) == 10.55 && df->get_double(4, 4) == 494);
+        assert(df->get_double(4, 2) == 0);
+        assert(df->get_string(5, 0)->size() == 0);
+        assert(strcmp(df->get_string(5, 4)->c_str(), "extra") == 0);
+        delete(df);
+        OK("SorReader schema inference and build -- passed.");
+    }
+
+    void testGivenSchema() {
+        write_file_(
+            "<1> <12> <x>\n"
+            "<0> <1.5> <y> <ignored>\n"
+            "<1> <+7>\n");
+        Schema sch("BIS");
+        SorReader reader(SOR_TEST_FILE, sch);
+        Row row(sch);
+        assert(!reader.done());
+        reader.visit(row);
+        assert(row.get_bool(0) && row.get_int(1) == 12 && strcmp(row.get_string(2)->c_str(), "x") == 0);
+        reader.visit(row);
+        assert(!row.get_bool(0) && row.get_int(1) == 0); // not an int, so the default
+        assert(strcmp(row.get_string(2)->c_str(), "y") == 0);
+        reader.visit(row);
+        assert(row.get_int(1) == 7 && row.get_string(2)->size() == 0);
+        assert(reader.done());
+        OK("SorReader with a given schema -- passed.");
+    }
+
+    /** Builds a file of a few MB both ways, it has to come out the same when split between threads. */
+    void testParallelBuild() {
+        FILE* f = fopen(SOR_TEST_FILE, "w");
+        assert(f != nullptr);
+        for (size_t i = 0; i < 100000; i++)
+        {
+            fprintf(f, "<%zu> <%zu.5> <%d> <\"s%zu\">\n", i, i % 1000, (int)(i % 3 == 0), i % 777);
+            if(i % 9999 == 0) fputs("\n   \n", f); // blank lines aren't rows
+        }
+        fputs("<1> <2> <1>", f); // a last row cut short, with no newline
+        fclose(f);
+
+        SorReader serial(SOR_TEST_FILE);
+        assert(strcmp(serial.get_schema().col_types, "IFBS") == 0);
+        DataFrame* expected = serial.build();
+        assert(expected->nrows() == 100001);
+
+        ThreadPool pool(3);
+        SorReader parallel(SOR_TEST_FILE);
+        DataFrame* df = parallel.build(pool);
+        assert(df->nrows() == 100001);
+        assert(parallel.rows() == 100001 && parallel.done());
+        assert(df->data_equals(expected));
+        assert(df->get_int(0, 99999) == 99999 && df->get_int(0, 100000) == 1);
+        assert(df->get_string(3, 100000)->size() == 0);
+
+        // rows added after the chunks were put together land where they should
+        Row row(df->get_schema());
+        row.set(0, 7);
+        row.set(1, 7.5);
+        row.set(2, true);
+        String s("more");
+        row.set(3, &s);
+        df->add_row(row);
+        assert(df->get_int(0, 100001) == 7 && df->get_string(3, 100001)->equals(&s));
+        delete(df);
+        delete(expected);
+        OK("SorReader parallel build -- passed.");
+    }
+
+    bool run() {
+        testParsers();
+        testScanner();
+        testInferAndBuild();
+        testGivenSchema();
+        testParallelBuild();
+        remove(SOR_TEST_FILE);
+        return true;
+    }
+};
+
+int main() {
+    TestSorReader test;
+    test.testSuccess();
+}
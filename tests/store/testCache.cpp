@@ -0,0 +1,108 @@
+#include <assert.h>
+
+#include "../test.h"
+#include "../../src/store/cache.h"
+
+class TestCache : public Test {
+public:
+    Key* k1 = new Key("a", 1);
+    Key* k2 = new Key("b", 1);
+    Key* k3 = new Key("c", 1);
+    SerialString* ss = new SerialString("0123456789", 10);
+    Value* v = new Value(ss);
+
+    ~TestCache() {
+        delete(k1);
+        delete(k2);
+        delete(k3);
+        delete(ss);
+        delete(v);
+    }
+
+    // true if the key is cached, counts as a use
+    bool has(ChunkCache& c, Key* k) {
+        Value* got = c.get(k);
+        if(got == nullptr) return false;
+        assert(got->serialized()->equals(ss));
+        delete(got);
+        return true;
+    }
+
+    bool testGetPut() {
+        ChunkCache c(100);
+        assert(!has(c, k1));
+        c.put(k1, v);
+        c.put(k2, v);
+        assert(c.count() == 2);
+        assert(c.bytes_ == 20);
+        assert(has(c, k1));
+        assert(has(c, k2));
+        assert(!has(c, k3));
+        assert(c.hits_.next_ == 2);
+        assert(c.misses_.next_ == 2);
+
+        // putting a key again replaces it
+        c.put(k1, v);
+        assert(c.count() == 2);
+        assert(c.bytes_ == 20);
+
+        c.remove(k1);
+        assert(!has(c, k1));
+        assert(has(c, k2));
+        assert(c.bytes_ == 10);
+        OK("ChunkCache get, put and remove - passed.");
+        return true;
+    }
+
+    bool testEviction() {
+        ChunkCache c(25);
+        c.put(k1, v);
+        c.put(k2, v);
+        assert(has(c, k1)); // k2 is now the least recently used
+        c.put(k3, v);
+        assert(c.evictions_.next_ == 1);
+        assert(c.count() == 2);
+        assert(!has(c, k2));
+        assert(has(c, k1));
+        assert(has(c, k3));
+
+        // too big to ever fit, so it isn't kept
+        ChunkCache small(5);
+        small.put(k1, v);
+        assert(small.count() == 0);
+        OK("ChunkCache eviction - passed.");
+        return true;
+    }
+
+    bool testMany() {
+        ChunkCache c(10 * 100);
+        char name[16];
+        for (size_t i = 0; i < 1000; i++)
+        {
+            snprintf(name, 16, "k%zu", i);
+            Key k(name, 1);
+            c.put(&k, v);
+        }
+        assert(c.count() == 100);
+        assert(c.evictions_.next_ == 900);
+        for (size_t i = 0; i < 1000; i++)
+        {
+            snprintf(name, 16, "k%zu", i);
+            Key k(name, 1);
+            assert(has(c, &k) == (i >= 900));
+        }
+        OK("ChunkCache with many keys - passed.");
+        return true;
+    }
+
+    bool run() {
+        return testGetPut()
+            && testEviction()
+            && testMany();
+    }
+};
+
+int main() {
+    TestCache test;
+    test.testSuccess();
+}
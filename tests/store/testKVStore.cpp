@@ -65,7 +65,7 @@ public:
     }
 };
 
-class TestKVStoreNode : public Test {
+class TestKVTable : public Test {
 public:
     TestSO* so1 = new TestSO(4, 10.5, "hello");
     TestSO* so2 = new TestSO(10, 100.923, "nope");
@@ -74,11 +74,9 @@ public:
     Key* k3 = new Key("last", 2);
     Value* v1 = new Value(so1);
     Value* v2 = new Value(so2);
-    KVStore_Node* n2 = new KVStore_Node(k2, v2);
-    KVStore_Node* n1 = new KVStore_Node(k1, v1, n2);
-    KVStore_Node* n3 = new KVStore_Node(k3, v2);
+    KVTable* table = new KVTable(1);
 
-    ~TestKVStoreNode() {
+    ~TestKVTable() {
         delete(so1);
         delete(so2);
         delete(k1);
@@ -86,88 +84,70 @@ public:
         delete(k3);
         delete(v1);
         delete(v2);
-        delete(n1);
-        delete(n3);
+        delete(table);
     }
 
-    bool testCount() {
-        assert(n1->count() == 2);
-        assert(n2->count() == 1);
-        assert(n3->count() == 1);
-
-        OK("KVStore_Node::count() -- passed.");
-        return true;
-    }
-
-    bool testPushBack() {
-        assert(n1->count() == 2);
-        n1->pushBack(n3);
-        assert(n1->count() == 3);
-        assert(n1->next_->next_ == n3);
-
-        OK("KVStore_Node::pushBack(n) -- passed.");
-        return true;
-    }
-
-    bool testPop() {
-        assert(n1->count() == 3);
-        KVStore_Node* n3_popped = n1->pop();
-        assert(n1->count() == 2);
-        KVStore_Node* n2_popped = n1->pop();
-        assert(n1->count() == 1);
-        assert(n1->next_ == nullptr);
-        assert(n1->pop() == nullptr);
-        assert(n3_popped == n3);
-        assert(n2_popped == n2);
-        n1->pushBack(n2);
-
-        OK("KVStore_Node::pop() -- passed.");
-        return true;
-    }
-
-    bool testFind() {
-        assert(n1->find(k3) == nullptr);
-        assert(n1->find(k2) == n2);
-        assert(n1->find(k1) == n1);
-        assert(n3->find(k3) == n3);
-
-        OK("KVStore_Node::find(k) -- passed.");
+    bool testSetGet() {
+        assert(table->count() == 0);
+        assert(table->get(k1) == nullptr);
+        table->set(k1, v1);
+        table->set(k2, v2);
+        assert(table->count() == 2);
+        assert(table->get(k1)->serialized()->equals(v1->serialized()));
+        assert(table->get(k2)->serialized()->equals(v2->serialized()));
+        assert(table->get(k3) == nullptr);
+
+        table->set(k1, v2);
+        assert(table->count() == 2);
+        assert(table->get(k1)->serialized()->equals(v2->serialized()));
+
+        OK("KVTable::set(k, v) and get(k) -- passed.");
         return true;
     }
 
-    bool testGetValue() {
-        assert(n1->getValue(k1)->serialized()->equals(v1->serialized()));
-        assert(n1->getValue(k2)->serialized()->equals(v2->serialized()));
-        assert(n1->getValue(k3) == nullptr);
-        assert(n3->getValue(k3)->serialized()->equals(v2->serialized()));
-
-        OK("KVStore_Node::getValue(k) -- passed.");
+    bool testGrow() {
+        assert(table->capacity_ >= 4);
+        for (size_t i = 0; i < 1000; i++)
+        {
+            Key k(i % 2 == 0 ? "even" : "odd", i);
+            table->set(&k, v1);
+        }
+        assert(table->count() == 1002);
+        assert(table->count() <= table->capacity_ * GROWTH_THRESHOLD);
+        for (size_t i = 0; i < 1000; i++)
+        {
+            Key k(i % 2 == 0 ? "even" : "odd", i);
+            assert(table->get(&k) != nullptr);
+        }
+        assert(table->get(k2)->serialized()->equals(v2->serialized()));
+
+        OK("KVTable::grow() -- passed.");
         return true;
     }
 
-    bool testSet() {
-        assert(n1->count() == 2);
-        n1->set(k3, v1);
-        assert(n1->count() == 3);
-        assert(n1->find(k3) != nullptr);
-
-        assert(n3->count() == 1);
-        assert(n3->getValue(k3)->serialized()->equals(v2->serialized()));
-        n3->set(k3, v1);
-        assert(n3->count() == 1);
-        assert(n3->getValue(k3)->serialized()->equals(v1->serialized()));
-
-        OK("KVStore_Node::set(k, v) -- passed.");
+    bool testRemove() {
+        for (size_t i = 0; i < 1000; i += 2)
+        {
+            Key k("even", i);
+            table->remove(&k);
+        }
+        table->remove(k3); // not there
+        assert(table->count() == 502);
+        for (size_t i = 0; i < 1000; i++)
+        {
+            Key k(i % 2 == 0 ? "even" : "odd", i);
+            assert((table->get(&k) == nullptr) == (i % 2 == 0));
+        }
+        assert(table->get(k1) != nullptr);
+
+        OK("KVTable::remove(k) -- passed.");
         return true;
     }
 
     bool run() {
-        return testCount()
-            && testPushBack()
-            && testPop()
-            && testFind()
-            && testGetValue()
-            && testSet();
+        return testSetGet()
+            && testGrow()
+            && testRemove();
     }
 };
 
@@ -196,6 +176,55 @@ public:
     }
 };
 
+/** Puts its own keys while waiting on the keys of the thread after it */
+class PutGetThread : public Thread {
+public:
+    KVStore* s_;
+    size_t id_;
+    size_t threads_;
+    size_t keys_;
+    bool ok_;
+
+    PutGetThread(KVStore* s, size_t id, size_t threads, size_t keys) {
+        s_ = s;
+        id_ = id;
+        threads_ = threads;
+        keys_ = keys;
+        ok_ = false;
+    }
+
+    Key* key(size_t thread, size_t i) {
+        char name[32];
+        snprintf(name, sizeof(name), "t%zu-%zu", thread, i);
+        return new Key(name, s_->idx_);
+    }
+
+    void run() {
+        ValueFuture** fs = new ValueFuture*[keys_];
+        for (size_t i = 0; i < keys_; i++)
+        {
+            Key* k = key((id_ + 1) % threads_, i);
+            fs[i] = s_->get_async(k);
+            delete(k);
+
+            k = key(id_, i);
+            SerialString ss((char*)&i, sizeof(size_t));
+            Value v(&ss);
+            s_->put(k, &v);
+            delete(k);
+        }
+        ok_ = true;
+        for (size_t i = 0; i < keys_; i++)
+        {
+            Value* v = fs[i]->get();
+            ok_ = ok_ && v != nullptr && *(size_t*)v->serialized()->data_ == i;
+            delete(v);
+            delete(fs[i]);
+        }
+        delete[](fs);
+    }
+};
+
 class TestLocalKVStore : public Test {
 public:
     PseudoNetwork* net = new PseudoNetwork(2);
@@ -227,37 +256,14 @@ public:
         return true;
     }
 
-    bool testGetPosition() {
-        Key k("test", 0);
-        assert(small->get_position(&k) == 0);
-        assert(reg->get_position(&k) < reg->capacity_);
-
-        OK("KVStore::get_position(k) -- passed.");
-        return true;
-    }
-
-    bool testPutNode() {
-        Key k("node", 1);
-        KVStore_Node* n = new KVStore_Node(&k, v);
-        assert(reg->count() == 2);
-        reg->put_node(n);
-        assert(reg->count() == 3);
-        assert(reg->nodes_[reg->get_position(&k)] == n);
-
-        OK("KVStore::put_node(node) -- passed.");
-        return true;
-    }
-
     bool testGrow() {
         Key k("in_small", 0);
-        assert(small->capacity_ == 1);
-        small->grow();
-        assert(small->capacity_ == 1);
+        KVTable* table = &small->shard_(&k)->table_;
+        assert(table->capacity_ == 1);
         small->put(&k, v);
-        small->grow();
-        assert(small->capacity_ == GROWTH_FACTOR);
+        assert(table->capacity_ == GROWTH_FACTOR);
 
-        OK("KVStore::grow() -- passed.");
+        OK("KVStore grows its table -- passed.");
         return true;
     }
 
@@ -269,6 +275,12 @@ public:
         //assert(small->get(&kbad) == nullptr);
         assert(reg->get(&kreg)->serialized()->equals(v->serialized()));
 
+        // gets share the stored bytes rather than copying them
+        size_t copied = Value::bytes_copied();
+        Value* got = reg->get(&kreg);
+        assert(Value::bytes_copied() == copied);
+        delete(got);
+
         OK("KVStore::get(k) -- passed.");
         return true;
     }
@@ -308,20 +320,260 @@ public:
         return true;
     }
 
+    bool testConcurrent() {
+        size_t n = 8;
+        PutGetThread** threads = new PutGetThread*[n];
+        for (size_t i = 0; i < n; i++)
+        {
+            threads[i] = new PutGetThread(reg, i, n, 500);
+            threads[i]->start();
+        }
+        for (size_t i = 0; i < n; i++)
+        {
+            threads[i]->join();
+            assert(threads[i]->ok_);
+            delete(threads[i]);
+        }
+        delete[](threads);
+        assert(reg->parked() == 0);
+
+        OK("KVStore put(k, v) and get_async(k) from many threads -- passed.");
+        return true;
+    }
+
     bool run() {
         return testCount()
-            && testGetPosition()
-            && testPutNode()
             && testGrow()
             && testGet()
             && testWaitAndGet()
-            && testPut();
+            && testPut()
+            && testConcurrent();
+    }
+};
+
+class TestPendingTable : public Test {
+public:
+    PendingTable table;
+
+    bool testAddTake() {
+        ValueFuture* fs = new ValueFuture[100];
+        for (size_t i = 0; i < 100; i++)
+        {
+            table.add(i * 16 + 1, &fs[i]); // all want the same home slot at first
+        }
+        assert(table.count() == 100);
+        assert(table.take(2) == nullptr);
+        for (size_t i = 0; i < 100; i += 2)
+        {
+            assert(table.take(i * 16 + 1) == &fs[i]);
+        }
+        for (size_t i = 1; i < 100; i += 2)
+        {
+            assert(table.take(i * 16 + 1) == &fs[i]);
+        }
+        assert(table.count() == 0);
+        delete[](fs);
+
+        OK("PendingTable::add(id, f) and take(id) -- passed.");
+        return true;
+    }
+
+    bool run() { return testAddTake(); }
+};
+
+class TestRemoteKVStore : public Test {
+public:
+    PseudoNetwork* net = new PseudoNetwork(2);
+    KVStore* s0 = new KVStore(0, net);
+    KVStore* s1 = new KVStore(1, net);
+
+    ~TestRemoteKVStore() {
+        delete(s0);
+        delete(s1);
+        delete(net);
+    }
+
+    bool testGetAsync() {
+        size_t n = 20;
+        Key** keys = new Key*[n];
+        Value** vals = new Value*[n];
+        for (size_t i = 0; i < n; i++)
+        {
+            char* name = to_str<size_t>(i);
+            TestSO so(i, i * 0.5, name);
+            keys[i] = new Key(name, 1);
+            vals[i] = new Value(&so);
+            s1->put(keys[i], vals[i]);
+            free(name);
+        }
+
+        // every request is in flight before any is waited on
+        ValueFuture** fs = new ValueFuture*[n];
+        for (size_t i = 0; i < n; i++)
+        {
+            fs[i] = s0->get_async(keys[i]);
+        }
+        for (size_t i = n; i > 0; i--)
+        {
+            Value* v = fs[i - 1]->get();
+            assert(v->equals(vals[i - 1]));
+            delete(v);
+            delete(fs[i - 1]);
+            delete(keys[i - 1]);
+            delete(vals[i - 1]);
+        }
+        assert(s0->pending_.count() == 0);
+        delete[](fs);
+        delete[](keys);
+        delete[](vals);
+
+        OK("KVStore::get_async(k) -- passed.");
+        return true;
+    }
+
+    bool testParkedGet() {
+        Key k("late", 1);
+        TestSO so(1, 2.5, "late");
+        Value v(&so);
+        ValueFuture* f = s0->get_async(&k);
+        Thread::sleep(200);
+        assert(!f->ready());
+        s1->put(&k, &v);
+        Value* got = f->get();
+        assert(got->equals(&v));
+        assert(s1->parked() == 0);
+        delete(got);
+        delete(f);
+
+        OK("KVStore::get_async(k) before put(k, v) -- passed.");
+        return true;
+    }
+
+    bool testTimeout() {
+        Key k("never", 1);
+        ValueFuture* f = s0->get_async(&k, 200);
+        assert(f->get() == nullptr);
+        assert(s0->pending_.count() == 0);
+        delete(f);
+        assert(s1->waitAndGet(&k, 100) == nullptr);
+        assert(s1->parked() == 0);
+
+        OK("KVStore::waitAndGet(k, timeout) -- passed.");
+        return true;
+    }
+
+    bool testGetMany() {
+        size_t n = 6;
+        TestSO so(3, 1.5, "many");
+        Value v(&so);
+        Key** keys = new Key*[n];
+        for (size_t i = 0; i < n; i++)
+        {
+            char* name = to_str<size_t>(100 + i);
+            keys[i] = new Key(name, i % 2); // half here, half on s1
+            free(name);
+            if(i != n - 1) s1->put(keys[i], &v); // the last one shows up later
+        }
+
+        ValueFuture** fs = s0->get_many(keys, n);
+        Thread::sleep(100);
+        assert(!fs[n - 1]->ready());
+        s1->put(keys[n - 1], &v);
+        for (size_t i = 0; i < n; i++)
+        {
+            Value* got = fs[i]->get();
+            assert(got->equals(&v));
+            delete(got);
+            delete(fs[i]);
+            delete(keys[i]);
+        }
+        delete[](fs);
+        delete[](keys);
+        assert(s0->pending_.count() == 0);
+
+        OK("KVStore::get_many(keys, n) -- passed.");
+        return true;
+    }
+
+    bool testParkedReduce() {
+        PrimitiveArrayChunk<int> chunk(10);
+        for (int i = 1; i <= 4; i++) chunk.push_back(i);
+        Value v(&chunk);
+        Key early("reduce-early", 1);
+        Key late("reduce-late", 1);
+        Key* keys[2] = { &early, &late };
+        s1->put(&early, &v);
+
+        // the owner parks the reduction instead of holding a worker, so gets still get through
+        ValueFuture* f = s0->reduce_async(keys, 2, 'I');
+        Thread::sleep(100);
+        assert(!f->ready());
+        assert(s1->parked() == 1);
+        Value* got = s0->get(&early);
+        assert(got->equals(&v));
+        delete(got);
+
+        s1->put(&late, &v);
+        got = f->get();
+        Aggregate a = Aggregate::deserialize(SerialView(got->serialized()));
+        assert(a.count() == 8 && a.sum() == 20);
+        assert(s1->parked() == 0);
+        delete(got);
+        delete(f);
+
+        Key never("reduce-never", 1);
+        keys[1] = &never;
+        f = s0->reduce_async(keys, 2, 'I', 200);
+        assert(f->get() == nullptr);
+        assert(s0->pending_.count() == 0 && s1->parked() == 0);
+        delete(f);
+
+        OK("KVStore::reduce_async(keys, n, elem, timeout) before put(k, v) -- passed.");
+        return true;
+    }
+
+    bool testPutBatch() {
+        TestSO so(4, 2.5, "batched");
+        Value v(&so);
+        Key here("batch-here", 0);
+        Key there("batch-there", 1);
+        Key there2("batch-there2", 1);
+        PutBatch batch(s0, 2);
+        batch.put(&here, &v);
+        batch.put(&there, &v);
+        batch.put(&there2, &v);
+        assert(batch.batches_[1]->count() == 2);
+        Value* got = s0->get(&here);
+        assert(got->equals(&v));
+        delete(got);
+
+        batch.flush();
+        assert(batch.batches_[1] == nullptr);
+        got = s0->waitAndGet(&there2);
+        assert(got->equals(&v));
+        delete(got);
+
+        OK("PutBatch::put(k, v) and flush() -- passed.");
+        return true;
+    }
+
+    bool run() {
+        return testGetAsync()
+            && testParkedGet()
+            && testTimeout()
+            && testGetMany()
+            && testParkedReduce()
+            && testPutBatch();
     }
 };
 
 int main() {
-    TestKVStoreNode testNode;
-    testNode.testSuccess();
+    TestKVTable testTable;
+    testTable.testSuccess();
     TestLocalKVStore testLocal;
     testLocal.testSuccess();
+    TestPendingTable testPending;
+    testPending.testSuccess();
+    TestRemoteKVStore testRemote;
+    testRemote.testSuccess();
 }
\ No newline at end of file
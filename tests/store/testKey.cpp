@@ -28,7 +28,9 @@ public:
     }
 
     bool testHash() {
-        size_t val = 31 * ('t' + 'e' + 's' + 't');
+        size_t val = 14695981039346656037UL;
+        for (size_t i = 0; i < 4; i++) val = (val ^ "test"[i]) * 1099511628211UL;
+        val = (val ^ 5) * 1099511628211UL;
         assert(key->hash() == val);
         assert(key->hash() == k->hash());
         assert(key->hash() != not_k->hash());
@@ -95,13 +95,87 @@ public:
         return true;
     }
 
+    bool testMulti() {
+        MultiGet mg(0);
+        mg.id_ = 7;
+        mg.add(k1);
+        mg.add(k2);
+        MultiGet* mg_clone = dynamic_cast<MultiGet *>(msg_deserialize(mg.serialize()));
+        assert(mg_clone->equals(&mg));
+        assert(mg_clone->count() == 2);
+        assert(mg_clone->key(1)->equals(k2));
+
+        SerialString other("longer test string", 18);
+        MultiPut mp(0);
+        mp.add(k1, v->clone());
+        mp.add(k2, new Value(&other));
+        MultiPut* mp_clone = dynamic_cast<MultiPut *>(msg_deserialize(mp.serialize()));
+        assert(mp_clone->equals(&mp));
+        assert(mp_clone->value(1)->serialized()->equals(&other));
+
+        MultiStatus ms(1);
+        ms.add(7, v->clone());
+        ms.add(8, new Value(&other));
+        MultiStatus* ms_clone = dynamic_cast<MultiStatus *>(msg_deserialize(ms.serialize()));
+        assert(ms_clone->equals(&ms));
+        assert(ms_clone->ids_[1] == 8);
+
+        Reduce r(2, 'F');
+        r.id_ = 9;
+        r.timeout_ = 500;
+        r.add(k1);
+        r.add(k2);
+        Reduce* r_clone = dynamic_cast<Reduce *>(msg_deserialize(r.serialize()));
+        assert(r_clone->equals(&r));
+        assert(r_clone->elem_ == 'F' && r_clone->timeout_ == 500);
+        assert(r_clone->count() == 2);
+        assert(!r_clone->equals(&mg));
+
+        delete(mg_clone);
+        delete(mp_clone);
+        delete(ms_clone);
+        delete(r_clone);
+        OK("Message::MultiGet, MultiPut, MultiStatus and Reduce tests - passed.");
+        return true;
+    }
+
+    bool testRequestId() {
+        Get req(k1);
+        req.id_ = 42;
+        req.timeout_ = 250;
+        Get* g_clone = Get::deserialize(req.serialize());
+        assert(g_clone->id_ == 42);
+        assert(g_clone->timeout_ == 250);
+        assert(g_clone->equals(&req));
+
+        Status reply(0, v);
+        reply.id_ = 42;
+        Message* s_clone = msg_deserialize(reply.serialize());
+        assert(s_clone->id_ == 42);
+        assert(s_clone->equals(&reply));
+
+        Fail f(k1);
+        f.id_ = 43;
+        Message* f_clone = msg_deserialize(f.serialize());
+        assert(f_clone->id_ == 43);
+        assert(!f_clone->equals(&req));
+
+        delete(g_clone);
+        delete(s_clone);
+        delete(f_clone);
+        OK("Message request ids - passed.");
+        return true;
+    }
+
     bool run() {
         return testRegister()
             && testGet()
             && testPut()
             && testStatus()
             && testDirectory()
-            && testMsgDeserialize();
+            && testMsgDeserialize()
+            && testRequestId()
+            && testMulti();
     }
 };
 
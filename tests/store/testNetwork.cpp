@@ -123,7 +123,187 @@ public:
     }
 };
 
+class TestMsgChannel : public Test {
+public:
+    MsgChannel ch;
+
+    bool testFifo() {
+        Key k("test", 0);
+        for (size_t i = 0; i < 40; i++) // enough to wrap and grow the ring
+        {
+            Get* g = new Get(&k);
+            g->sender_ = i;
+            ch.push(g);
+            if(i % 3 == 0) {
+                Message* m = ch.pop(0);
+                assert(m->sender_ == i - (2 * i / 3));
+                delete(m);
+            }
+        }
+        assert(ch.count() == 26);
+        for (size_t i = 14; i < 40; i++)
+        {
+            Message* m = ch.pop(0);
+            assert(m->sender_ == i);
+            delete(m);
+        }
+        assert(ch.pop(10) == nullptr);
+
+        OK("MsgChannel push/pop order -- passed.");
+        return true;
+    }
+
+    bool run() { return testFifo(); }
+};
+
+class ReceiveThread : public Thread {
+public:
+    NetworkIfc* net_;
+    Message* received_; // not owned
+
+    ReceiveThread(NetworkIfc* net) {
+        net_ = net;
+        received_ = nullptr;
+    }
+
+    void run() {
+        while(received_ == nullptr) received_ = net_->receive_message();
+    }
+};
+
+class TestNetworkIP : public Test {
+public:
+    NetworkIP net0;
+    NetworkIP net1;
+
+    TestNetworkIP() {
+        unsigned ports[2] = { 9310, 9311 };
+        setup(net0, 0, ports);
+        setup(net1, 1, ports);
+    }
+
+    // two nodes on localhost, set up without registering through a server
+    void setup(NetworkIP& net, size_t idx, unsigned* ports) {
+        net.this_node_ = idx;
+        net.init_sock_(ports[idx]);
+        net.nodes_ = new NodeInfo[2];
+        net.init_nodes_(2);
+        for (size_t i = 0; i < 2; i++)
+        {
+            net.nodes_[i].id = i;
+            net.nodes_[i].address.sin_family = AF_INET;
+            net.nodes_[i].address.sin_port = htons(ports[i]);
+            inet_pton(AF_INET, "127.0.0.1", &net.nodes_[i].address.sin_addr);
+        }
+    }
+
+    // sends a clone of the message from net0 to net1 and checks it arrived intact
+    bool roundTrip(Message* m) {
+        ReceiveThread rt(&net1);
+        rt.start();
+        net0.send_message(dynamic_cast<Message *>(m->clone()));
+        rt.join();
+        bool same = m->equals(rt.received_);
+        delete(rt.received_);
+        return same;
+    }
+
+    bool testPersistentConnection() {
+        Key k("test", 1);
+        Get g(&k);
+        g.sender_ = 0;
+        assert(roundTrip(&g));
+        int conn = net0.nodes_[1].conn;
+        assert(conn >= 0);
+
+        SerialString ss("value", 5);
+        Value v(&ss);
+        Put p(&k, &v);
+        p.sender_ = 0;
+        assert(roundTrip(&p));
+        assert(net0.nodes_[1].conn == conn); // reused the connection
+        assert(net1.reactor_->num_conns_ == 1); // accepted a single connection
+
+        OK("NetworkIP::send_message(msg) persistent connection -- passed.");
+        return true;
+    }
+
+    bool testReconnect() {
+        // drop our connection, the next send has to open a new one
+        close(net0.nodes_[1].conn);
+        net0.nodes_[1].conn = -1;
+
+        Key k("again", 1);
+        Get g(&k);
+        g.sender_ = 0;
+        assert(roundTrip(&g));
+        assert(net0.nodes_[1].conn >= 0);
+
+        OK("NetworkIP::send_message(msg) reconnect -- passed.");
+        return true;
+    }
+
+    bool testManyFrames() {
+        // frames sent back to back arrive whole and in order
+        Key k("many", 1);
+        for (size_t i = 0; i < 100; i++)
+        {
+            Get* g = new Get(&k);
+            g->sender_ = i;
+            net0.send_message(g);
+        }
+        for (size_t i = 0; i < 100; i++)
+        {
+            Message* m = nullptr;
+            while(m == nullptr) m = net1.receive_message();
+            assert(m->type_ == MsgType::Get);
+            assert(dynamic_cast<Get *>(m)->k_->equals(&k));
+            delete(m);
+        }
+        assert(net1.receive_message() == nullptr); // times out when there's nothing left
+
+        OK("NetworkIP::receive_message() frame decoding -- passed.");
+        return true;
+    }
+
+    bool testLargeFrame() {
+        // values big enough to be written from where they are rather than copied into the frame
+        size_t sz = 1 << 20;
+        char* data = new char[sz];
+        for (size_t i = 0; i < sz; i++) data[i] = (char)(i * 7);
+        SerialString ss(data, sz);
+        Value v(&ss);
+        Key k("large", 1);
+
+        MultiPut* mp = new MultiPut(1);
+        mp->add(&k, v.clone());
+        mp->add(&k, v.clone());
+        MultiPut* expected = dynamic_cast<MultiPut *>(mp->clone());
+        net0.send_message(mp);
+
+        Message* m = nullptr;
+        while(m == nullptr) m = net1.receive_message();
+        expected->sender_ = m->sender_;
+        assert(m->equals(expected));
+
+        delete(m);
+        delete(expected);
+        delete[](data);
+
+        OK("NetworkIP::send_message(msg) large values -- passed.");
+        return true;
+    }
+
+    bool run() {
+        return testPersistentConnection() && testReconnect() && testManyFrames() && testLargeFrame();
+    }
+};
+
 int main() {
     TestPseudoNetwork pseudo;
     pseudo.testSuccess();
+    TestMsgChannel channel;
+    channel.testSuccess();
+    TestNetworkIP ip;
+    ip.testSuccess();
 }
\ No newline at end of file
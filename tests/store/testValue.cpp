@@ -125,10 +125,20 @@ public:
     // }
 
     bool testClone() {
+        size_t copied = Value::bytes_copied();
         Value* reg_clone = v_reg->clone();
         // CachableValue* cache_clone = dynamic_cast<CachableValue *>(v_cache->clone());
 
         assert(reg_clone->serialized_->equals(v_reg->serialized_));
+        assert(reg_clone->serialized() == v_reg->serialized()); // shared, not copied
+        assert(Value::bytes_copied() == copied);
+
+        // the bytes outlive the value they came from
+        Value* orig = new Value(so2);
+        Value* orig_clone = orig->clone();
+        delete(orig);
+        assert(orig_clone->serialized()->equals(so2->serialize()));
+        delete(orig_clone);
         // assert(strcmp(cache_clone->file_, v_cache->file_) == 0);
         // assert(cache_clone->size_ == v_cache->size_);
         // assert(cache_clone->position_ == v_cache->position_);
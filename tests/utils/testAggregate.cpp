@@ -0,0 +1,129 @@
+#include <assert.h>
+#include <stdlib.h>
+
+#include "../test.h"
+#include "../../src/utils/primitivearray.h"
+
+#define VALUES 10007 // not a multiple of any vector width
+
+class TestAggregate : public Test {
+public:
+    int* ints_;
+    double* doubles_;
+    bool* bools_;
+
+    TestAggregate() {
+        srand(4500);
+        ints_ = new int[VALUES];
+        doubles_ = new double[VALUES];
+        bools_ = new bool[VALUES];
+        for (size_t i = 0; i < VALUES; i++)
+        {
+            ints_[i] = rand() - RAND_MAX / 2;
+            doubles_[i] = (rand() - RAND_MAX / 2) / 1000.0;
+            bools_[i] = rand() % 3 == 0;
+        }
+    }
+
+    ~TestAggregate() {
+        delete[](ints_);
+        delete[](doubles_);
+        delete[](bools_);
+    }
+
+    // checks a against a two pass reference over n values
+    template<class T> void check_(Aggregate a, const T* v, size_t n) {
+        assert(a.count() == n);
+        long double sum = 0;
+        double min = v[0], max = v[0];
+        for (size_t i = 0; i < n; i++)
+        {
+            sum += v[i];
+            if(v[i] < min) min = v[i];
+            if(v[i] > max) max = v[i];
+        }
+        long double mean = sum / n;
+        long double m2 = 0;
+        for (size_t i = 0; i < n; i++) m2 += (v[i] - mean) * (v[i] - mean);
+        assert(fabsl(a.sum() - sum) <= 1e-9 * fabsl(sum) + 1e-9);
+        assert(a.min() == min && a.max() == max);
+        assert(fabsl(a.variance() - m2 / n) <= 1e-9 * (m2 / n) + 1e-12);
+    }
+
+    // checks every length up to 100 and a long run, starting off of any alignment
+    template<class T> void check_all_(const T* v) {
+        for (size_t n = 1; n <= 100; n++) check_(aggregate_of(v + n % 8, n), v + n % 8, n);
+        check_(aggregate_of(v + 1, VALUES - 1), v + 1, VALUES - 1);
+    }
+
+    bool testKernels() {
+        int best = simd_level();
+        for (int level = SIMD_SCALAR; level <= best; level++)
+        {
+            set_simd_level(level);
+            assert(simd_level() == level);
+            check_all_(ints_);
+            check_all_(doubles_);
+            check_all_(bools_);
+            assert(aggregate_of(ints_, 0).count() == 0);
+            assert(isnan(aggregate_of(doubles_, 0).mean()));
+        }
+        set_simd_level(SIMD_AVX2);
+        assert(simd_level() == best);
+
+        // the sum of ints is exact even past what an int holds
+        int big[9] = { 2147483647, 2147483647, 2147483647, 2147483647, 2147483647, 2147483647, 2147483647, 2147483647, 2147483647 };
+        assert(aggregate_of(big, 9).sum() == 9.0 * 2147483647);
+        OK("aggregate_of(v, n) at every simd level -- passed.");
+        return true;
+    }
+
+    bool testMerge() {
+        Aggregate all = aggregate_of(doubles_, VALUES);
+        Aggregate merged;
+        for (size_t i = 0; i < VALUES; i += 1000)
+        {
+            Aggregate part = aggregate_of(doubles_ + i, i + 1000 < VALUES ? 1000 : VALUES - i);
+            merged.merge(part);
+        }
+        assert(merged.count() == all.count());
+        assert(merged.min() == all.min() && merged.max() == all.max());
+        assert(fabs(merged.sum() - all.sum()) <= 1e-9 * fabs(all.sum()));
+        assert(fabs(merged.variance() - all.variance()) <= 1e-9 * all.variance());
+
+        Serializer s;
+        all.serialize_into(s);
+        SerialString* ss = s.to_serial();
+        Aggregate back = Aggregate::deserialize(SerialView(ss));
+        assert(back.equals(&all));
+        delete(ss);
+        OK("Aggregate::merge(other) and serialization -- passed.");
+        return true;
+    }
+
+    bool testArray() {
+        PrimitiveArray<int> arr(64);
+        for (size_t i = 0; i < VALUES; i++) arr.push_back(ints_[i]);
+        Aggregate a = arr.aggregate();
+        check_(a, ints_, VALUES);
+
+        // a serialized chunk is aggregated where it is
+        SerialString* ss = arr.data_[1]->serialize();
+        Aggregate chunk = aggregate_chunk('I', SerialView(ss));
+        check_(chunk, ints_ + 64, 64);
+        delete(ss);
+        OK("PrimitiveArray::aggregate() and aggregate_chunk(type, view) -- passed.");
+        return true;
+    }
+
+    bool run() {
+        return testKernels()
+            && testMerge()
+            && testArray();
+    }
+};
+
+int main() {
+    TestAggregate test;
+    test.testSuccess();
+}
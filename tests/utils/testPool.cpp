@@ -0,0 +1,89 @@
+#include <assert.h>
+
+#include "../test.h"
+#include "../../src/utils/pool.h"
+
+/** Adds one to a counter, optionally after spawning more of itself on the same pool */
+class CountTask : public Task {
+public:
+    ThreadPool* pool_; // external
+    std::atomic<size_t>* count_; // external
+    size_t children_;
+
+    CountTask(ThreadPool* pool, std::atomic<size_t>* count, size_t children) {
+        pool_ = pool;
+        count_ = count;
+        children_ = children;
+    }
+
+    void run() override {
+        TaskGroup g;
+        for (size_t i = 0; i < children_; i++) pool_->submit(new CountTask(pool_, count_, 0), &g);
+        pool_->wait(g);
+        (*count_)++;
+    }
+};
+
+class TestPool : public Test {
+public:
+    bool testQueue() {
+        TaskQueue q;
+        Task* ts[100];
+        for (size_t i = 0; i < 100; i++)
+        {
+            ts[i] = new Task();
+            q.push(ts[i]);
+        }
+        assert(q.capacity_ >= 100);
+        assert(q.pop() == ts[99]);
+        assert(q.steal() == ts[0]);
+        assert(q.steal() == ts[1]);
+        assert(q.pop() == ts[98]);
+        while(q.count_ > 0) q.pop();
+        assert(q.pop() == nullptr);
+        assert(q.steal() == nullptr);
+        for (size_t i = 0; i < 100; i++) delete(ts[i]);
+        OK("TaskQueue push, pop and steal -- passed.");
+        return true;
+    }
+
+    bool testRun() {
+        ThreadPool pool(4);
+        std::atomic<size_t> count(0);
+        TaskGroup g;
+        for (size_t i = 0; i < 1000; i++) pool.submit(new CountTask(&pool, &count, 0), &g);
+        pool.wait(g);
+        assert(count == 1000);
+
+        // the pool can be reused, and tasks can wait on tasks of their own
+        TaskGroup nested;
+        for (size_t i = 0; i < 50; i++) pool.submit(new CountTask(&pool, &count, 10), &nested);
+        pool.wait(nested);
+        assert(count == 1000 + 50 * 11);
+        OK("ThreadPool submit and wait -- passed.");
+        return true;
+    }
+
+    bool testShared() {
+        assert(ThreadPool::shared() == ThreadPool::shared());
+        assert(ThreadPool::shared()->size() >= 1);
+        std::atomic<size_t> count(0);
+        TaskGroup g;
+        ThreadPool::shared()->submit(new CountTask(ThreadPool::shared(), &count, 3), &g);
+        ThreadPool::shared()->wait(g);
+        assert(count == 4);
+        OK("ThreadPool::shared() -- passed.");
+        return true;
+    }
+
+    bool run() {
+        return testQueue()
+            && testRun()
+            && testShared();
+    }
+};
+
+int main() {
+    TestPool test;
+    test.testSuccess();
+}
@@ -46,8 +46,8 @@ public:
         String s2("test2");
         strchunk->set(0, &s2);
 
-        assert(s2.equals(strchunk->data_[0]));
-        assert(!s1.equals(strchunk->data_[0]));
+        assert(s2.equals(strchunk->get(0)));
+        assert(!s1.equals(strchunk->get(0)));
         
         OK("PrimitiveArrayChunk::set(idx, v) -- passed.");
         return true;
@@ -124,12 +124,286 @@ public:
         return true;
     }
 
+    bool testArraySerialization() {
+        PrimitiveArray<int> ints(16);
+        StringArray strs(4);
+        for (size_t i = 0; i < 100; i++)
+        {
+            ints.push_back(i);
+            String s(i % 2 == 0 ? "even" : "odd");
+            strs.push_back(&s);
+        }
+
+        // both arrays in one buffer, each read off of a borrowed view of it
+        Serializer ser;
+        ints.serialize_into(ser);
+        strs.serialize_into(ser);
+        SerialString* ss = ser.to_serial();
+
+        Deserializer d(ss);
+        PrimitiveArray<int>* ints_ds = PrimitiveArray<int>::deserialize(d);
+        StringArray* strs_ds = StringArray::deserialize(d);
+        assert(d.remaining() == 0);
+        assert(ints_ds->equals(&ints));
+        assert(strs_ds->equals(&strs));
+        assert(StringArrayChunk::quick_deserialize(strs.data_[1]->serialize(), 3)->equals(strs.get(7)));
+
+        delete(ss);
+        delete(ints_ds);
+        delete(strs_ds);
+
+        OK("PrimitiveArray and StringArray deserialize(d) -- passed.");
+        return true;
+    }
+
+    bool testBoolChunk() {
+        PrimitiveArrayChunk<bool> bools(1000);
+        for (size_t i = 0; i < 999; i++) assert(bools.push_back(i % 3 == 0));
+        bools.set(1, true);
+        assert(bools.get(0) && bools.get(1) && !bools.get(2) && bools.get(3));
+        assert(bools.trues() == 334);
+        assert(bools.aggregate().sum() == 334);
+
+        // a bit per value, and only the words in use are sent
+        SerialString* ssb = bools.serialize();
+        assert(ssb->size_ == 2 * sizeof(size_t) + bitmap_words(999) * sizeof(uint64_t));
+        PrimitiveArrayChunk<bool>* bools_ds = PrimitiveArrayChunk<bool>::deserialize(ssb);
+        assert(bools_ds->equals(&bools));
+        assert(bools_ds->count() == 999);
+        for (size_t i = 0; i < 999; i += 7)
+        {
+            assert(PrimitiveArrayChunk<bool>::quick_deserialize(ssb, i) == bools.get(i));
+        }
+        assert(PrimitiveArrayChunk<bool>::quick_aggregate(SerialView(ssb)).sum() == 334);
+
+        bool* out = new bool[999];
+        PrimitiveArrayChunk<bool>::quick_copy(SerialView(ssb), out);
+        for (size_t i = 0; i < 999; i++) assert(out[i] == bools.get(i));
+
+        bools_ds->set(998, !bools.get(998));
+        assert(!bools_ds->equals(&bools));
+
+        delete[](out);
+        delete(bools_ds);
+        delete(ssb);
+
+        OK("PrimitiveArrayChunk<bool> as a bitmap -- passed.");
+        return true;
+    }
+
+    bool testStringChunk() {
+        StringArrayChunk chunk(3000);
+        char buf[32];
+        for (size_t i = 0; i < 2500; i++)
+        {
+            snprintf(buf, sizeof(buf), "%zu", i * i);
+            String s(i % 10 == 0 ? "" : buf);
+            assert(chunk.push_back(&s));
+        }
+        // views stay put as the heap grows and strings around them change
+        String* first = chunk.get(1);
+        String* last = chunk.get(2499);
+        String longer("a much longer string than was there before");
+        String shorter("x");
+        chunk.set(1, &longer);
+        chunk.set(2498, &shorter);
+        assert(chunk.push_back(chunk.get(1)));
+        assert(first == chunk.get(1) && first->equals(&longer));
+        assert(last == chunk.get(2499) && strcmp(last->c_str(), "6245001") == 0);
+        assert(chunk.get(2500)->equals(&longer) && chunk.get(2498)->equals(&shorter));
+        assert(chunk.get(0)->size() == 0 && chunk.get(0)->c_str()[0] == 0);
+        assert(chunk.views(1024) + 1 == chunk.get(1025));
+
+        // the dictionary's offsets and heap as they are in memory, then two byte codes
+        SerialString* ss = chunk.serialize();
+        assert(chunk.entries() == 2250 + 3);
+        assert(ss->size_ == 4 * sizeof(size_t) + sizeof(uint32_t) * (chunk.entries() + 1) + chunk.heap_size() + 2 * 2501);
+        StringArrayChunk* ds = StringArrayChunk::deserialize(ss);
+        assert(ds->equals(&chunk) && ds->count() == 2501);
+        for (size_t i = 0; i < 2501; i += 7)
+        {
+            assert(ds->get(i)->equals(chunk.get(i)));
+            String* qs = StringArrayChunk::quick_deserialize(ss, i);
+            assert(qs->equals(chunk.get(i)));
+            delete(qs);
+        }
+        size_t len;
+        const char* v = StringArrayChunk::quick_view(SerialView(ss), 2499, &len);
+        assert(len == 7 && strcmp(v, "6245001") == 0);
+
+        StringArrayChunk* cl = ds->clone();
+        cl->set(2000, &shorter);
+        assert(!cl->equals(ds) && cl->get(2001)->equals(ds->get(2001)));
+
+        delete(cl);
+        delete(ds);
+        delete(ss);
+        OK("StringArrayChunk offsets and heap -- passed.");
+        return true;
+    }
+
+    bool testStringDictionary() {
+        const char* words[4] = { "apple", "banana", "cherry", "" };
+        StringArrayChunk chunk(2000);
+        size_t bytes = 0;
+        for (size_t i = 0; i < 2000; i++)
+        {
+            String s(words[i * i % 4]);
+            chunk.push_back(&s);
+            bytes += s.size();
+        }
+        assert(chunk.entries() == 2);
+        String date("date");
+        chunk.set(2, &date);
+        assert(chunk.entries() == 3);
+
+        // equal strings have equal codes
+        uint32_t code;
+        assert(chunk.find(&date, &code) && chunk.code(2) == code);
+        String missing("cherry");
+        assert(!chunk.find(&missing, &code));
+        for (size_t i = 0; i < 2000; i++)
+        {
+            assert(chunk.get(i)->equals(i == 2 ? &date : chunk.get(i % 2)));
+            assert((chunk.code(i) == chunk.code(0)) == chunk.get(i)->equals(chunk.get(0)));
+        }
+
+        // a byte of code per string rather than its characters
+        SerialString* ss = chunk.serialize();
+        assert(ss->size_ < 100 + 2000 && ss->size_ < bytes / 2);
+        StringArrayChunk* ds = StringArrayChunk::deserialize(ss);
+        assert(ds->equals(&chunk) && ds->entries() == 3);
+        String* qs = StringArrayChunk::quick_deserialize(ss, 2);
+        assert(qs->equals(&date));
+
+        // distinct strings don't send codes at all
+        StringArrayChunk distinct(100);
+        char buf[16];
+        for (size_t i = 0; i < 100; i++)
+        {
+            snprintf(buf, sizeof(buf), "%zu", i);
+            String n(buf);
+            distinct.push_back(&n);
+        }
+        SerialString* ssd = distinct.serialize();
+        assert(ssd->size_ == 4 * sizeof(size_t) + sizeof(uint32_t) * 101 + distinct.heap_size());
+        StringArrayChunk* dsd = StringArrayChunk::deserialize(ssd);
+        assert(dsd->equals(&distinct) && dsd->code(42) == 42);
+
+        delete(qs);
+        delete(ds);
+        delete(ss);
+        delete(dsd);
+        delete(ssd);
+        OK("StringArrayChunk dictionary -- passed.");
+        return true;
+    }
+
+    // the encoding a serialized chunk was written in
+    ChunkEncoding encoding_(SerialString* ss) {
+        Deserializer d(ss);
+        d.read_size();
+        d.read_size();
+        return read_chunk_encoding(d);
+    }
+
+    // round trips the values through every way of reading a serialized chunk, returning its encoding
+    template<class T> ChunkEncoding roundTrip_(T* values, size_t n) {
+        PrimitiveArrayChunk<T> chunk(n + 10);
+        for (size_t i = 0; i < n; i++) chunk.push_back(values[i]);
+        SerialString* ss = chunk.serialize();
+        PrimitiveArrayChunk<T>* ds = PrimitiveArrayChunk<T>::deserialize(ss);
+        assert(ds->equals(&chunk) && ds->capacity_ == n + 10);
+        T* copy = new T[n];
+        PrimitiveArrayChunk<T>::quick_copy(SerialView(ss), copy);
+        for (size_t i = 0; i < n; i++)
+        {
+            assert(PrimitiveArrayChunk<T>::quick_deserialize(ss, i) == values[i]);
+            assert(copy[i] == values[i]);
+        }
+        Aggregate a = chunk.aggregate();
+        assert(n == 0 || PrimitiveArrayChunk<T>::quick_aggregate(SerialView(ss)).equals(&a));
+        ChunkEncoding enc = encoding_(ss);
+        delete[](copy);
+        delete(ds);
+        delete(ss);
+        return enc;
+    }
+
+    bool testEncodings() {
+        size_t n = 1000;
+        int* ints = new int[n];
+        double* doubles = new double[n];
+
+        for (size_t i = 0; i < n; i++) ints[i] = 7;
+        assert(roundTrip_(ints, n) == CHUNK_FOR);
+        for (size_t i = 0; i < n; i++) ints[i] = -500 + 3 * (int)i;
+        assert(roundTrip_(ints, n) == CHUNK_DELTA);
+        for (size_t i = 0; i < n; i++) ints[i] = 1000000 + (int)(i * 7919 % 60000);
+        assert(roundTrip_(ints, n) == CHUNK_FOR);
+        for (size_t i = 0; i < n; i++) ints[i] = (int)(i * 100 + i % 7);
+        assert(roundTrip_(ints, n) == CHUNK_DELTA);
+        for (size_t i = 0; i < n; i++) ints[i] = i % 2 == 0 ? INT32_MIN : INT32_MAX;
+        assert(roundTrip_(ints, n) == CHUNK_PLAIN);
+        for (size_t i = 0; i < n; i++) ints[i] = (int)(i / 100) * 123456789;
+        assert(roundTrip_(ints, n) == CHUNK_RLE);
+        for (size_t i = 0; i < n; i++) ints[i] = (int)(i * 2654435761u);
+        assert(roundTrip_(ints, n) == CHUNK_PLAIN);
+        assert(roundTrip_(ints, 1) == CHUNK_PLAIN);
+        assert(roundTrip_(ints, 0) == CHUNK_PLAIN);
+
+        for (size_t i = 0; i < n; i++) doubles[i] = i / 3.0;
+        assert(roundTrip_(doubles, n) == CHUNK_PLAIN);
+        for (size_t i = 0; i < n; i++) doubles[i] = i < 600 ? 0.5 : -0.0;
+        assert(roundTrip_(doubles, n) == CHUNK_RLE);
+
+        // a lone value in a big chunk costs its header and itself
+        PrimitiveArrayChunk<double> scalar(1 << 16);
+        scalar.push_back(3.5);
+        SerialString* ss = scalar.serialize();
+        assert(ss->size_ == 3 * sizeof(size_t) + sizeof(double));
+        delete(ss);
+
+        delete[](ints);
+        delete[](doubles);
+        OK("PrimitiveArrayChunk encodings -- passed.");
+        return true;
+    }
+
+    bool testDeltaCheckpoints() {
+        // a whole int column chunk of ascending ids with uneven gaps
+        size_t n = 128000;
+        PrimitiveArrayChunk<int> chunk(n);
+        for (size_t i = 0; i < n; i++) chunk.push_back((int)(i * 3 + i % 5));
+        SerialString* ss = chunk.serialize();
+        assert(encoding_(ss) == CHUNK_DELTA);
+        assert(ss->size_ < n * 2);
+        assert(PrimitiveArrayChunk<int>::quick_deserialize(ss, n - 1) == chunk.get(n - 1));
+        for (size_t i = 0; i < n; i += 37)
+        {
+            assert(PrimitiveArrayChunk<int>::quick_deserialize(ss, i) == chunk.get(i));
+        }
+        for (size_t i = DELTA_CHECKPOINT - 1; i <= DELTA_CHECKPOINT + 1; i++)
+        {
+            assert(PrimitiveArrayChunk<int>::quick_deserialize(ss, i) == chunk.get(i));
+        }
+        delete(ss);
+        OK("PrimitiveArrayChunk delta checkpoints -- passed.");
+        return true;
+    }
+
     bool run() {
         return testPushBack() 
             && testSet() 
             && testGet()
             && testCloneAndEquals() 
-            && testSerialization();
+            && testSerialization()
+            && testArraySerialization()
+            && testBoolChunk()
+            && testEncodings()
+            && testDeltaCheckpoints()
+            && testStringChunk()
+            && testStringDictionary();
     }
 };
 
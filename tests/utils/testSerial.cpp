@@ -0,0 +1,78 @@
+#include <assert.h>
+
+#include "../test.h"
+#include "../../src/utils/serial.h"
+
+class TestSerial : public Test {
+public:
+    char* big = new char[SERIAL_BORROW_MIN * 2];
+
+    TestSerial() {
+        for (size_t i = 0; i < SERIAL_BORROW_MIN * 2; i++) big[i] = (char)i;
+    }
+
+    ~TestSerial() {
+        delete[](big);
+    }
+
+    bool testWriteRead() {
+        Serializer s;
+        s.write_size(42);
+        s.write("abc", 3);
+        s.write_size(7);
+        assert(s.size() == 2 * sizeof(size_t) + 3);
+
+        SerialString* ss = s.to_serial();
+        Deserializer d(ss);
+        assert(d.read_size() == 42);
+        SerialView abc = d.read_bytes(3);
+        assert(abc.data_ == ss->data_ + sizeof(size_t)); // borrowed, not copied
+        assert(memcmp(abc.data_, "abc", 3) == 0);
+        assert(d.read_size() == 7);
+        assert(d.remaining() == 0);
+        delete(ss);
+
+        OK("Serializer::write(data, len) and Deserializer::read() -- passed.");
+        return true;
+    }
+
+    bool testBorrow() {
+        Serializer s;
+        size_t at = s.reserve_size();
+        s.borrow("small", 5); // too small to be worth borrowing
+        s.borrow(big, SERIAL_BORROW_MIN * 2);
+        s.write_size(9);
+        s.patch_size(at, s.size() - sizeof(size_t));
+
+        iovec* iov;
+        assert(s.iov(&iov) == 3);
+        assert(iov[1].iov_base == big);
+        assert(iov[0].iov_len == sizeof(size_t) + 5);
+
+        SerialString* ss = s.to_serial();
+        Deserializer d(ss);
+        assert(d.read_size() == ss->size_ - sizeof(size_t));
+        assert(memcmp(d.read_bytes(5).data_, "small", 5) == 0);
+        assert(memcmp(d.read_bytes(SERIAL_BORROW_MIN * 2).data_, big, SERIAL_BORROW_MIN * 2) == 0);
+        assert(d.read_size() == 9);
+        delete(ss);
+
+        // reuse keeps nothing from before
+        s.clear();
+        s.write_size(1);
+        assert(s.size() == sizeof(size_t));
+        assert(s.iov(&iov) == 1);
+
+        OK("Serializer::borrow(data, len) and iov(out) -- passed.");
+        return true;
+    }
+
+    bool run() {
+        return testWriteRead() && testBorrow();
+    }
+};
+
+int main() {
+    TestSerial test;
+    test.testSuccess();
+}